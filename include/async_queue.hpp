@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "db.hpp"
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define ASYNC_QUEUE_COROUTINES 1
+#endif
+#endif
+
+/*
+ *  A submission and completion ring in front of a DB, for a thread that
+ *  serves many clients and wants many operations in flight rather than
+ *  blocking on each. A queue belongs to one thread.
+ *
+ *  Submit* copies an operation into the ring. Poll runs everything
+ *  submitted so far: a run of consecutive Gets goes to the engine as one
+ *  MultiGet, which overlaps their memory accesses, and the other operations
+ *  run one by one in submission order, so operations on one key complete in
+ *  the order they were submitted. A finished operation either has its
+ *  callback called by Poll or waits in the ring until Reap hands it out.
+ */
+class AsyncQueue {
+public:
+    enum OpType : unsigned char {
+        kGet,
+        kSet,
+        kDelete
+    };
+
+    struct Completion {
+        uint64_t user_data;
+        OpType type;
+        Status status;
+        // What a Get found.
+        std::string value;
+    };
+
+    /*
+     *  Called by Poll with the status of the operation and, for a Get, the
+     *  value, which the callback may swap out. A callback may submit more
+     *  operations but must not call Poll.
+     */
+    typedef std::function<void(Status status, std::string* value)> Callback;
+
+    /*
+     *  capacity bounds the operations in the ring: submitted and not yet
+     *  completed, or completed without a callback and not yet reaped.
+     */
+    AsyncQueue(DB* db, size_t capacity);
+
+    /*
+     *  Queue an operation. Without a callback its completion is reaped
+     *  with user_data. Returns false when the ring is full.
+     */
+    bool SubmitGet(const Slice& key, uint64_t user_data, Callback callback = Callback());
+    bool SubmitSet(const Slice& key, const Slice& value, uint32_t ttl, uint64_t user_data,
+                   Callback callback = Callback());
+    bool SubmitDelete(const Slice& key, uint64_t user_data, Callback callback = Callback());
+
+    /*
+     *  Run every submitted operation. Returns how many were run.
+     */
+    size_t Poll();
+
+    /*
+     *  Move up to n completions into out, oldest first. Returns how many.
+     */
+    size_t Reap(Completion* out, size_t n);
+
+    /*
+     *  Operations submitted and not yet run.
+     */
+    size_t submitted() const {
+        return tail_ - run_;
+    }
+
+#ifdef ASYNC_QUEUE_COROUTINES
+    class Operation;
+
+    /*
+     *  co_await queue.Get(key, &value) in a coroutine resumed by the thread
+     *  that polls the queue: it suspends until Poll has run the Get. When
+     *  the ring is full the operation runs at once instead.
+     */
+    Operation Get(const Slice& key, std::string* value);
+    Operation Set(const Slice& key, const Slice& value, uint32_t ttl = 0);
+    Operation Delete(const Slice& key);
+#endif
+
+private:
+    struct Entry {
+        OpType type;
+        Status status;
+        uint32_t ttl;
+        uint64_t user_data;
+        std::string key;
+        std::string value;
+        Callback callback;
+        // The entry's slot is free again once its callback has returned,
+        // or, without a callback, once it is reaped.
+        bool has_callback;
+        bool called_back;
+    };
+
+    Entry* At(uint64_t position) {
+        return &ring_[position % ring_.size()];
+    }
+
+    bool Submit(OpType type, const Slice& key, const Slice& value, uint32_t ttl,
+                uint64_t user_data, Callback* callback);
+
+    // Runs the Gets from position run_ on, up to the first other operation.
+    size_t RunGets();
+
+    void Complete(Entry* e);
+
+    // Frees the completed operations at the head whose callback has run.
+    void SkipCalledBack();
+
+    DB* const db_;
+    std::vector<Entry> ring_;
+    // Positions grow without wrapping: [head_, run_) have completed,
+    // [run_, tail_) wait for Poll.
+    uint64_t head_;
+    uint64_t run_;
+    uint64_t tail_;
+
+    // MultiGet arguments, reused across Polls.
+    std::vector<Slice> keys_;
+    std::vector<std::string> values_;
+    std::vector<Status> statuses_;
+
+    AsyncQueue(const AsyncQueue&);
+    void operator=(const AsyncQueue&);
+};
+
+#ifdef ASYNC_QUEUE_COROUTINES
+class AsyncQueue::Operation {
+public:
+    bool await_ready() const {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        Callback resume = [this, handle](Status status, std::string* value) {
+            status_ = status;
+            if (value_ != nullptr) {
+                value_->swap(*value);
+            }
+            handle.resume();
+        };
+        bool queued;
+        switch (type_) {
+        case kGet:
+            queued = queue_->SubmitGet(key_, 0, std::move(resume));
+            break;
+        case kSet:
+            queued = queue_->SubmitSet(key_, input_, ttl_, 0, std::move(resume));
+            break;
+        default:
+            queued = queue_->SubmitDelete(key_, 0, std::move(resume));
+            break;
+        }
+        if (!queued) {
+            RunNow();
+        }
+        return queued;
+    }
+
+    Status await_resume() const {
+        return status_;
+    }
+
+private:
+    friend class AsyncQueue;
+
+    Operation(AsyncQueue* queue, OpType type, const Slice& key, const Slice& input,
+              uint32_t ttl, std::string* value)
+        : queue_(queue), type_(type), key_(key), input_(input), ttl_(ttl), value_(value),
+          status_(IOError) {}
+
+    void RunNow() {
+        DB* db = queue_->db_;
+        switch (type_) {
+        case kGet: {
+            std::string ignored;
+            status_ = db->Get(key_, value_ != nullptr ? value_ : &ignored);
+            break;
+        }
+        case kSet:
+            status_ = ttl_ != 0 ? db->Set(key_, input_, ttl_) : db->Set(key_, input_);
+            break;
+        default:
+            status_ = db->Delete(key_);
+            break;
+        }
+    }
+
+    AsyncQueue* queue_;
+    OpType type_;
+    Slice key_;
+    Slice input_;
+    uint32_t ttl_;
+    std::string* value_;
+    Status status_;
+};
+
+inline AsyncQueue::Operation AsyncQueue::Get(const Slice& key, std::string* value) {
+    return Operation(this, kGet, key, Slice(), 0, value);
+}
+
+inline AsyncQueue::Operation AsyncQueue::Set(const Slice& key, const Slice& value, uint32_t ttl) {
+    return Operation(this, kSet, key, value, ttl, nullptr);
+}
+
+inline AsyncQueue::Operation AsyncQueue::Delete(const Slice& key) {
+    return Operation(this, kDelete, key, Slice(), 0, nullptr);
+}
+#endif
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <emmintrin.h>
+
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <string>
@@ -36,12 +39,17 @@ public:
         return _size;
     }
 
-    bool operator==(const Slice& b) {
-        if (b.size() == this->_size && memcmp(this->_data, b.data(), b.size()) == 0) {
-            return true;
-        } else {
+    bool operator==(const Slice& b) const {
+        if (b.size() != this->_size) {
             return false;
         }
+        // Keys are 16 bytes in the common case: compare them in one go.
+        if (this->_size == 16) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(this->_data));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b.data()));
+            return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xffff;
+        }
+        return memcmp(this->_data, b.data(), b.size()) == 0;
     }
 
     std::string to_string() {
@@ -57,6 +65,14 @@ private:
     uint64_t _size;
 };
 
+/*
+ *  A consistent point-in-time view of a db, from DB::GetSnapshot.
+ */
+class Snapshot {
+protected:
+    virtual ~Snapshot();
+};
+
 class DB {
 public:
     /*
@@ -80,6 +96,53 @@ public:
      */
     virtual Status Set(const Slice& key, const Slice& value) = 0;
 
+    /*
+     *  Set key to hold the string value for ttl seconds, after which Get
+     *  reports it NotFound; a ttl of 0 never expires. Engines without
+     *  expiry return IOError.
+     */
+    virtual Status Set(const Slice& key, const Slice& value, uint32_t ttl) {
+        return IOError;
+    }
+
+    /*
+     *  Remove key. Deleting a key that does not exist is not an error.
+     *  Engines without deletes return IOError.
+     */
+    virtual Status Delete(const Slice& key) {
+        return IOError;
+    }
+
+    /*
+     *  Get the values of n keys at once: statuses[i] and values[i] receive
+     *  what Get(keys[i], &values[i]) would. Engines may overlap the memory
+     *  accesses of the lookups.
+     */
+    virtual void MultiGet(size_t n, const Slice* keys, std::string* values, Status* statuses) {
+        for (size_t i = 0; i < n; ++i) {
+            statuses[i] = Get(keys[i], &values[i]);
+        }
+    }
+
+    /*
+     *  Take a snapshot: Gets at it see every Set that returned before the
+     *  call and none that started after it, while writes go on. It must be
+     *  released with ReleaseSnapshot. Engines without snapshots return
+     *  nullptr, at which Gets see the latest data.
+     */
+    virtual const Snapshot* GetSnapshot() {
+        return nullptr;
+    }
+
+    virtual void ReleaseSnapshot(const Snapshot* snapshot) {}
+
+    /*
+     *  Get the value key had at snapshot, or the latest if it is nullptr.
+     */
+    virtual Status Get(const Snapshot* snapshot, const Slice& key, std::string* value) {
+        return Get(key, value);
+    }
+
     /*
      * Close the db on exit.
      */
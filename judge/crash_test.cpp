@@ -0,0 +1,347 @@
+// Crash-recovery check and recovery-time benchmark.
+//
+// Every round forks a writer that opens a fresh db and runs a set phase
+// (each thread writes -n keys of its own) followed by a mixed phase
+// (overwrites and reads of those keys). The parent SIGKILLs the writer
+// after a random delay, reopens the db with DB::CreateOrOpen, times the
+// reopen and checks that every write the writer saw acknowledged is
+// readable. A write that was in flight when the writer died may or may
+// not have survived; anything else counts as a failure.
+//
+// Keys and values are a pure function of (thread, op), so the parent can
+// replay what each thread did from nothing but its count of acknowledged
+// ops, which the writer keeps in memory shared with the parent.
+//
+// Usage: ./crash_test [-t threads] [-n keys-per-thread] [-m mixed-ops-per-thread]
+//                     [-r rounds] [-k max-kill-delay-ms] [-S seed] [-p db-path]
+//                     [-f fixed-size-percent]
+
+#include <dirent.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "db.hpp"
+
+using namespace std;
+
+typedef unsigned long long ull;
+
+static const int MAX_THREADS = 64;
+
+int NUM_THREADS = 4;
+int PER_SET = 200000;
+int PER_MIXED = 200000;
+int ROUNDS = 10;
+int MAX_KILL_MS = 3000;
+ull SEED = 23333;
+string DB_PATH = "./crash_test_db";
+// Percent of writes whose value is exactly FIXED_VALUE_SIZE bytes, the size
+// the engine keeps in its slot store, so that slots overwrite slots.
+int FIXED_PERCENT = 0;
+static const size_t FIXED_VALUE_SIZE = 80;
+
+// Written by the writer, read by the parent after the writer is dead.
+struct alignas(64) Ack {
+    atomic<ull> ops;
+};
+Ack* acks = nullptr;
+
+DB* db = nullptr;
+
+static ull now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return 1000000ULL * tv.tv_sec + tv.tv_usec;
+}
+
+static inline ull mix(ull x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// What op `i` of thread `t` does: which of the thread's keys it touches
+// and whether it writes.
+struct Op {
+    int key;
+    bool write;
+};
+
+static Op op_of(int t, ull i) {
+    Op op;
+    if (i < (ull)PER_SET) {
+        op.key = (int)i;
+        op.write = true;
+    } else {
+        ull h = mix(SEED ^ ((ull)t << 40) ^ i);
+        op.key = (int)(h % PER_SET);
+        op.write = (h >> 32) % 2 == 0;
+    }
+    return op;
+}
+
+static void make_key(int t, int k, char* key) {
+    ull a = ((ull)t << 32) | (unsigned)k;
+    ull b = mix(SEED ^ a);
+    memcpy(key, &a, 8);
+    memcpy(key + 8, &b, 8);
+}
+
+// Sizes range from inline-sized values up to a few hundred bytes, with
+// FIXED_PERCENT of them exactly FIXED_VALUE_SIZE.
+static void make_value(int t, ull i, string* value) {
+    ull h = mix(SEED * 31 + ((ull)t << 40) + i);
+    value->resize((int)((h >> 40) % 100) < FIXED_PERCENT ? FIXED_VALUE_SIZE : 8 + h % 256);
+    for (size_t off = 0; off < value->size(); off += 8) {
+        h = mix(h);
+        memcpy(&(*value)[off], &h, min((size_t)8, value->size() - off));
+    }
+}
+
+void* writer(void* arg) {
+    int t = (int)(long)arg;
+    char key[16];
+    string value;
+    ull total = (ull)PER_SET + PER_MIXED;
+    for (ull i = 0; i < total; ++i) {
+        Op op = op_of(t, i);
+        make_key(t, op.key, key);
+        if (op.write) {
+            make_value(t, i, &value);
+            if (db->Set(Slice(key, 16), Slice(&value[0], value.size())) != Ok) {
+                fprintf(stderr, "thread %d: set %llu failed\n", t, i);
+                _exit(2);
+            }
+        } else {
+            db->Get(Slice(key, 16), &value);
+        }
+        acks[t].ops.store(i + 1, memory_order_release);
+    }
+    return 0;
+}
+
+static void run_writer() {
+    if (DB::CreateOrOpen(DB_PATH, &db, nullptr) != Ok) {
+        fprintf(stderr, "writer: open %s failed\n", DB_PATH.c_str());
+        _exit(2);
+    }
+    pthread_t tids[MAX_THREADS];
+    for (long t = 0; t < NUM_THREADS; ++t) {
+        pthread_create(&tids[t], NULL, writer, (void*)t);
+    }
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        pthread_join(tids[t], NULL);
+    }
+    _exit(0);
+}
+
+struct Result {
+    ull acked_writes;
+    ull bytes;
+    ull keys;
+    ull failures;
+};
+
+// Replays every thread's acknowledged ops and checks each key against the
+// last acknowledged write, allowing for the one op that was in flight.
+static Result verify() {
+    Result r = {0, 0, 0, 0};
+    string value, expected;
+    char key[16];
+    vector<long long> last(PER_SET);
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        ull acked = acks[t].ops.load(memory_order_acquire);
+        fill(last.begin(), last.end(), -1);
+        for (ull i = 0; i < acked; ++i) {
+            Op op = op_of(t, i);
+            if (op.write) {
+                last[op.key] = (long long)i;
+                make_value(t, i, &value);
+                r.acked_writes++;
+                r.bytes += 16 + value.size();
+            }
+        }
+        long long pending = -1;
+        int pending_key = -1;
+        if (acked < (ull)PER_SET + PER_MIXED && op_of(t, acked).write) {
+            pending = (long long)acked;
+            pending_key = op_of(t, acked).key;
+        }
+
+        for (int k = 0; k < PER_SET; ++k) {
+            if (last[k] < 0 && k != pending_key) {
+                continue;
+            }
+            r.keys++;
+            make_key(t, k, key);
+            Status s = db->Get(Slice(key, 16), &value);
+            bool ok = false;
+            if (last[k] >= 0 && s == Ok) {
+                make_value(t, last[k], &expected);
+                ok = value == expected;
+            }
+            if (!ok && k == pending_key) {
+                if (s == Ok) {
+                    make_value(t, pending, &expected);
+                    ok = value == expected;
+                } else {
+                    ok = last[k] < 0;
+                }
+            }
+            if (!ok) {
+                if (r.failures < 10) {
+                    printf("  thread %d key %d: %s\n", t, k,
+                           s == Ok ? "wrong value" : "missing");
+                }
+                r.failures++;
+            }
+        }
+    }
+    return r;
+}
+
+// Removes the pmem file and the directory its log is flushed to, so that
+// no round sees tables of an earlier one.
+static void remove_db() {
+    unlink(DB_PATH.c_str());
+    string tables = DB_PATH + ".tables";
+    DIR* dir = opendir(tables.c_str());
+    if (dir != NULL) {
+        for (struct dirent* e; (e = readdir(dir)) != NULL;) {
+            if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) {
+                unlink((tables + "/" + e->d_name).c_str());
+            }
+        }
+        closedir(dir);
+        rmdir(tables.c_str());
+    }
+}
+
+void config_parse(int argc, char* argv[]) {
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "ht:n:m:r:k:S:p:f:")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf("Usage: ./crash_test -t <threads> -n <keys-per-thread> "
+                       "-m <mixed-ops-per-thread> -r <rounds> -k <max-kill-delay-ms> "
+                       "-S <seed> -p <db-path> -f <fixed-size-percent>\n");
+                exit(0);
+            case 't':
+                NUM_THREADS = atoi(optarg);
+                if (NUM_THREADS < 1 || NUM_THREADS > MAX_THREADS) {
+                    printf("threads must be in [1, %d]\n", MAX_THREADS);
+                    exit(1);
+                }
+                break;
+            case 'n':
+                PER_SET = atoi(optarg);
+                break;
+            case 'm':
+                PER_MIXED = atoi(optarg);
+                break;
+            case 'r':
+                ROUNDS = atoi(optarg);
+                break;
+            case 'k':
+                MAX_KILL_MS = atoi(optarg);
+                break;
+            case 'S':
+                SEED = strtoull(optarg, NULL, 10);
+                break;
+            case 'p':
+                DB_PATH = optarg;
+                break;
+            case 'f':
+                FIXED_PERCENT = atoi(optarg);
+                break;
+        }
+    }
+    if (PER_SET < 1 || PER_MIXED < 0 || MAX_KILL_MS < 1 || FIXED_PERCENT < 0 ||
+        FIXED_PERCENT > 100) {
+        printf("bad parameters\n");
+        exit(1);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    config_parse(argc, argv);
+
+    acks = (Ack*)mmap(NULL, sizeof(Ack) * MAX_THREADS, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (acks == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    mt19937_64 mt(SEED);
+    ull failures = 0;
+    printf("%5s %8s %6s %12s %10s %10s %10s %8s\n",
+           "round", "kill_ms", "phase", "acked_sets", "data_MB", "reopen_ms", "keys", "failed");
+    for (int round = 0; round < ROUNDS; ++round) {
+        remove_db();
+        for (int t = 0; t < MAX_THREADS; ++t) {
+            acks[t].ops.store(0);
+        }
+        int kill_ms = 1 + (int)(mt() % MAX_KILL_MS);
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            run_writer();
+        }
+        usleep(kill_ms * 1000);
+        kill(pid, SIGKILL);
+        int status;
+        waitpid(pid, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+            printf("writer failed with status %d\n", WEXITSTATUS(status));
+            return 1;
+        }
+
+        const char* phase = "done";
+        if (WIFSIGNALED(status)) {
+            phase = "set";
+            for (int t = 0; t < NUM_THREADS; ++t) {
+                if (acks[t].ops.load() >= (ull)PER_SET) {
+                    phase = "mixed";
+                }
+            }
+        }
+
+        ull start = now_us();
+        if (DB::CreateOrOpen(DB_PATH, &db, nullptr) != Ok) {
+            printf("reopen %s failed\n", DB_PATH.c_str());
+            return 1;
+        }
+        double reopen_ms = (now_us() - start) / 1000.0;
+
+        Result r = verify();
+        delete db;
+        db = nullptr;
+        failures += r.failures;
+        printf("%5d %8d %6s %12llu %10.1lf %10.2lf %10llu %8llu\n", round, kill_ms, phase,
+               r.acked_writes, r.bytes / 1048576.0, reopen_ms, r.keys, r.failures);
+    }
+    remove_db();
+
+    printf("%s: %llu failed keys\n", failures == 0 ? "PASS" : "FAIL", failures);
+    return failures == 0 ? 0 : 1;
+}
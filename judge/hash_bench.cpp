@@ -0,0 +1,125 @@
+// Checks the 16-byte key path of the engine on keys drawn the same way the
+// judge draws them: speed of FixedKeyHash against the generic Hash64, how
+// evenly both spread keys over index buckets and lock stripes, 64-bit
+// collisions, and the cost of FixedKeyEqual against memcmp.
+//
+// Usage: ./hash_bench [-n keys] [-b log2-buckets]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "nvm_engine/FixedKey.hpp"
+#include "random.h"
+
+using namespace std;
+
+typedef unsigned long long ull;
+
+static const uint64_t SEED = 0x9ae16a3b2f90404fULL;
+
+int NUM_KEYS = 16000000;
+int BUCKET_BITS = 20;
+
+static ull now_ns() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return 1000000000ULL * tv.tv_sec + 1000ULL * tv.tv_usec;
+}
+
+// Chi-square of the bucket histogram divided by its degrees of freedom;
+// close to 1.0 for a uniform hash.
+static double chi_square(const vector<uint64_t>& hashes, int shift) {
+    size_t buckets = 1UL << BUCKET_BITS;
+    vector<uint32_t> count(buckets, 0);
+    for (uint64_t h : hashes) {
+        count[(h >> shift) & (buckets - 1)]++;
+    }
+    double expect = (double)hashes.size() / buckets;
+    double chi = 0;
+    for (uint32_t c : count) {
+        chi += (c - expect) * (c - expect) / expect;
+    }
+    return chi / (buckets - 1);
+}
+
+template <typename T>
+static size_t duplicates(vector<T> items) {
+    sort(items.begin(), items.end());
+    size_t n = 0;
+    for (size_t i = 1; i < items.size(); ++i) {
+        n += items[i] == items[i - 1];
+    }
+    return n;
+}
+
+// The generator repeats some keys, and those collide under any hash.
+size_t DUPLICATE_KEYS = 0;
+
+template <typename Fn>
+static void report(const char* name, const vector<char>& keys, Fn fn) {
+    vector<uint64_t> hashes(NUM_KEYS);
+    ull start = now_ns();
+    for (int i = 0; i < NUM_KEYS; ++i) {
+        hashes[i] = fn(&keys[16UL * i]);
+    }
+    ull ns = now_ns() - start;
+    printf("%-14s %6.2lf ns/key  chi2(low)=%.3lf  chi2(stripe)=%.3lf  collisions=%zu\n",
+           name, (double)ns / NUM_KEYS, chi_square(hashes, 0), chi_square(hashes, 40),
+           duplicates(hashes) - DUPLICATE_KEYS);
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, "hn:b:")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf("Usage: ./hash_bench -n <keys> -b <log2-buckets>\n");
+                return 0;
+            case 'n':
+                NUM_KEYS = atoi(optarg);
+                break;
+            case 'b':
+                BUCKET_BITS = atoi(optarg);
+                break;
+        }
+    }
+
+    Random rnd(vector<uint16_t>(16, 19));
+    vector<char> keys(16UL * NUM_KEYS);
+    for (int i = 0; i < NUM_KEYS; ++i) {
+        memcpy(&keys[16UL * i], rnd.nextUnsignedInt(), 16);
+    }
+    vector<pair<uint64_t, uint64_t>> key_words(NUM_KEYS);
+    for (int i = 0; i < NUM_KEYS; ++i) {
+        memcpy(&key_words[i].first, &keys[16UL * i], 8);
+        memcpy(&key_words[i].second, &keys[16UL * i + 8], 8);
+    }
+    DUPLICATE_KEYS = duplicates(key_words);
+    printf("%d keys, %zu duplicates\n", NUM_KEYS, DUPLICATE_KEYS);
+
+    report("Hash64", keys, [](const char* k) { return Hash64(k, 16, SEED); });
+    report("FixedKeyHash", keys, [](const char* k) { return FixedKeyHash(k, SEED); });
+
+    // Compare every key with its neighbour, the common "hash matched, check
+    // the key" case on a chain hop.
+    size_t equal = 0;
+    ull start = now_ns();
+    for (int i = 1; i < NUM_KEYS; ++i) {
+        equal += memcmp(&keys[16UL * i], &keys[16UL * (i - 1)], 16) == 0;
+    }
+    ull memcmp_ns = now_ns() - start;
+    start = now_ns();
+    for (int i = 1; i < NUM_KEYS; ++i) {
+        equal += FixedKeyEqual(&keys[16UL * i], &keys[16UL * (i - 1)]);
+    }
+    ull simd_ns = now_ns() - start;
+    printf("memcmp         %6.2lf ns/cmp\nFixedKeyEqual  %6.2lf ns/cmp  (%zu equal)\n",
+           (double)memcmp_ns / NUM_KEYS, (double)simd_ns / NUM_KEYS, equal);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Latency histogram in the spirit of HdrHistogram: values below 2^kSubBits
+// get a bucket each, larger ones are bucketed by their power of two and the
+// kSubBits bits below the leading one, so every bucket is within 1/128 of
+// the values it holds. Recording is a couple of instructions and no
+// allocation; each thread records into its own histogram and the results
+// are merged once the threads are done.
+class Histogram {
+public:
+    Histogram() {
+        Clear();
+    }
+
+    void Clear() {
+        memset(counts_, 0, sizeof(counts_));
+        count_ = 0;
+        sum_ = 0;
+        max_ = 0;
+    }
+
+    void Record(uint64_t value) {
+        counts_[BucketOf(value)]++;
+        count_++;
+        sum_ += value;
+        if (value > max_) {
+            max_ = value;
+        }
+    }
+
+    void Merge(const Histogram& other) {
+        for (int i = 0; i < kBuckets; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        if (other.max_ > max_) {
+            max_ = other.max_;
+        }
+    }
+
+    uint64_t Count() const {
+        return count_;
+    }
+
+    uint64_t Max() const {
+        return max_;
+    }
+
+    double Mean() const {
+        return count_ == 0 ? 0 : (double)sum_ / count_;
+    }
+
+    // Smallest recorded value v such that at least `p` percent of the
+    // values are <= v, reported as the upper bound of its bucket.
+    uint64_t Percentile(double p) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p / 100.0 * count_ + 0.5);
+        if (rank == 0) {
+            rank = 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                uint64_t upper = UpperBound(i);
+                return upper < max_ ? upper : max_;
+            }
+        }
+        return max_;
+    }
+
+private:
+    static const int kSubBits = 7;
+    static const int kSubBuckets = 1 << kSubBits;
+    static const int kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    static int BucketOf(uint64_t value) {
+        if (value < (uint64_t)kSubBuckets) {
+            return (int)value;
+        }
+        int shift = 63 - __builtin_clzll(value) - kSubBits;
+        return (shift + 1) * kSubBuckets + (int)((value >> shift) - kSubBuckets);
+    }
+
+    static uint64_t UpperBound(int bucket) {
+        if (bucket < kSubBuckets) {
+            return bucket;
+        }
+        int shift = bucket / kSubBuckets - 1;
+        uint64_t sub = bucket % kSubBuckets + kSubBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    uint64_t counts_[kBuckets];
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+};
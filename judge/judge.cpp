@@ -11,7 +11,10 @@
 #include <random>
 #include <atomic> 
 #include <immintrin.h>
+#include <sched.h>
+#include "histogram.h"
 #include "random.h"
+#include "workload.h"
 
 #include "db.hpp"
 
@@ -19,32 +22,81 @@ using namespace std;
 
 typedef unsigned long long ull;
 
-const int NUM_THREADS = 16;
+const int MAX_THREADS = 64;
+int NUM_THREADS = 16;
 int PER_SET = 48000000;
 int PER_GET = 48000000;
 const ull BASE = 199997;
-struct  timeval TIME_START, TIME_END;
-const int MAX_POOL_SIZE = 1e4;
-int POOL_TOP = 0;
+struct  timeval TIME_START, TIME_OPENED, TIME_END;
+// Every 4096th key a thread sets is sampled into the pool of hot keys the
+// mixed phase reads and overwrites: 2 ull per key, 16 threads x 48M / 4096
+// keys at most.
+const int MAX_POOL_SIZE = 1 << 19;
+atomic<int> POOL_TOP(0);
 ull key_pool[MAX_POOL_SIZE];
-int MODE = 1;
+// Keys inserted in the mixed phase (read-latest profiles) become visible to
+// readers in pool order, once POOL_READY has moved past them.
+atomic<int> POOL_READY(0);
+
+const Workload* MODE = &kWorkloads[0];
+double THETA = 0.99;
+double HOT_KEYS = 0.2;
+double HOT_OPS = 0.8;
+int VALUE_MIN = -1;
+int VALUE_MAX = -1;
+int SCAN_LENGTH = 16;
+ull SEED = 23333;
+Workload WORKLOAD;
+
+// Random bytes values are cut from, enough for the largest value at any
+// offset below MAX_VALUE_SIZE.
+const int MAX_VALUE_SIZE = 4096;
+char value_buf[2 * MAX_VALUE_SIZE];
+
+// Per-thread results, one cache line apart so that recording never bounces
+// a line between threads.
+struct alignas(64) ThreadStats {
+    Histogram set_lat;
+    Histogram get_lat;
+    Histogram scan_lat;
+    ull errors;
+};
+ThreadStats set_stats[MAX_THREADS];
+ThreadStats get_stats[MAX_THREADS];
+bool CSV = false;
+
+static inline ull now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return 1000000000ULL * ts.tv_sec + ts.tv_nsec;
+}
 
 DB* db = nullptr;
 
-vector<uint16_t> pool_seed[16];
+vector<uint16_t> pool_seed[MAX_THREADS];
 
-ull seed[] = {
+ull seed[MAX_THREADS] = {
     19, 31, 277, 131, 97, 2333, 19997, 22221, 
     217, 89, 73, 31, 17,
     255, 103, 207
 };
 
 
+// Seeds of each thread's Random: the thread's entry of seed[], its index
+// (seed[] repeats 31) and the -S seed, so every thread writes its own keys
+// and a run is reproducible.
 void init_pool_seed() {
-    for(int i = 0; i < 16; i++) {
+    for(int i = 16; i < MAX_THREADS; i++) {
+        seed[i] = seed[i - 16] * BASE + i;
+    }
+    for(int i = 0; i < MAX_THREADS; i++) {
         pool_seed[i].resize(16);
         pool_seed[i][0] = seed[i];
-        for(int j = 1; j < 16; j++) {
+        pool_seed[i][1] = i;
+        for(int j = 0; j < 4; j++) {
+            pool_seed[i][2 + j] = SEED >> (16 * j);
+        }
+        for(int j = 6; j < 16; j++) {
             pool_seed[i][j] = pool_seed[i][j-1] * pool_seed[i][j-1];
         }
     }
@@ -53,7 +105,10 @@ void init_pool_seed() {
 void* set_pure(void * id) {
 
     ull thread_id = (ull*)id - seed;
-    Random rnd;
+    Random rnd(pool_seed[thread_id]);
+    ThreadStats& stats = set_stats[thread_id];
+    OpChooser chooser(WORKLOAD, 2, THETA, HOT_KEYS, HOT_OPS, SEED + thread_id);
+    bool fixed_size = WORKLOAD.value_min == 80 && WORKLOAD.value_max == 80;
 
     int cnt = PER_SET;
 
@@ -63,59 +118,124 @@ void* set_pure(void * id) {
 
         Slice data_key((char*)start, 16);
         Slice data_value((char*)(start + 4), 80);
+        if(!fixed_size) {
+            data_value = Slice(value_buf + chooser.Uniform(MAX_VALUE_SIZE), chooser.ValueSize());
+        }
 
         if(((cnt & 0x7777) ^ 0x7777) == 0) {
-            memcpy(key_pool + POOL_TOP, start, 16);           
-            POOL_TOP += 2;
+            int top = POOL_TOP.fetch_add(2, memory_order_relaxed);
+            if(top + 2 <= MAX_POOL_SIZE) {
+                memcpy(key_pool + top, start, 16);
+            }
         }
-	    // db->Set(data_key, data_value);
+        ull begin = now_ns();
+        Status s = db->Set(data_key, data_value);
+        stats.set_lat.Record(now_ns() - begin);
+        stats.errors += s != Ok;
     }
     return 0;
 }
 
 void* get_pure(void *id) {
     int thread_id = (ull*)id - seed;
+    int pool_keys = POOL_TOP.load(memory_order_relaxed) / 2;
 
-    Random rnd;
+    // A stream of its own, so that mixed-phase inserts are new keys.
+    vector<uint16_t> mixed_seed = pool_seed[thread_id];
+    mixed_seed[1] += MAX_THREADS;
+    Random rnd(mixed_seed);
+    ThreadStats& stats = get_stats[thread_id];
+    OpChooser chooser(WORKLOAD, pool_keys, THETA, HOT_KEYS, HOT_OPS, SEED + thread_id);
 
-    mt19937 mt(23333);
-    double u = POOL_TOP / 2.0;
-    double o = POOL_TOP * 0.01;
-    int edge = POOL_TOP * 0.0196;
-    normal_distribution<double> n(u, o);
     string value = "";
+    vector<Slice> scan_keys(SCAN_LENGTH);
+    vector<string> scan_values(SCAN_LENGTH);
+    vector<Status> scan_statuses(SCAN_LENGTH);
 
     int cnt = PER_GET;
     while(cnt --) {
-        int id = ((int)n(mt) | 1) ^ 1;
-        id %= POOL_TOP - 2;
-        if( id - u > edge || u - id > edge) {
+        ull top = POOL_READY.load(memory_order_acquire) / 2;
+        Op op = chooser.Next(top);
+        Slice data_key((char*)(key_pool + 2 * op.key), 16);
+        if(op.type == Op::kWrite) {
             // 写
             unsigned int* start = rnd.nextUnsignedInt();
-            Slice data_key((char*)(key_pool + id), 16);
             Slice data_value((char*)start, 80);
-	        // db->Set(data_key, data_value);
+            if(WORKLOAD.value_min != 80 || WORKLOAD.value_max != 80) {
+                data_value = Slice(value_buf + chooser.Uniform(MAX_VALUE_SIZE), chooser.ValueSize());
+            }
+            int slot = -1;
+            if(WORKLOAD.dist == kLatest) {
+                slot = POOL_TOP.fetch_add(2, memory_order_relaxed);
+                if(slot + 2 <= MAX_POOL_SIZE) {
+                    memcpy(key_pool + slot, start + 4, 16);
+                    data_key = Slice((char*)(key_pool + slot), 16);
+                } else {
+                    slot = -1;
+                }
+            }
+            ull begin = now_ns();
+            Status s = db->Set(data_key, data_value);
+            stats.set_lat.Record(now_ns() - begin);
+            stats.errors += s != Ok;
+            if(slot >= 0) {
+                while(POOL_READY.load(memory_order_acquire) != slot) {
+                    sched_yield();
+                }
+                POOL_READY.store(slot + 2, memory_order_release);
+            }
+        } else if(op.type == Op::kScan) {
+            int n = 0;
+            for(ull k = op.key; k < top && n < SCAN_LENGTH; ++k, ++n) {
+                scan_keys[n] = Slice((char*)(key_pool + 2 * k), 16);
+            }
+            ull begin = now_ns();
+            db->MultiGet(n, scan_keys.data(), scan_values.data(), scan_statuses.data());
+            stats.scan_lat.Record(now_ns() - begin);
+            for(int i = 0; i < n; ++i) {
+                stats.errors += scan_statuses[i] != Ok;
+            }
         } else {
             // 读
-            Slice data_key((char*)(key_pool + id), 16);
-            // db->Get(data_key, &value);
+            ull begin = now_ns();
+            Status s = db->Get(data_key, &value);
+            stats.get_lat.Record(now_ns() - begin);
+            stats.errors += s != Ok;
         }
     }
     return 0;
 }
 
 
+void usage() {
+    printf("Usage: ./judge -s <set-size-per-Thread> -g <get-size-per-Thread>\n"
+           "               [-m <workload>] [-z <zipfian theta>] [-v <min>:<max> value size]\n"
+           "               [-H <hot key fraction>:<hot op fraction>] [-r <read ratio>]\n"
+           "               [-l <scan length>] [-S <seed>] [-t <threads>] [-o csv]\n"
+           "workloads:");
+    for(int i = 0; i < kNumWorkloads; i++) {
+        printf(" %s", kWorkloads[i].name);
+    }
+    printf("\n");
+}
+
 void config_parse(int argc, char *argv[]) {
 
     int opt = 0;
+    double read = -1;
 
-    while((opt = getopt(argc, argv, "hs:g:")) != -1) {
+    while((opt = getopt(argc, argv, "hs:g:m:z:v:H:r:l:S:t:o:")) != -1) {
         switch(opt) {
             case 'h':
-                printf("Usage: ./judge -s <set-size-per-Thread> -g <get-size-per-Thread>\n");
-                return ;
+                usage();
+                exit(0);
             case 'm':
-                MODE = atoi(optarg);
+                MODE = FindWorkload(optarg);
+                if(MODE == nullptr) {
+                    printf("unknown workload %s\n", optarg);
+                    usage();
+                    exit(1);
+                }
                 break;
             case 's':
                 PER_SET = atoi(optarg);
@@ -123,8 +243,54 @@ void config_parse(int argc, char *argv[]) {
             case 'g':
                 PER_GET = atoi(optarg);
                 break;
+            case 'z':
+                THETA = atof(optarg);
+                break;
+            case 'v':
+                if(sscanf(optarg, "%d:%d", &VALUE_MIN, &VALUE_MAX) != 2) {
+                    VALUE_MAX = VALUE_MIN;
+                }
+                break;
+            case 'H':
+                sscanf(optarg, "%lf:%lf", &HOT_KEYS, &HOT_OPS);
+                break;
+            case 'r':
+                read = atof(optarg);
+                break;
+            case 'l':
+                SCAN_LENGTH = atoi(optarg);
+                break;
+            case 'S':
+                SEED = strtoull(optarg, NULL, 10);
+                break;
+            case 't':
+                NUM_THREADS = atoi(optarg);
+                if(NUM_THREADS < 1 || NUM_THREADS > MAX_THREADS) {
+                    printf("threads must be in [1, %d]\n", MAX_THREADS);
+                    exit(1);
+                }
+                break;
+            case 'o':
+                CSV = strcmp(optarg, "csv") == 0;
+                break;
         }
     }
+
+    WORKLOAD = *MODE;
+    if(VALUE_MIN >= 0) {
+        WORKLOAD.value_min = VALUE_MIN;
+        WORKLOAD.value_max = VALUE_MAX;
+    }
+    if(read >= 0) {
+        WORKLOAD.read = read;
+        WORKLOAD.scan = WORKLOAD.scan < 1 - read ? WORKLOAD.scan : 1 - read;
+    }
+    if(THETA <= 0 || THETA == 1 || WORKLOAD.value_min < 1 || WORKLOAD.value_max > MAX_VALUE_SIZE ||
+       WORKLOAD.value_min > WORKLOAD.value_max || SCAN_LENGTH < 1) {
+        printf("bad workload parameters\n");
+        usage();
+        exit(1);
+    }
 }
 
 void test_set_pure(pthread_t * tids) {
@@ -146,6 +312,10 @@ void test_set_pure(pthread_t * tids) {
 void test_set_get(pthread_t * tids) {
     for(int i = 0; i < NUM_THREADS; ++i) {
         int ret = pthread_create(&tids[i], NULL, get_pure, seed+i);
+        if(ret != 0) {
+            printf("create thread failed.\n");
+            exit(1);
+        }
     }
 
     for(int i = 0; i < NUM_THREADS; i++){
@@ -155,30 +325,103 @@ void test_set_get(pthread_t * tids) {
 
 
 
+// Prints throughput and latency percentiles (in ns) of one kind of
+// operation, merged over all threads.
+void report(const char* phase, const char* op, ull usec, ThreadStats* stats,
+            Histogram ThreadStats::*which) {
+    Histogram merged;
+    for(int i = 0; i < NUM_THREADS; i++) {
+        merged.Merge(stats[i].*which);
+    }
+    if(merged.Count() == 0) {
+        return;
+    }
+    if(CSV) {
+        printf("%s,%s,%llu,%.0lf,%.0lf,%llu,%llu,%llu,%llu\n",
+               phase, op, (ull)merged.Count(), merged.Count() / (usec / 1e6), merged.Mean(),
+               (ull)merged.Percentile(50), (ull)merged.Percentile(99),
+               (ull)merged.Percentile(99.9), (ull)merged.Max());
+        return;
+    }
+    printf("%-5s %-4s %12llu ops %12.0lf ops/s  avg %8.0lf  p50 %8llu  p99 %8llu  p999 %8llu  max %10llu\n",
+           phase, op, (ull)merged.Count(), merged.Count() / (usec / 1e6), merged.Mean(),
+           (ull)merged.Percentile(50), (ull)merged.Percentile(99),
+           (ull)merged.Percentile(99.9), (ull)merged.Max());
+}
+
+ull errors(ThreadStats* stats) {
+    ull sum = 0;
+    for(int i = 0; i < NUM_THREADS; i++) {
+        sum += stats[i].errors;
+    }
+    return sum;
+}
+
 int main(int argc, char *argv[]) {
 
     config_parse(argc, argv);
 
     init_pool_seed();
 
+    mt19937_64 mt(SEED);
+    for(int i = 0; i < (int)sizeof(value_buf); i++) {
+        value_buf[i] = (char)mt();
+    }
+
     gettimeofday(&TIME_START,NULL);
 
     FILE * log_file =  fopen("./performance.log", "w");
 
-    DB::CreateOrOpen("./DB", &db, log_file);
+    if(DB::CreateOrOpen("./DB", &db, log_file) != Ok) {
+        printf("open db failed.\n");
+        exit(1);
+    }
+    gettimeofday(&TIME_OPENED,NULL);
+    ull sec_open = 1000000 * (TIME_OPENED.tv_sec-TIME_START.tv_sec)+ (TIME_OPENED.tv_usec-TIME_START.tv_usec);
 
-    pthread_t tids[NUM_THREADS];
+    pthread_t tids[MAX_THREADS];
 
     test_set_pure(tids);
     gettimeofday(&TIME_END,NULL);
 
     ull sec_set = 1000000 * (TIME_END.tv_sec-TIME_START.tv_sec)+ (TIME_END.tv_usec-TIME_START.tv_usec);
-    test_set_get(tids);
+
+    if(POOL_TOP > MAX_POOL_SIZE) {
+        POOL_TOP = MAX_POOL_SIZE;
+    }
+    POOL_READY = POOL_TOP.load();
+    if(POOL_TOP < 4) {
+        printf("too few keys set to sample a key pool; skipping the mixed phase.\n");
+    } else {
+        test_set_get(tids);
+    }
     gettimeofday(&TIME_END,NULL);
     ull sec_total = 1000000 * (TIME_END.tv_sec-TIME_START.tv_sec)+ (TIME_END.tv_usec-TIME_START.tv_usec);
     ull sec_set_get = sec_total - sec_set;
 
     printf("%.2lf\n%.2lf\n", sec_set/1000.0, sec_set_get/1000.0);
 
+    if(!CSV) {
+        printf("workload %s, %d threads\n", WORKLOAD.name, NUM_THREADS);
+    }
+    // Opening counts towards the set phase, as in the contest; shown on its
+    // own so that work moved into it, like prefaulting, is visible.
+    if(CSV) {
+        printf("open,all,1,,%.0lf,,,,\n", sec_open * 1000.0);
+    } else {
+        printf("open  %.2lf ms\n", sec_open / 1000.0);
+    }
+    report("set", "set", sec_set, set_stats, &ThreadStats::set_lat);
+    report("mixed", "set", sec_set_get, get_stats, &ThreadStats::set_lat);
+    report("mixed", "get", sec_set_get, get_stats, &ThreadStats::get_lat);
+    report("mixed", "scan", sec_set_get, get_stats, &ThreadStats::scan_lat);
+    if(CSV) {
+        printf("errors,all,%llu,,,,,,\n", errors(set_stats) + errors(get_stats));
+    } else {
+        printf("errors: set %llu, mixed %llu\n", errors(set_stats), errors(get_stats));
+    }
+
+    delete db;
+
     return 0;
 }
@@ -19,5 +19,5 @@ if [ $? -ne 0 ]; then
 fi
 
 # rm -f /mnt/pmem/DB
-./judge -s $set_per_thread -g $get_per_thread
+./judge -s $set_per_thread -g $get_per_thread "${@:4}"
 
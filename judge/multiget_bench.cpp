@@ -0,0 +1,180 @@
+// Compares serial Get with MultiGet on the same stream of keys.
+//
+// The set phase writes -n keys of 16 bytes with 80-byte values. The read
+// phase then draws -g keys per thread either the way the judge does
+// (a normal distribution centred on a small pool of hot keys) or uniformly
+// over everything written, and looks them up one Get at a time and in
+// MultiGet batches of -b keys.
+//
+// Usage: ./multiget_bench [-n keys] [-g gets-per-thread] [-t threads]
+//                         [-b batch] [-d hot|uniform] [-p db-path]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "db.hpp"
+#include "random.h"
+
+using namespace std;
+
+typedef unsigned long long ull;
+
+static const int MAX_THREADS = 64;
+
+int NUM_KEYS = 4000000;
+int PER_GET = 4000000;
+int NUM_THREADS = 1;
+int BATCH = 16;
+bool UNIFORM = false;
+string DB_PATH = "./multiget_bench_db";
+
+DB* db = nullptr;
+vector<char> keys;
+
+static ull now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return 1000000ULL * tv.tv_sec + tv.tv_usec;
+}
+
+// Indices of the keys each thread looks up, drawn once so that both modes
+// see the same stream.
+static vector<int> draw(int thread_id) {
+    mt19937 mt(23333 + thread_id);
+    vector<int> ids(PER_GET);
+    if (UNIFORM) {
+        uniform_int_distribution<int> u(0, NUM_KEYS - 1);
+        for (int& id : ids) {
+            id = u(mt);
+        }
+    } else {
+        double u = NUM_KEYS / 2.0;
+        normal_distribution<double> n(u, NUM_KEYS * 0.01);
+        for (int& id : ids) {
+            id = (int)n(mt);
+            id = id < 0 ? 0 : (id >= NUM_KEYS ? NUM_KEYS - 1 : id);
+        }
+    }
+    return ids;
+}
+
+struct Job {
+    int thread_id;
+    bool multi;
+    vector<int> ids;
+    size_t found;
+};
+
+void* get_phase(void* arg) {
+    Job* job = (Job*)arg;
+    job->found = 0;
+    if (!job->multi) {
+        string value;
+        for (int id : job->ids) {
+            job->found += db->Get(Slice(&keys[16UL * id], 16), &value) == Ok;
+        }
+        return 0;
+    }
+    vector<Slice> batch(BATCH);
+    vector<string> values(BATCH);
+    vector<Status> statuses(BATCH);
+    for (size_t i = 0; i < job->ids.size(); i += BATCH) {
+        size_t n = min((size_t)BATCH, job->ids.size() - i);
+        for (size_t j = 0; j < n; ++j) {
+            batch[j] = Slice(&keys[16UL * job->ids[i + j]], 16);
+        }
+        db->MultiGet(n, batch.data(), values.data(), statuses.data());
+        for (size_t j = 0; j < n; ++j) {
+            job->found += statuses[j] == Ok;
+        }
+    }
+    return 0;
+}
+
+static void run(const char* name, bool multi, vector<Job>& jobs) {
+    pthread_t tids[MAX_THREADS];
+    ull start = now_us();
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        jobs[i].multi = multi;
+        pthread_create(&tids[i], NULL, get_phase, &jobs[i]);
+    }
+    size_t found = 0;
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        pthread_join(tids[i], NULL);
+        found += jobs[i].found;
+    }
+    double ms = (now_us() - start) / 1000.0;
+    printf("%-8s %.2lf ms  %.0lf ops/s  found %zu/%zu\n", name, ms,
+           (double)PER_GET * NUM_THREADS / (ms / 1000.0), found, (size_t)PER_GET * NUM_THREADS);
+}
+
+void config_parse(int argc, char* argv[]) {
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "hn:g:t:b:d:p:")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf("Usage: ./multiget_bench -n <keys> -g <gets-per-thread> -t <threads> "
+                       "-b <batch> -d <hot|uniform> -p <db-path>\n");
+                exit(0);
+            case 'n':
+                NUM_KEYS = atoi(optarg);
+                break;
+            case 'g':
+                PER_GET = atoi(optarg);
+                break;
+            case 't':
+                NUM_THREADS = atoi(optarg);
+                if (NUM_THREADS < 1 || NUM_THREADS > MAX_THREADS) {
+                    printf("threads must be in [1, %d]\n", MAX_THREADS);
+                    exit(1);
+                }
+                break;
+            case 'b':
+                BATCH = atoi(optarg);
+                break;
+            case 'd':
+                UNIFORM = strcmp(optarg, "uniform") == 0;
+                break;
+            case 'p':
+                DB_PATH = optarg;
+                break;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    config_parse(argc, argv);
+
+    FILE* log_file = fopen("./performance.log", "w");
+    if (DB::CreateOrOpen(DB_PATH, &db, log_file) != Ok) {
+        printf("open %s failed\n", DB_PATH.c_str());
+        return 1;
+    }
+
+    Random rnd(vector<uint16_t>(16, 19));
+    keys.resize(16UL * NUM_KEYS);
+    for (int i = 0; i < NUM_KEYS; ++i) {
+        unsigned int* start = rnd.nextUnsignedInt();
+        memcpy(&keys[16UL * i], start, 16);
+        db->Set(Slice(&keys[16UL * i], 16), Slice((char*)(start + 4), 80));
+    }
+
+    vector<Job> jobs(NUM_THREADS);
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        jobs[i].thread_id = i;
+        jobs[i].ids = draw(i);
+    }
+    run("Get", false, jobs);
+    run("MultiGet", true, jobs);
+
+    delete db;
+    return 0;
+}
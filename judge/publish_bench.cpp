@@ -0,0 +1,150 @@
+// Compares the two ways PersistantPool can place values during the judge's
+// Set phase:
+//   alloc:   one pmemobj_alloc per value, i.e. one redo log commit per Set.
+//   publish: KVSEncodeValue reserves the value, the reservations are
+//            collected and made durable with one KVSPublish per batch.
+//
+// Usage: ./publish_bench -p <pool-path> [-n sets-per-thread] [-t threads]
+//                        [-b publish-batch] [-s pool-bytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+
+#include "nvm_engine/PersistantPool.hpp"
+#include "random.h"
+
+using namespace std;
+
+typedef unsigned long long ull;
+
+static const int MAX_THREADS = 64;
+static const int VALUE_SIZE = 80;
+
+int NUM_THREADS = 16;
+int PER_SET = 1000000;
+size_t PUBLISH_BATCH = 32;
+size_t POOL_SIZE = 16UL << 30;
+string POOL_PATH = "./publish_bench_pool";
+
+static ull now_us() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return 1000000ULL * tv.tv_sec + tv.tv_usec;
+}
+
+static int construct_value(PMEMobjpool* pop, void* ptr, void* arg) {
+    pmemobj_memcpy_persist(pop, ptr, arg, VALUE_SIZE);
+    return 0;
+}
+
+void* set_alloc(void* id) {
+    long thread_id = (long)id;
+    Random rnd(vector<uint16_t>(16, (uint16_t)(thread_id * 7919 + 1)));
+    for (int cnt = PER_SET; cnt--; ) {
+        unsigned int* start = rnd.nextUnsignedInt();
+        size_t pool_index = (next_pool_index_++) % pool_count_;
+        PMEMoid oid;
+        if (pmemobj_alloc(pools_[pool_index].pool, &oid, VALUE_SIZE, 0,
+                          construct_value, start + 4) != 0) {
+            printf("alloc failed after %d sets\n", PER_SET - cnt);
+            exit(1);
+        }
+    }
+    return 0;
+}
+
+void* set_publish(void* id) {
+    long thread_id = (long)id;
+    Random rnd(vector<uint16_t>(16, (uint16_t)(thread_id * 7919 + 1)));
+    vector<PobjAction> pacts(PUBLISH_BATCH);
+    size_t pending = 0;
+    for (int cnt = PER_SET; cnt--; ) {
+        unsigned int* start = rnd.nextUnsignedInt();
+        Slice value((char*)(start + 4), VALUE_SIZE);
+        KVSRef ref;
+        if (!KVSEncodeValue(value, false, &ref, &pacts[pending])) {
+            printf("reserve failed after %d sets\n", PER_SET - cnt);
+            exit(1);
+        }
+        if (++pending == PUBLISH_BATCH) {
+            KVSPublish(pacts.data(), pending);
+            pending = 0;
+        }
+    }
+    KVSPublish(pacts.data(), pending);
+    return 0;
+}
+
+static double run(void* (*fn)(void*)) {
+    pthread_t tids[MAX_THREADS];
+    ull start = now_us();
+    for (long i = 0; i < NUM_THREADS; ++i) {
+        if (pthread_create(&tids[i], NULL, fn, (void*)i) != 0) {
+            printf("create thread failed.\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < NUM_THREADS; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    return (now_us() - start) / 1000.0;
+}
+
+void config_parse(int argc, char* argv[]) {
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "hp:n:t:b:s:")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf("Usage: ./publish_bench -p <pool-path> -n <sets-per-thread> "
+                       "-t <threads> -b <publish-batch> -s <pool-bytes>\n");
+                exit(0);
+            case 'p':
+                POOL_PATH = optarg;
+                break;
+            case 'n':
+                PER_SET = atoi(optarg);
+                break;
+            case 't':
+                NUM_THREADS = atoi(optarg);
+                if (NUM_THREADS < 1 || NUM_THREADS > MAX_THREADS) {
+                    printf("threads must be in [1, %d]\n", MAX_THREADS);
+                    exit(1);
+                }
+                break;
+            case 'b':
+                PUBLISH_BATCH = strtoull(optarg, NULL, 10);
+                break;
+            case 's':
+                POOL_SIZE = strtoull(optarg, NULL, 10);
+                break;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    config_parse(argc, argv);
+    KVSSetPublishBatch(PUBLISH_BATCH);
+
+    const char* modes[] = { "alloc", "publish" };
+    void* (*fns[])(void*) = { set_alloc, set_publish };
+    for (int m = 0; m < 2; ++m) {
+        string path = POOL_PATH + "." + modes[m];
+        if (KVSOpen(path.c_str(), POOL_SIZE, NUM_THREADS) != 0) {
+            printf("open %s failed\n", path.c_str());
+            return 1;
+        }
+        double ms = run(fns[m]);
+        KVSCLose();
+        printf("%-8s batch=%-4zu threads=%-3d %.2lf ms %.0lf ops/s\n", modes[m],
+               m == 0 ? (size_t)1 : PUBLISH_BATCH, NUM_THREADS, ms,
+               (double)PER_SET * NUM_THREADS / (ms / 1000.0));
+    }
+    return 0;
+}
@@ -0,0 +1,21 @@
+#!/bin/bash
+
+INCLUDE_DIR="../include"
+POOL_PATH=$1
+set_per_thread=$2
+publish_batch=${3:-32}
+
+
+g++ -pthread -o publish_bench publish_bench.cpp random.cpp\
+	-I .. -I $INCLUDE_DIR \
+	-lpmemobj -lpmem \
+    -g -O2 \
+    -mavx2 \
+    -std=c++11
+
+if [ $? -ne 0 ]; then
+    echo "Compile Error"
+    exit 7
+fi
+
+./publish_bench -p $POOL_PATH -n $set_per_thread -b $publish_batch
@@ -1,8 +1,5 @@
-// Should be compiled with Intel compiler and optimization flags
-// -xCORE-AVX-I -O3 -ipo 
-// for example: icpc -xCORE-AVX-I -O3 -ipo -g -o main main.cpp random.cpp
-
-// BASED ON IVAN DIMKOVIC's CODE WITH LICENCE BELOW
+// See random.h. The buffering scheme is BASED ON IVAN DIMKOVIC's CODE WITH
+// LICENCE BELOW.
 
 /*****************************************************************************
 	
@@ -35,105 +32,73 @@
 *****************************************************************************/
 
 #include "random.h"
-#include <xmmintrin.h>
 #include <emmintrin.h>
-#include <smmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include <cassert>
-#include <iostream>
 using namespace std;
 
+static inline uint64_t splitmix64(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
 Random::Random(std::vector<uint16_t> seeds) {
 	if(seeds.size() == 0) {
 		// Use seed based on system rand()
 		seeds.resize(16);
-		uint32_t *ptr = (uint32_t *)&seeds[0];
-		for(unsigned int i=0; i<8; i++) ptr[i] = rand();
+		for(unsigned int i=0; i<16; i++) seeds[i] = (uint16_t)rand();
+	}
+
+	static_assert(RNDSTOREDNUMBERS % 8 == 0, "RNDSTOREDNUMBERS needs to be a multiple of 8.");
+
+	// Hash the seed and spread it over the lanes; splitmix64 is a bijection,
+	// so the lanes of one generator never start in the same state.
+	uint64_t h = 0;
+	for(size_t i=0; i<seeds.size(); i++) h = splitmix64(h ^ seeds[i]) + i;
+	for(int i=0; i<4; i++) {
+		s0[i] = splitmix64(h + 2*i);
+		s1[i] = splitmix64(h + 2*i + 1);
+		if((s0[i] | s1[i]) == 0) s1[i] = 1;
 	}
 
-	assert((RNDSTOREDNUMBERS%4==0) && "RNDSTOREDNUMBERS needs to be a multiple of 4.");
-	
-	initFastRand(seeds[0], seeds[1], 
-		seeds[2], seeds[3],
-		seeds[4], seeds[5],
-		seeds[6], seeds[7],
-		seeds[8], seeds[9],
-		seeds[10], seeds[11],
-		seeds[12], seeds[13],
-		seeds[14], seeds[15]);
-	
 	m_nextUnsignedInt = RNDSTOREDNUMBERS;
 	refillRandomUnsignedInts();
 }
 
 void Random::refillRandomUnsignedInts() {
-	const unsigned int randomNumbersToBeGenerated = m_nextUnsignedInt;
-	// We generate 4 each time with SSE4. If we have used 4N+k numbers, we will generate 4(N+1) instead
-	const unsigned int limit = randomNumbersToBeGenerated/4 + (randomNumbersToBeGenerated%4 != 0); 
-	
-	for(unsigned int i=0; i<limit; i++) {
-		generateSSE4();
-		m_randomUnsignedInts[4*i+0] = res[0];
-		m_randomUnsignedInts[4*i+1] = res[1];
-		m_randomUnsignedInts[4*i+2] = res[2];
-		m_randomUnsignedInts[4*i+3] = res[3];
+	for(unsigned int i=0; i<RNDSTOREDNUMBERS; i+=8) {
+		generate(m_randomUnsignedInts + i);
 	}
-
 	m_nextUnsignedInt = 0;
 }
 
-void Random::initFastRand( 
-	uint16_t a1, uint16_t c1,
-	uint16_t b1, uint16_t d1,
-	uint16_t a2, uint16_t c2,
-	uint16_t b2, uint16_t d2,
-	uint16_t a3, uint16_t c3,
-	uint16_t b3, uint16_t d3,
-	uint16_t a4, uint16_t c4,
-	uint16_t b4, uint16_t d4)
-{
-	//
-	// Initialize MWC1616 masks and multipliers
-	// Default values of 18000 and 30903 used
-	// for multipliers
-
-	for(uint8_t i=0;i<4;i++) {
-		mask[i]=0xFFFF;
-		m1[i]=0x4650;
-		m2[i]=0x78B7;
+// xorshift128+ (Vigna), lane-wise:
+//   x = s0; y = s1; s0 = y; x ^= x << 23; s1 = x ^ y ^ (x >> 17) ^ (y >> 26);
+//   out = s1 + y
+void Random::generate(unsigned int* out) {
+#ifdef __AVX2__
+	__m256i x = _mm256_loadu_si256((const __m256i *)s0);
+	__m256i y = _mm256_loadu_si256((const __m256i *)s1);
+	x = _mm256_xor_si256(x, _mm256_slli_epi64(x, 23));
+	__m256i s = _mm256_xor_si256(_mm256_xor_si256(x, y),
+		_mm256_xor_si256(_mm256_srli_epi64(x, 17), _mm256_srli_epi64(y, 26)));
+	_mm256_storeu_si256((__m256i *)s0, y);
+	_mm256_storeu_si256((__m256i *)s1, s);
+	_mm256_storeu_si256((__m256i *)out, _mm256_add_epi64(s, y));
+#else
+	for(int i=0; i<4; i+=2) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(s0 + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(s1 + i));
+		x = _mm_xor_si128(x, _mm_slli_epi64(x, 23));
+		__m128i s = _mm_xor_si128(_mm_xor_si128(x, y),
+			_mm_xor_si128(_mm_srli_epi64(x, 17), _mm_srli_epi64(y, 26)));
+		_mm_storeu_si128((__m128i *)(s0 + i), y);
+		_mm_storeu_si128((__m128i *)(s1 + i), s);
+		_mm_storeu_si128((__m128i *)(out + 2*i), _mm_add_epi64(s, y));
 	}
-
-	a[0]=((uint32_t )c1<<16) | a1;
-	a[1]=((uint32_t )c2<<16) | a2;
-	a[2]=((uint32_t )c3<<16) | a3;
-	a[3]=((uint32_t )c4<<16) | a4;
-	b[0]=((uint32_t )d1<<16) | b1;
-	b[1]=((uint32_t )d2<<16) | b2;
-	b[2]=((uint32_t )d3<<16) | b3;
-	b[3]=((uint32_t )d4<<16) | b4;
-}
-
-void Random::generateSSE4() {
-	__m128i a_ = _mm_load_si128((const __m128i *)a);
-	__m128i b_ = _mm_load_si128((const __m128i *)b);
-
-	const __m128i mask_ = _mm_load_si128((const __m128i *)mask);
-	const __m128i m1_ = _mm_load_si128((const __m128i *)m1);
-	const __m128i m2_ = _mm_load_si128((const __m128i *)m2);
-
-	__m128i amask = _mm_and_si128(a_, mask_);
-	__m128i ashift = _mm_srli_epi32(a_, 0x10);
-	__m128i amul = _mm_mullo_epi32(amask, m1_);
-	__m128i anew = _mm_add_epi32(amul, ashift);
-	_mm_store_si128((__m128i *)a, anew);
-
-	__m128i bmask = _mm_and_si128(b_, mask_);
-	__m128i bshift = _mm_srli_epi32(b_, 0x10);
-	__m128i bmul = _mm_mullo_epi32(bmask, m2_);
-	__m128i bnew = _mm_add_epi32(bmul, bshift);
-	_mm_store_si128((__m128i *)b, bnew);
-
-	__m128i bmasknew = _mm_and_si128(bnew, mask_);
-	__m128i ashiftnew = _mm_slli_epi32(anew, 0x10);
-	__m128i newRes = _mm_add_epi32(ashiftnew, bmasknew);
-	_mm_store_si128((__m128i *)res, newRes);
+#endif
 }
@@ -0,0 +1,87 @@
+#!/bin/bash
+#
+# Scaling sweep: builds every engine, links the judge against each and
+# runs it over thread counts, value sizes and read ratios, one dimension
+# at a time around a base point. Results go to <out-dir>/sweep.csv and
+# <out-dir>/sweep.json.
+#
+# Usage: ./sweep.sh <out-dir> [scale of set] [scale of get]
+#
+# The points can be overridden from the environment:
+#   ENGINES="nvm_engine nvm_example"  THREADS="1 2 4 8 16 32 64"
+#   VALUE_SIZES="16 80 256 1024 4096" READ_RATIOS="0 0.5 0.95 1"
+#   BASE_THREADS=16 BASE_VALUE=80 BASE_READ=0.95 WORKLOAD=uniform
+
+OUT_DIR=$1
+set_per_thread=${2:-100000}
+get_per_thread=${3:-100000}
+
+if [ -z "$OUT_DIR" ]; then
+    echo "Usage: ./sweep.sh <out-dir> [scale of set] [scale of get]"
+    exit 1
+fi
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+ENGINES=${ENGINES:-"nvm_engine nvm_example"}
+THREADS=${THREADS:-"1 2 4 8 16 32 64"}
+VALUE_SIZES=${VALUE_SIZES:-"16 80 256 1024 4096"}
+READ_RATIOS=${READ_RATIOS:-"0 0.5 0.95 1"}
+BASE_THREADS=${BASE_THREADS:-16}
+BASE_VALUE=${BASE_VALUE:-80}
+BASE_READ=${BASE_READ:-0.95}
+WORKLOAD=${WORKLOAD:-uniform}
+
+mkdir -p "$OUT_DIR"
+OUT_DIR=$(cd "$OUT_DIR" && pwd)
+CSV=$OUT_DIR/sweep.csv
+echo "engine,threads,value_size,read_ratio,phase,op,ops,ops_per_sec,avg_ns,p50_ns,p99_ns,p999_ns,max_ns" > "$CSV"
+
+for engine in $ENGINES; do
+    lib=$OUT_DIR/lib/$engine
+    make -C "$ROOT/$engine" LIBOUTPUT="$lib" EXEC_DIR="$ROOT" > /dev/null || exit 7
+    g++ -pthread -O2 -o "$OUT_DIR/judge_$engine" "$ROOT/judge/judge.cpp" "$ROOT/judge/random.cpp" \
+        -L "$lib" -l engine -I "$ROOT/include" -mavx2 -std=c++11 || exit 7
+done
+
+run() {
+    local engine=$1 threads=$2 value=$3 read=$4
+    local work=$OUT_DIR/work
+    rm -rf "$work" && mkdir -p "$work"
+    echo "$engine threads=$threads value=$value read=$read" >&2
+    (cd "$work" && "$OUT_DIR/judge_$engine" -s $set_per_thread -g $get_per_thread \
+        -m $WORKLOAD -t $threads -v $value -r $read -o csv) |
+        awk -F, -v prefix="$engine,$threads,$value,$read" 'NF > 1 { print prefix "," $0 }' >> "$CSV"
+    rm -rf "$work"
+}
+
+for engine in $ENGINES; do
+    for threads in $THREADS; do
+        run $engine $threads $BASE_VALUE $BASE_READ
+    done
+    for value in $VALUE_SIZES; do
+        [ "$value" = "$BASE_VALUE" ] || run $engine $BASE_THREADS $value $BASE_READ
+    done
+    for read in $READ_RATIOS; do
+        [ "$read" = "$BASE_READ" ] || run $engine $BASE_THREADS $BASE_VALUE $read
+    done
+done
+
+# Same rows as JSON, one object per CSV line.
+awk -F, '
+NR == 1 { for (i = 1; i <= NF; i++) name[i] = $i; print "["; next }
+{
+    line = "  {"
+    for (i = 1; i <= NF; i++) {
+        v = $i
+        if (v == "") v = "null"
+        else if (v !~ /^-?[0-9.]+$/) v = "\"" v "\""
+        line = line (i > 1 ? ", " : "") "\"" name[i] "\": " v
+    }
+    rows[NR] = line "}"
+}
+END {
+    for (r = 2; r <= NR; r++) print rows[r] (r < NR ? "," : "")
+    print "]"
+}' "$CSV" > "$OUT_DIR/sweep.json"
+
+echo "results in $CSV and $OUT_DIR/sweep.json"
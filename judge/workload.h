@@ -0,0 +1,193 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <random>
+
+// Workload profiles for the mixed phase of the judge, after the YCSB core
+// workloads. A profile fixes how keys are drawn from the pool of keys
+// written in the set phase, the mix of operations and the value sizes;
+// everything can be overridden from the command line.
+
+enum KeyDistribution {
+    kNormal,    // the contest's: normal around the middle of the pool
+    kUniform,
+    kZipfian,   // the first keys of the pool are the hottest
+    kHotspot,   // hot_ops of the operations go to hot_keys of the pool
+    kLatest,    // zipfian, counted back from the most recently written key
+};
+
+struct Workload {
+    const char* name;
+    KeyDistribution dist;
+    double read;        // fraction of operations that are Gets
+    double scan;        // fraction that are scans, the rest are Sets
+    int value_min;      // value sizes are uniform in [value_min, value_max]
+    int value_max;
+};
+
+// kNormal ignores `read` and `scan`: as in the contest, keys drawn more
+// than 1.96 sigma from the middle are written, all others read (95:5).
+// Under kLatest a Set inserts a new key, everywhere else it overwrites.
+// The engine has no ordered iteration, so a scan reads `scan_length`
+// consecutive pool keys (in the order they were written) with MultiGet.
+static const Workload kWorkloads[] = {
+    {"contest", kNormal,  0.95, 0,    80, 80},
+    {"round2",  kNormal,  0.95, 0,    80, 1024},
+    {"a",       kZipfian, 0.50, 0,    80, 80},
+    {"b",       kZipfian, 0.95, 0,    80, 80},
+    {"c",       kZipfian, 1.00, 0,    80, 80},
+    {"d",       kLatest,  0.95, 0,    80, 80},
+    {"e",       kZipfian, 0,    0.95, 80, 80},
+    {"uniform", kUniform, 0.95, 0,    80, 80},
+    {"hotspot", kHotspot, 0.95, 0,    80, 80},
+};
+
+static const int kNumWorkloads = sizeof(kWorkloads) / sizeof(kWorkloads[0]);
+
+// Looks a profile up by name or by its index in kWorkloads.
+static inline const Workload* FindWorkload(const char* name) {
+    for (int i = 0; i < kNumWorkloads; ++i) {
+        if (strcmp(kWorkloads[i].name, name) == 0) {
+            return &kWorkloads[i];
+        }
+    }
+    char* end;
+    long i = strtol(name, &end, 10);
+    if (*end == '\0' && end != name && i >= 0 && i < kNumWorkloads) {
+        return &kWorkloads[i];
+    }
+    return nullptr;
+}
+
+// Zipfian over [0, n) as generated by YCSB (Gray et al., "Quickly
+// generating billion-record synthetic databases"). Setting up costs O(n)
+// for zeta(n); each draw is constant time. theta must not be 1.
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint64_t n, double theta) : n_(n), theta_(theta) {
+        double zeta2 = Zeta(2, theta);
+        zetan_ = Zeta(n, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan_);
+    }
+
+    // `u` is uniform in [0, 1).
+    uint64_t Next(double u) const {
+        double uz = u * zetan_;
+        if (uz < 1.0) {
+            return 0;
+        }
+        if (uz < 1.0 + pow(0.5, theta_)) {
+            return 1;
+        }
+        uint64_t k = (uint64_t)(n_ * pow(eta_ * u - eta_ + 1, alpha_));
+        return k < n_ ? k : n_ - 1;
+    }
+
+private:
+    static double Zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) {
+            sum += 1.0 / pow((double)i, theta);
+        }
+        return sum;
+    }
+
+    uint64_t n_;
+    double theta_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+};
+
+struct Op {
+    enum Type { kRead, kWrite, kScan } type;
+    uint64_t key;   // index into the key pool
+};
+
+// Draws the operations of one thread. Seeded explicitly, so a run is
+// reproducible for a given seed and thread count.
+class OpChooser {
+public:
+    OpChooser(const Workload& w, uint64_t keys, double theta, double hot_keys, double hot_ops,
+              uint64_t seed)
+        : w_(w),
+          keys_(keys),
+          hot_keys_(hot_keys),
+          hot_ops_(hot_ops),
+          mt_(seed),
+          unit_(0.0, 1.0),
+          normal_(keys / 2.0, keys * 0.01),
+          zipf_(keys, theta) {}
+
+    // `top` is the number of keys readable now; it only grows past `keys`
+    // under kLatest.
+    Op Next(uint64_t top) {
+        Op op;
+        if (w_.dist == kNormal) {
+            double u = keys_ / 2.0;
+            double edge = (int)(keys_ * 0.0196);
+            double x = normal_(mt_);
+            op.key = x < 0 ? 0 : (uint64_t)x % keys_;
+            op.type = (op.key - u > edge || u - op.key > edge) ? Op::kWrite : Op::kRead;
+            return op;
+        }
+
+        double p = unit_(mt_);
+        op.type = p < w_.read ? Op::kRead : (p < w_.read + w_.scan ? Op::kScan : Op::kWrite);
+        switch (w_.dist) {
+            case kUniform:
+                op.key = (uint64_t)(unit_(mt_) * keys_);
+                break;
+            case kZipfian:
+                op.key = zipf_.Next(unit_(mt_));
+                break;
+            case kHotspot: {
+                uint64_t hot = (uint64_t)(keys_ * hot_keys_);
+                hot = hot == 0 ? 1 : hot;
+                if (unit_(mt_) < hot_ops_ || hot == keys_) {
+                    op.key = (uint64_t)(unit_(mt_) * hot);
+                } else {
+                    op.key = hot + (uint64_t)(unit_(mt_) * (keys_ - hot));
+                }
+                break;
+            }
+            case kLatest: {
+                uint64_t back = zipf_.Next(unit_(mt_));
+                op.key = back < top ? top - 1 - back : 0;
+                break;
+            }
+            default:
+                op.key = 0;
+                break;
+        }
+        if (op.key >= keys_ && w_.dist != kLatest) {
+            op.key = keys_ - 1;
+        }
+        return op;
+    }
+
+    int ValueSize() {
+        if (w_.value_min >= w_.value_max) {
+            return w_.value_min;
+        }
+        return w_.value_min + (int)(unit_(mt_) * (w_.value_max - w_.value_min + 1));
+    }
+
+    uint64_t Uniform(uint64_t n) {
+        return (uint64_t)(unit_(mt_) * n);
+    }
+
+private:
+    const Workload& w_;
+    uint64_t keys_;
+    double hot_keys_;
+    double hot_ops_;
+    std::mt19937_64 mt_;
+    std::uniform_real_distribution<double> unit_;
+    std::normal_distribution<double> normal_;
+    ZipfianGenerator zipf_;
+};
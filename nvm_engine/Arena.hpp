@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+#include "Allocator.hpp"
+#include "HugePages.hpp"
+
+// A fixed-size bump allocator that is safe to use from many threads. The
+// whole region is reserved up front and, unless prefaulted, only faulted in
+// as it is used; memory is never returned before the arena is destroyed.
+// Allocate returns nullptr once the region is exhausted. Every allocation is
+// aligned to `align` bytes, a power of two.
+class Arena : public Allocator {
+public:
+    explicit Arena(size_t capacity, size_t align = sizeof(void*),
+                   const PageOptions& pages = PageOptions())
+        : base_(nullptr), capacity_(capacity), mapped_(0), align_(align), used_(0) {
+        if (capacity_ > 0) {
+            base_ = static_cast<char*>(MapPages(capacity_, pages, &mapped_));
+            if (base_ == nullptr) {
+                capacity_ = 0;
+            }
+        }
+    }
+
+    ~Arena() {
+        UnmapPages(base_, mapped_);
+    }
+
+    // Faults in the whole region with `threads` threads. Only before the
+    // first allocation.
+    void Prefault(int threads) {
+        PrefaultPages(base_, capacity_, threads);
+    }
+
+    char* Allocate(size_t bytes) override {
+        return AllocateAligned(bytes);
+    }
+
+    char* AllocateAligned(size_t bytes, size_t huge_page_size = 0) override {
+        bytes = (bytes + align_ - 1) & ~(align_ - 1);
+        size_t off = used_.fetch_add(bytes, std::memory_order_relaxed);
+        if (off + bytes > capacity_) {
+            return nullptr;
+        }
+        return base_ + off;
+    }
+
+    size_t BlockSize() const override {
+        return capacity_;
+    }
+
+    // Allocations can be referred to by their offset from the arena start.
+    size_t Offset(const char* p) const {
+        return p - base_;
+    }
+
+    char* At(size_t offset) const {
+        return base_ + offset;
+    }
+
+    size_t MemoryUsage() const {
+        size_t used = used_.load(std::memory_order_relaxed);
+        return used < capacity_ ? used : capacity_;
+    }
+
+private:
+    char* base_;
+    size_t capacity_;
+    size_t mapped_;
+    const size_t align_;
+    std::atomic<size_t> used_;
+
+    Arena(const Arena&);
+    void operator=(const Arena&);
+};
@@ -0,0 +1,128 @@
+#include "include/async_queue.hpp"
+
+// Gets handed to one MultiGet at most; as many as the engine overlaps in
+// one go is plenty.
+static const size_t kMaxGetBatch = 32;
+
+AsyncQueue::AsyncQueue(DB* db, size_t capacity)
+    : db_(db), ring_(capacity > 0 ? capacity : 1), head_(0), run_(0), tail_(0),
+      keys_(kMaxGetBatch), values_(kMaxGetBatch), statuses_(kMaxGetBatch) {}
+
+bool AsyncQueue::SubmitGet(const Slice& key, uint64_t user_data, Callback callback) {
+    return Submit(kGet, key, Slice(), 0, user_data, &callback);
+}
+
+bool AsyncQueue::SubmitSet(const Slice& key, const Slice& value, uint32_t ttl,
+                           uint64_t user_data, Callback callback) {
+    return Submit(kSet, key, value, ttl, user_data, &callback);
+}
+
+bool AsyncQueue::SubmitDelete(const Slice& key, uint64_t user_data, Callback callback) {
+    return Submit(kDelete, key, Slice(), 0, user_data, &callback);
+}
+
+bool AsyncQueue::Submit(OpType type, const Slice& key, const Slice& value, uint32_t ttl,
+                        uint64_t user_data, Callback* callback) {
+    SkipCalledBack();
+    if (tail_ - head_ >= ring_.size()) {
+        return false;
+    }
+    // The entry's strings keep their buffers from earlier laps of the ring.
+    Entry* e = At(tail_++);
+    e->type = type;
+    e->status = Ok;
+    e->ttl = ttl;
+    e->user_data = user_data;
+    e->key.assign(key.data(), key.size());
+    e->value.assign(value.data(), value.size());
+    e->callback.swap(*callback);
+    e->has_callback = static_cast<bool>(e->callback);
+    e->called_back = false;
+    return true;
+}
+
+size_t AsyncQueue::Poll() {
+    size_t ran = 0;
+    // Callbacks may submit more; those run in this Poll too.
+    while (run_ != tail_) {
+        Entry* e = At(run_);
+        if (e->type == kGet) {
+            ran += RunGets();
+            continue;
+        }
+        Slice key(&e->key[0], e->key.size());
+        if (e->type == kSet) {
+            Slice value(&e->value[0], e->value.size());
+            e->status = e->ttl != 0 ? db_->Set(key, value, e->ttl) : db_->Set(key, value);
+        } else {
+            e->status = db_->Delete(key);
+        }
+        e->value.clear();
+        ++run_;
+        ++ran;
+        Complete(e);
+    }
+    SkipCalledBack();
+    return ran;
+}
+
+size_t AsyncQueue::RunGets() {
+    size_t n = 0;
+    while (run_ + n != tail_ && n < kMaxGetBatch && At(run_ + n)->type == kGet) {
+        std::string& key = At(run_ + n)->key;
+        keys_[n] = Slice(&key[0], key.size());
+        ++n;
+    }
+    db_->MultiGet(n, keys_.data(), values_.data(), statuses_.data());
+    // Every Get of the batch is done before the first callback runs, as a
+    // callback may submit into the slots behind them.
+    uint64_t first = run_;
+    for (size_t i = 0; i < n; ++i) {
+        Entry* e = At(first + i);
+        e->status = statuses_[i];
+        e->value.swap(values_[i]);
+    }
+    run_ += n;
+    for (size_t i = 0; i < n; ++i) {
+        Complete(At(first + i));
+    }
+    return n;
+}
+
+void AsyncQueue::Complete(Entry* e) {
+    if (e->has_callback) {
+        // The slot stays taken during the call, as the callback may submit.
+        Callback callback;
+        callback.swap(e->callback);
+        callback(e->status, &e->value);
+        e->called_back = true;
+    }
+}
+
+void AsyncQueue::SkipCalledBack() {
+    while (head_ != run_ && At(head_)->called_back) {
+        ++head_;
+    }
+}
+
+size_t AsyncQueue::Reap(Completion* out, size_t n) {
+    size_t reaped = 0;
+    while (reaped < n && head_ != run_) {
+        Entry* e = At(head_);
+        if (e->has_callback) {
+            if (!e->called_back) {
+                break;
+            }
+            ++head_;
+            continue;
+        }
+        ++head_;
+        Completion* c = &out[reaped++];
+        c->user_data = e->user_data;
+        c->type = e->type;
+        c->status = e->status;
+        c->value.swap(e->value);
+    }
+    SkipCalledBack();
+    return reaped;
+}
@@ -0,0 +1,277 @@
+#include "Block.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Coding.hpp"
+
+Block::Block(const BlockContents& contents)
+    : data_(contents.data.data()),
+      size_(contents.data.size()),
+      restart_offset_(0),
+      owned_(contents.heap_allocated) {
+    if (size_ < sizeof(uint32_t)) {
+        size_ = 0;  // Error marker
+    } else {
+        size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
+        if (NumRestarts() > max_restarts_allowed) {
+            size_ = 0;
+        } else {
+            restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+        }
+    }
+}
+
+Block::~Block() {
+    if (owned_) {
+        delete[] data_;
+    }
+}
+
+uint32_t Block::NumRestarts() const {
+    return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+}
+
+// Decodes the entry header at p. Returns a pointer to the key delta, or
+// nullptr if the entry does not fit before limit.
+static inline const char* DecodeEntry(const char* p, const char* limit, uint32_t* shared,
+                                      uint32_t* non_shared, uint32_t* value_length) {
+    if ((p = GetVarint32Ptr(p, limit, shared)) == nullptr ||
+        (p = GetVarint32Ptr(p, limit, non_shared)) == nullptr ||
+        (p = GetVarint32Ptr(p, limit, value_length)) == nullptr) {
+        return nullptr;
+    }
+    if ((size_t)(limit - p) < (size_t)*non_shared + *value_length) {
+        return nullptr;
+    }
+    return p;
+}
+
+class Block::Iter : public Iterator {
+public:
+    Iter(const Comparator* comparator, const char* data, uint32_t restarts, uint32_t num_restarts)
+        : comparator_(comparator),
+          data_(data),
+          restarts_(restarts),
+          num_restarts_(num_restarts),
+          current_(restarts),
+          restart_index_(num_restarts),
+          status_(Ok) {
+        assert(num_restarts_ > 0);
+    }
+
+    bool Valid() const override {
+        return current_ < restarts_;
+    }
+
+    Status status() const override {
+        return status_;
+    }
+
+    Slice key() override {
+        assert(Valid());
+        return Slice(const_cast<char*>(key_.data()), key_.size());
+    }
+
+    Slice value() override {
+        assert(Valid());
+        return value_;
+    }
+
+    void Next() override {
+        assert(Valid());
+        ParseNextKey();
+    }
+
+    void Prev() override {
+        assert(Valid());
+        // Scan backwards to a restart point before current_.
+        const uint32_t original = current_;
+        while (GetRestartPoint(restart_index_) >= original) {
+            if (restart_index_ == 0) {
+                current_ = restarts_;
+                restart_index_ = num_restarts_;
+                return;
+            }
+            restart_index_--;
+        }
+        SeekToRestartPoint(restart_index_);
+        do {
+        } while (ParseNextKey() && NextEntryOffset() < original);
+    }
+
+    void Seek(const Slice& target) override {
+        // Binary search for the last restart point with a key < target.
+        uint32_t left = 0;
+        uint32_t right = num_restarts_ - 1;
+        while (left < right) {
+            uint32_t mid = (left + right + 1) / 2;
+            uint32_t region_offset = GetRestartPoint(mid);
+            uint32_t shared, non_shared, value_length;
+            const char* key_ptr = DecodeEntry(data_ + region_offset, data_ + restarts_, &shared,
+                                              &non_shared, &value_length);
+            if (key_ptr == nullptr || shared != 0) {
+                CorruptionError();
+                return;
+            }
+            Slice mid_key(const_cast<char*>(key_ptr), non_shared);
+            if (comparator_->Compare(mid_key, target) < 0) {
+                left = mid;
+            } else {
+                right = mid - 1;
+            }
+        }
+
+        // Linear search within the restart interval for the first key >= target.
+        SeekToRestartPoint(left);
+        while (true) {
+            if (!ParseNextKey()) {
+                return;
+            }
+            if (comparator_->Compare(key(), target) >= 0) {
+                return;
+            }
+        }
+    }
+
+    void SeekToFirst() override {
+        SeekToRestartPoint(0);
+        ParseNextKey();
+    }
+
+    void SeekToLast() override {
+        SeekToRestartPoint(num_restarts_ - 1);
+        while (ParseNextKey() && NextEntryOffset() < restarts_) {
+        }
+    }
+
+private:
+    uint32_t NextEntryOffset() const {
+        return (value_.data() + value_.size()) - data_;
+    }
+
+    uint32_t GetRestartPoint(uint32_t index) const {
+        assert(index < num_restarts_);
+        return DecodeFixed32(data_ + restarts_ + index * sizeof(uint32_t));
+    }
+
+    void SeekToRestartPoint(uint32_t index) {
+        key_.clear();
+        restart_index_ = index;
+        // ParseNextKey starts at the end of value_, so point it there.
+        uint32_t offset = GetRestartPoint(index);
+        value_ = Slice(const_cast<char*>(data_) + offset, 0);
+    }
+
+    void CorruptionError() {
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        status_ = IOError;
+        key_.clear();
+        value_ = Slice();
+    }
+
+    bool ParseNextKey() {
+        current_ = NextEntryOffset();
+        const char* p = data_ + current_;
+        const char* limit = data_ + restarts_;
+        if (p >= limit) {
+            // No more entries; mark as invalid.
+            current_ = restarts_;
+            restart_index_ = num_restarts_;
+            return false;
+        }
+
+        uint32_t shared, non_shared, value_length;
+        p = DecodeEntry(p, limit, &shared, &non_shared, &value_length);
+        if (p == nullptr || key_.size() < shared) {
+            CorruptionError();
+            return false;
+        }
+        key_.resize(shared);
+        key_.append(p, non_shared);
+        value_ = Slice(const_cast<char*>(p) + non_shared, value_length);
+        while (restart_index_ + 1 < num_restarts_ && GetRestartPoint(restart_index_ + 1) < current_) {
+            ++restart_index_;
+        }
+        return true;
+    }
+
+    const Comparator* const comparator_;
+    const char* const data_;
+    const uint32_t restarts_;      // Offset of the restart array
+    const uint32_t num_restarts_;
+
+    // current_ is the offset of the current entry in data_; >= restarts_
+    // when the iterator is not valid.
+    uint32_t current_;
+    uint32_t restart_index_;  // Index of the restart block current_ falls in
+    std::string key_;
+    Slice value_;
+    Status status_;
+};
+
+Iterator* Block::NewIterator(const Comparator* comparator) {
+    if (size_ < sizeof(uint32_t)) {
+        return new EmptyIterator(IOError);
+    }
+    const uint32_t num_restarts = NumRestarts();
+    if (num_restarts == 0) {
+        return new EmptyIterator(Ok);
+    }
+    return new Iter(comparator, data_, restart_offset_, num_restarts);
+}
+
+BlockBuilder::BlockBuilder(int block_restart_interval)
+    : block_restart_interval_(block_restart_interval), counter_(0), finished_(false) {
+    assert(block_restart_interval_ >= 1);
+    restarts_.push_back(0);  // First restart point is at offset 0
+}
+
+void BlockBuilder::Reset() {
+    buffer_.clear();
+    restarts_.clear();
+    restarts_.push_back(0);
+    counter_ = 0;
+    finished_ = false;
+    last_key_.clear();
+}
+
+size_t BlockBuilder::CurrentSizeEstimate() const {
+    return buffer_.size() + restarts_.size() * sizeof(uint32_t) + sizeof(uint32_t);
+}
+
+Slice BlockBuilder::Finish() {
+    for (size_t i = 0; i < restarts_.size(); i++) {
+        PutFixed32(&buffer_, restarts_[i]);
+    }
+    PutFixed32(&buffer_, restarts_.size());
+    finished_ = true;
+    return Slice(const_cast<char*>(buffer_.data()), buffer_.size());
+}
+
+void BlockBuilder::Add(const Slice& key, const Slice& value) {
+    assert(!finished_);
+    assert(counter_ <= block_restart_interval_);
+    size_t shared = 0;
+    if (counter_ < block_restart_interval_) {
+        const size_t min_length = std::min(last_key_.size(), key.size());
+        while (shared < min_length && last_key_[shared] == key.data()[shared]) {
+            shared++;
+        }
+    } else {
+        restarts_.push_back(buffer_.size());
+        counter_ = 0;
+    }
+    const size_t non_shared = key.size() - shared;
+
+    PutVarint32(&buffer_, shared);
+    PutVarint32(&buffer_, non_shared);
+    PutVarint32(&buffer_, value.size());
+    buffer_.append(key.data() + shared, non_shared);
+    buffer_.append(value.data(), value.size());
+
+    last_key_.resize(shared);
+    last_key_.append(key.data() + shared, non_shared);
+    counter_++;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "include/db.hpp"
+#include "Comparator.hpp"
+#include "Iterator.hpp"
+
+// A block holds sorted entries with prefix-compressed keys:
+//
+//     shared_bytes: varint32
+//     unshared_bytes: varint32
+//     value_length: varint32
+//     key_delta: char[unshared_bytes]
+//     value: char[value_length]
+//
+// Every block_restart_interval entries a restart point stores its key in
+// full. The block ends with the offsets of the restart points (fixed32
+// each) and their count (fixed32), so a seek binary searches the restart
+// points and then scans at most one interval.
+
+struct BlockContents {
+    Slice data;
+    // Whether data was allocated with new[] and is owned by the block.
+    bool heap_allocated;
+};
+
+class Block {
+public:
+    explicit Block(const BlockContents& contents);
+    ~Block();
+
+    size_t size() const {
+        return size_;
+    }
+
+    Iterator* NewIterator(const Comparator* comparator);
+
+private:
+    class Iter;
+
+    uint32_t NumRestarts() const;
+
+    const char* data_;
+    size_t size_;
+    uint32_t restart_offset_;
+    bool owned_;
+
+    Block(const Block&);
+    void operator=(const Block&);
+};
+
+class BlockBuilder {
+public:
+    explicit BlockBuilder(int block_restart_interval);
+
+    void Reset();
+
+    // Keys must be added in increasing order.
+    void Add(const Slice& key, const Slice& value);
+
+    // Appends the restart array and returns the finished block, which
+    // stays valid until Reset.
+    Slice Finish();
+
+    size_t CurrentSizeEstimate() const;
+
+    bool empty() const {
+        return buffer_.empty();
+    }
+
+private:
+    const int block_restart_interval_;
+    std::string buffer_;
+    std::vector<uint32_t> restarts_;
+    int counter_;
+    bool finished_;
+    std::string last_key_;
+
+    BlockBuilder(const BlockBuilder&);
+    void operator=(const BlockBuilder&);
+};
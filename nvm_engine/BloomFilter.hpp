@@ -0,0 +1,140 @@
+#pragma once
+
+#include <xmmintrin.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "include/db.hpp"
+#include "Coding.hpp"
+#include "Hash.hpp"
+
+// Cache-local blocked Bloom filter over the keys of one table. All probes of
+// a key fall in one 64-byte line picked by the high half of the key's hash,
+// so a lookup costs one cache miss whatever the number of probes. The
+// filter pays for that locality with a slightly higher false positive rate
+// than a plain Bloom filter of the same size: about 1.2% instead of 0.8% at
+// 10 bits per key.
+//
+// Layout: the lines, then the probe count (1 byte) and the line count
+// (fixed32).
+
+static const uint64_t kBloomHashSeed = 0x626c6f6f6d666c74ULL;
+static const size_t kBloomLineBits = 512;
+static const size_t kBloomLineBytes = kBloomLineBits / 8;
+static const size_t kBloomTrailerSize = 5;
+
+inline uint64_t BloomHash(const Slice& key) {
+    return Hash64(key.data(), key.size(), kBloomHashSeed);
+}
+
+class BloomFilterBuilder {
+public:
+    explicit BloomFilterBuilder(int bits_per_key) : bits_per_key_(bits_per_key) {
+        // k = ln(2) * bits_per_key minimizes the rate of a plain filter.
+        num_probes_ = (int)(bits_per_key * 0.69);
+        if (num_probes_ < 1) {
+            num_probes_ = 1;
+        }
+        if (num_probes_ > 30) {
+            num_probes_ = 30;
+        }
+    }
+
+    void AddKey(const Slice& key) {
+        hashes_.push_back(BloomHash(key));
+    }
+
+    bool empty() const {
+        return hashes_.empty();
+    }
+
+    // Appends the filter of every key added so far to `dst`.
+    void Finish(std::string* dst) {
+        size_t bits = hashes_.size() * bits_per_key_;
+        uint32_t num_lines = (uint32_t)((bits + kBloomLineBits - 1) / kBloomLineBits);
+        if (num_lines == 0) {
+            num_lines = 1;
+        }
+        size_t start = dst->size();
+        dst->resize(start + (size_t)num_lines * kBloomLineBytes, 0);
+        char* data = &(*dst)[start];
+        for (uint64_t h : hashes_) {
+            char* line = data + Line(h, num_lines) * kBloomLineBytes;
+            uint32_t a = (uint32_t)h;
+            const uint32_t delta = (a >> 17) | (a << 15);
+            for (int i = 0; i < num_probes_; ++i) {
+                uint32_t bit = a % kBloomLineBits;
+                line[bit / 8] |= (char)(1 << (bit % 8));
+                a += delta;
+            }
+        }
+        dst->push_back((char)num_probes_);
+        PutFixed32(dst, num_lines);
+        hashes_.clear();
+    }
+
+    static size_t Line(uint64_t h, uint32_t num_lines) {
+        return (size_t)(((h >> 32) * num_lines) >> 32);
+    }
+
+private:
+    const int bits_per_key_;
+    int num_probes_;
+    std::vector<uint64_t> hashes_;
+};
+
+// Answers lookups against a filter built by BloomFilterBuilder. The filter
+// data must outlive the reader.
+class BloomFilterReader {
+public:
+    BloomFilterReader() : lines_(nullptr), num_lines_(0), num_probes_(0) {}
+
+    // Returns false if `filter` is malformed, in which case every key may
+    // match.
+    bool Init(const Slice& filter) {
+        if (filter.size() < kBloomTrailerSize) {
+            return false;
+        }
+        const char* trailer = filter.data() + filter.size() - kBloomTrailerSize;
+        uint32_t num_lines = DecodeFixed32(trailer + 1);
+        if ((size_t)num_lines * kBloomLineBytes + kBloomTrailerSize != filter.size() ||
+            num_lines == 0) {
+            return false;
+        }
+        lines_ = filter.data();
+        num_lines_ = num_lines;
+        num_probes_ = (unsigned char)trailer[0];
+        return true;
+    }
+
+    void Prefetch(uint64_t h) const {
+        if (lines_ != nullptr) {
+            _mm_prefetch(lines_ + BloomFilterBuilder::Line(h, num_lines_) * kBloomLineBytes,
+                         _MM_HINT_T0);
+        }
+    }
+
+    bool KeyMayMatch(uint64_t h) const {
+        if (lines_ == nullptr) {
+            return true;
+        }
+        const char* line = lines_ + BloomFilterBuilder::Line(h, num_lines_) * kBloomLineBytes;
+        uint32_t a = (uint32_t)h;
+        const uint32_t delta = (a >> 17) | (a << 15);
+        for (int i = 0; i < num_probes_; ++i) {
+            uint32_t bit = a % kBloomLineBits;
+            if ((line[bit / 8] & (1 << (bit % 8))) == 0) {
+                return false;
+            }
+            a += delta;
+        }
+        return true;
+    }
+
+private:
+    const char* lines_;
+    uint32_t num_lines_;
+    int num_probes_;
+};
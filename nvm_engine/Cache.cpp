@@ -0,0 +1,271 @@
+#include "Cache.hpp"
+
+#include <cstdlib>
+#include <mutex>
+
+#include "Hash.hpp"
+
+Cache::~Cache() {}
+
+namespace {
+
+static const uint64_t kCacheHashSeed = 0x63616368656b6579ULL;
+
+// One shard of the sharded cache.
+class LRUCache {
+public:
+    LRUCache();
+    ~LRUCache();
+
+    void SetCapacity(size_t capacity) {
+        capacity_ = capacity;
+    }
+
+    Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value, size_t charge,
+                          void (*deleter)(const Slice& key, void* value));
+    Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+    void Release(Cache::Handle* handle);
+    void Erase(const Slice& key, uint32_t hash);
+    void Prune();
+
+    size_t TotalCharge() const {
+        std::lock_guard<std::mutex> l(mutex_);
+        return usage_;
+    }
+
+private:
+    void LRU_Remove(LRUHandle* e);
+    void LRU_Append(LRUHandle* list, LRUHandle* e);
+    void Ref(LRUHandle* e);
+    void Unref(LRUHandle* e);
+    bool FinishErase(LRUHandle* e);
+
+    size_t capacity_;
+
+    mutable std::mutex mutex_;
+    size_t usage_;
+
+    // Dummy head of the LRU list of entries only the cache refers to.
+    // lru.prev is the newest entry, lru.next the oldest.
+    LRUHandle lru_;
+
+    // Dummy head of the list of entries clients refer to.
+    LRUHandle in_use_;
+
+    HandleTable table_;
+};
+
+LRUCache::LRUCache() : capacity_(0), usage_(0) {
+    lru_.next = &lru_;
+    lru_.prev = &lru_;
+    in_use_.next = &in_use_;
+    in_use_.prev = &in_use_;
+}
+
+LRUCache::~LRUCache() {
+    assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
+    for (LRUHandle* e = lru_.next; e != &lru_;) {
+        LRUHandle* next = e->next;
+        assert(e->in_cache);
+        e->in_cache = false;
+        assert(e->refs == 1);  // Invariant of lru_ list.
+        Unref(e);
+        e = next;
+    }
+}
+
+void LRUCache::Ref(LRUHandle* e) {
+    if (e->refs == 1 && e->in_cache) {  // If on lru_ list, move to in_use_ list.
+        LRU_Remove(e);
+        LRU_Append(&in_use_, e);
+    }
+    e->refs++;
+}
+
+void LRUCache::Unref(LRUHandle* e) {
+    assert(e->refs > 0);
+    e->refs--;
+    if (e->refs == 0) {  // Deallocate.
+        assert(!e->in_cache);
+        (*e->deleter)(e->key(), e->value);
+        free(e);
+    } else if (e->in_cache && e->refs == 1) {
+        // No longer in use; move to lru_ list.
+        LRU_Remove(e);
+        LRU_Append(&lru_, e);
+    }
+}
+
+void LRUCache::LRU_Remove(LRUHandle* e) {
+    e->next->prev = e->prev;
+    e->prev->next = e->next;
+}
+
+void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
+    // Make "e" newest entry by inserting just before *list
+    e->next = list;
+    e->prev = list->prev;
+    e->prev->next = e;
+    e->next->prev = e;
+}
+
+Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
+    std::lock_guard<std::mutex> l(mutex_);
+    LRUHandle* e = table_.Lookup(key, hash);
+    if (e != nullptr) {
+        Ref(e);
+    }
+    return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void LRUCache::Release(Cache::Handle* handle) {
+    std::lock_guard<std::mutex> l(mutex_);
+    Unref(reinterpret_cast<LRUHandle*>(handle));
+}
+
+Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value, size_t charge,
+                                void (*deleter)(const Slice& key, void* value)) {
+    std::lock_guard<std::mutex> l(mutex_);
+
+    // The key is stored right behind the handle.
+    LRUHandle* e = reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) + key.size()));
+    e->value = value;
+    e->deleter = deleter;
+    e->charge = charge;
+    e->key_length = key.size();
+    e->hash = hash;
+    e->in_cache = false;
+    e->refs = 1;  // for the returned handle.
+    e->key_data = reinterpret_cast<char*>(e + 1);
+    memcpy(e->key_data, key.data(), key.size());
+
+    if (capacity_ > 0) {
+        e->refs++;  // for the cache's reference.
+        e->in_cache = true;
+        LRU_Append(&in_use_, e);
+        usage_ += charge;
+        FinishErase(table_.Insert(e));
+    } else {
+        // capacity_ == 0 turns caching off; the entry lives as long as the
+        // returned handle.
+        e->next = nullptr;
+    }
+    while (usage_ > capacity_ && lru_.next != &lru_) {
+        LRUHandle* old = lru_.next;
+        assert(old->refs == 1);
+        bool erased = FinishErase(table_.Remove(old->key(), old->hash));
+        if (!erased) {  // to avoid unused variable when compiled NDEBUG
+            assert(erased);
+        }
+    }
+
+    return reinterpret_cast<Cache::Handle*>(e);
+}
+
+// If e != nullptr, finish removing *e from the cache; it has already been
+// removed from the hash table. Return whether e != nullptr.
+bool LRUCache::FinishErase(LRUHandle* e) {
+    if (e != nullptr) {
+        assert(e->in_cache);
+        LRU_Remove(e);
+        e->in_cache = false;
+        usage_ -= e->charge;
+        Unref(e);
+    }
+    return e != nullptr;
+}
+
+void LRUCache::Erase(const Slice& key, uint32_t hash) {
+    std::lock_guard<std::mutex> l(mutex_);
+    FinishErase(table_.Remove(key, hash));
+}
+
+void LRUCache::Prune() {
+    std::lock_guard<std::mutex> l(mutex_);
+    while (lru_.next != &lru_) {
+        LRUHandle* e = lru_.next;
+        assert(e->refs == 1);
+        bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+        if (!erased) {  // to avoid unused variable when compiled NDEBUG
+            assert(erased);
+        }
+    }
+}
+
+static const int kNumShardBits = 4;
+static const int kNumShards = 1 << kNumShardBits;
+
+class ShardedLRUCache : public Cache {
+public:
+    explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
+        const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+        for (int s = 0; s < kNumShards; s++) {
+            shard_[s].SetCapacity(per_shard);
+        }
+    }
+
+    ~ShardedLRUCache() override {}
+
+    Handle* Insert(const Slice& key, void* value, size_t charge,
+                   void (*deleter)(const Slice& key, void* value)) override {
+        const uint32_t hash = HashSlice(key);
+        return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    }
+
+    Handle* Lookup(const Slice& key) override {
+        const uint32_t hash = HashSlice(key);
+        return shard_[Shard(hash)].Lookup(key, hash);
+    }
+
+    void Release(Handle* handle) override {
+        LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
+        shard_[Shard(h->hash)].Release(handle);
+    }
+
+    void Erase(const Slice& key) override {
+        const uint32_t hash = HashSlice(key);
+        shard_[Shard(hash)].Erase(key, hash);
+    }
+
+    void* Value(Handle* handle) override {
+        return reinterpret_cast<LRUHandle*>(handle)->value;
+    }
+
+    uint64_t NewID() override {
+        std::lock_guard<std::mutex> l(id_mutex_);
+        return ++(last_id_);
+    }
+
+    void Prune() override {
+        for (int s = 0; s < kNumShards; s++) {
+            shard_[s].Prune();
+        }
+    }
+
+    size_t TotalCharge() const override {
+        size_t total = 0;
+        for (int s = 0; s < kNumShards; s++) {
+            total += shard_[s].TotalCharge();
+        }
+        return total;
+    }
+
+private:
+    static inline uint32_t HashSlice(const Slice& s) {
+        return (uint32_t)Hash64(s.data(), s.size(), kCacheHashSeed);
+    }
+
+    static uint32_t Shard(uint32_t hash) {
+        return hash >> (32 - kNumShardBits);
+    }
+
+    LRUCache shard_[kNumShards];
+    std::mutex id_mutex_;
+    uint64_t last_id_;
+};
+
+}  // namespace
+
+Cache* NewLRUCache(size_t capacity) {
+    return new ShardedLRUCache(capacity);
+}
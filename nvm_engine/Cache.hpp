@@ -4,6 +4,9 @@
 #include <cstdint>
 #include <include/db.hpp>
 
+// A reference-counted key to value map that evicts the least recently used
+// unreferenced entries once their total charge exceeds its capacity, as in
+// leveldb. Safe for concurrent use.
 class Cache {
 public:
     Cache() = default;
@@ -22,17 +25,17 @@ public:
     virtual size_t TotalCharge() const = 0;
 
 private:
-    void LRU_Remove(Handle* e);
-    void LRU_Append(Handle* e);
-    void Unref(Handle* e);
-
-    struct Rep;
-    Rep* rep_;
-
     Cache(const Cache&);
     void operator=(const Cache&);
 };
 
+// Creates a cache with a fixed capacity, split into shards that each have
+// their own lock and LRU list.
+Cache* NewLRUCache(size_t capacity);
+
+// An entry of the cache. Entries are on the in-use list while a client
+// holds a reference and in_cache, on the LRU list while only the cache
+// does, and on neither once erased or replaced but still referenced.
 struct LRUHandle {
     void* value;
     void (*deleter)(const Slice&, void* value);
@@ -93,7 +96,7 @@ private:
     LRUHandle** FindPointer(const Slice& key, uint32_t hash) {
         LRUHandle** ptr = &list_[hash & (length_ - 1)];
         while (*ptr != nullptr &&
-            ((*ptr)->hash != hash || !(const_cast<Slice&>(key) == (*ptr)->key()))) {
+            ((*ptr)->hash != hash || !(key == (*ptr)->key()))) {
 
             ptr = &(*ptr)->next_hash;
         }
@@ -127,4 +130,3 @@ private:
     }
 };
 
-//TODO: 实现LRU的函数部分
\ No newline at end of file
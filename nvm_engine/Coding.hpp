@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "include/db.hpp"
+
+// Little-endian fixed-width and varint encodings used by the table format,
+// as in leveldb.
+
+inline void EncodeFixed32(char* dst, uint32_t value) {
+    memcpy(dst, &value, sizeof(value));
+}
+
+inline void EncodeFixed64(char* dst, uint64_t value) {
+    memcpy(dst, &value, sizeof(value));
+}
+
+inline uint32_t DecodeFixed32(const char* ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+inline uint64_t DecodeFixed64(const char* ptr) {
+    uint64_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+inline void PutFixed32(std::string* dst, uint32_t value) {
+    char buf[sizeof(value)];
+    EncodeFixed32(buf, value);
+    dst->append(buf, sizeof(buf));
+}
+
+inline void PutFixed64(std::string* dst, uint64_t value) {
+    char buf[sizeof(value)];
+    EncodeFixed64(buf, value);
+    dst->append(buf, sizeof(buf));
+}
+
+inline char* EncodeVarint64(char* dst, uint64_t v) {
+    unsigned char* ptr = reinterpret_cast<unsigned char*>(dst);
+    while (v >= 128) {
+        *(ptr++) = (unsigned char)(v | 128);
+        v >>= 7;
+    }
+    *(ptr++) = (unsigned char)v;
+    return reinterpret_cast<char*>(ptr);
+}
+
+inline void PutVarint32(std::string* dst, uint32_t v) {
+    char buf[5];
+    dst->append(buf, EncodeVarint64(buf, v) - buf);
+}
+
+inline void PutVarint64(std::string* dst, uint64_t v) {
+    char buf[10];
+    dst->append(buf, EncodeVarint64(buf, v) - buf);
+}
+
+inline void PutLengthPrefixedSlice(std::string* dst, const Slice& value) {
+    PutVarint32(dst, (uint32_t)value.size());
+    dst->append(value.data(), value.size());
+}
+
+// Decodes a varint from [p, limit) and returns a pointer past it, or
+// nullptr if it is truncated or too long.
+inline const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* value) {
+    uint64_t result = 0;
+    for (uint32_t shift = 0; shift <= 63 && p < limit; shift += 7) {
+        uint64_t byte = *reinterpret_cast<const unsigned char*>(p);
+        p++;
+        if (byte & 128) {
+            result |= ((byte & 127) << shift);
+        } else {
+            result |= (byte << shift);
+            *value = result;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+inline const char* GetVarint32Ptr(const char* p, const char* limit, uint32_t* value) {
+    uint64_t v;
+    p = GetVarint64Ptr(p, limit, &v);
+    if (p == nullptr || v > UINT32_MAX) {
+        return nullptr;
+    }
+    *value = (uint32_t)v;
+    return p;
+}
+
+// The Get* functions consume the value from the front of `input`.
+inline bool GetVarint64(Slice* input, uint64_t* value) {
+    const char* p = input->data();
+    const char* limit = p + input->size();
+    const char* q = GetVarint64Ptr(p, limit, value);
+    if (q == nullptr) {
+        return false;
+    }
+    *input = Slice(const_cast<char*>(q), limit - q);
+    return true;
+}
+
+inline bool GetVarint32(Slice* input, uint32_t* value) {
+    const char* p = input->data();
+    const char* limit = p + input->size();
+    const char* q = GetVarint32Ptr(p, limit, value);
+    if (q == nullptr) {
+        return false;
+    }
+    *input = Slice(const_cast<char*>(q), limit - q);
+    return true;
+}
+
+inline bool GetLengthPrefixedSlice(Slice* input, Slice* result) {
+    uint32_t len;
+    if (!GetVarint32(input, &len) || input->size() < len) {
+        return false;
+    }
+    *result = Slice(input->data(), len);
+    *input = Slice(input->data() + len, input->size() - len);
+    return true;
+}
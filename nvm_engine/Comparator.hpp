@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "include/db.hpp"
+
+// Total order over the keys of a sorted table, as in leveldb.
+class Comparator {
+public:
+    virtual ~Comparator() = default;
+
+    // <0, 0 or >0 as `a` sorts before, equal to or after `b`.
+    virtual int Compare(const Slice& a, const Slice& b) const = 0;
+
+    // Shortens `*start` to a key in [*start, limit), which keeps index
+    // blocks small. May leave it unchanged.
+    virtual void FindShortestSeparator(std::string* start, const Slice& limit) const = 0;
+};
+
+class BytewiseComparatorImpl : public Comparator {
+public:
+    int Compare(const Slice& a, const Slice& b) const override {
+        size_t n = std::min(a.size(), b.size());
+        int r = memcmp(a.data(), b.data(), n);
+        if (r == 0) {
+            r = a.size() < b.size() ? -1 : (a.size() > b.size() ? 1 : 0);
+        }
+        return r;
+    }
+
+    void FindShortestSeparator(std::string* start, const Slice& limit) const override {
+        size_t n = std::min(start->size(), limit.size());
+        size_t diff = 0;
+        while (diff < n && (*start)[diff] == limit.data()[diff]) {
+            diff++;
+        }
+        if (diff >= n) {
+            return;
+        }
+        uint8_t byte = (uint8_t)(*start)[diff];
+        if (byte < 0xff && byte + 1 < (uint8_t)limit.data()[diff]) {
+            (*start)[diff]++;
+            start->resize(diff + 1);
+        }
+    }
+};
+
+inline const Comparator* BytewiseComparator() {
+    static BytewiseComparatorImpl comparator;
+    return &comparator;
+}
@@ -0,0 +1,258 @@
+#include "Env.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+RandomAccessFile::~RandomAccessFile() {}
+
+WritableFile::~WritableFile() {}
+
+Env::~Env() {}
+
+namespace {
+
+class PosixRandomAccessFile : public RandomAccessFile {
+public:
+    explicit PosixRandomAccessFile(int fd) : fd_(fd) {}
+
+    ~PosixRandomAccessFile() override {
+        close(fd_);
+    }
+
+    Status Read(uint64_t offset, size_t n, Slice* result, char* scratch) const override {
+        size_t done = 0;
+        while (done < n) {
+            ssize_t r = pread(fd_, scratch + done, n - done, offset + done);
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return IOError;
+            }
+            if (r == 0) {
+                break;
+            }
+            done += r;
+        }
+        *result = Slice(scratch, done);
+        return Ok;
+    }
+
+private:
+    const int fd_;
+};
+
+// Hands out pointers into a read-only mapping of the whole file, which
+// lives as long as the object.
+class PosixMmapReadableFile : public RandomAccessFile {
+public:
+    PosixMmapReadableFile(char* base, size_t length) : base_(base), length_(length) {}
+
+    ~PosixMmapReadableFile() override {
+        munmap(base_, length_);
+    }
+
+    Status Read(uint64_t offset, size_t n, Slice* result, char* scratch) const override {
+        if (offset > length_) {
+            *result = Slice();
+            return IOError;
+        }
+        if (n > length_ - offset) {
+            n = length_ - offset;
+        }
+        *result = Slice(base_ + offset, n);
+        return Ok;
+    }
+
+    bool ReadsWithoutCopy() const override {
+        return true;
+    }
+
+private:
+    char* const base_;
+    const size_t length_;
+};
+
+static int MadviseAdvice(AccessPattern access) {
+    switch (access) {
+    case kAccessRandom: return MADV_RANDOM;
+    case kAccessSequential: return MADV_SEQUENTIAL;
+    default: return MADV_NORMAL;
+    }
+}
+
+static int FadviseAdvice(AccessPattern access) {
+    switch (access) {
+    case kAccessRandom: return POSIX_FADV_RANDOM;
+    case kAccessSequential: return POSIX_FADV_SEQUENTIAL;
+    default: return POSIX_FADV_NORMAL;
+    }
+}
+
+// Buffers appends so that building a table issues a write per buffer, not
+// per entry.
+class PosixWritableFile : public WritableFile {
+public:
+    explicit PosixWritableFile(int fd) : fd_(fd), pos_(0) {}
+
+    ~PosixWritableFile() override {
+        if (fd_ >= 0) {
+            Close();
+        }
+    }
+
+    Status Append(const Slice& data) override {
+        const char* p = data.data();
+        size_t n = data.size();
+        size_t copy = n < kBufferSize - pos_ ? n : kBufferSize - pos_;
+        memcpy(buf_ + pos_, p, copy);
+        p += copy;
+        n -= copy;
+        pos_ += copy;
+        if (n == 0) {
+            return Ok;
+        }
+        Status s = Flush();
+        if (s != Ok) {
+            return s;
+        }
+        if (n < kBufferSize) {
+            memcpy(buf_, p, n);
+            pos_ = n;
+            return Ok;
+        }
+        return WriteUnbuffered(p, n);
+    }
+
+    Status Flush() override {
+        Status s = WriteUnbuffered(buf_, pos_);
+        pos_ = 0;
+        return s;
+    }
+
+    Status Sync() override {
+        Status s = Flush();
+        if (s == Ok && fdatasync(fd_) != 0) {
+            s = IOError;
+        }
+        return s;
+    }
+
+    Status Close() override {
+        Status s = Flush();
+        if (close(fd_) != 0 && s == Ok) {
+            s = IOError;
+        }
+        fd_ = -1;
+        return s;
+    }
+
+private:
+    static const size_t kBufferSize = 64 << 10;
+
+    Status WriteUnbuffered(const char* p, size_t n) {
+        while (n > 0) {
+            ssize_t r = write(fd_, p, n);
+            if (r < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return IOError;
+            }
+            p += r;
+            n -= r;
+        }
+        return Ok;
+    }
+
+    int fd_;
+    size_t pos_;
+    char buf_[kBufferSize];
+};
+
+class PosixEnv : public Env {
+public:
+    Status NewRandomAccessFile(const std::string& fname, const FileOptions& options,
+                               RandomAccessFile** result) override {
+        int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return errno == ENOENT ? NotFound : IOError;
+        }
+        if (options.use_mmap) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                size_t length = st.st_size;
+                void* base = mmap(nullptr, length, PROT_READ,
+                                  MAP_SHARED | (options.populate ? MAP_POPULATE : 0), fd, 0);
+                if (base != MAP_FAILED) {
+                    // Hints are advisory; a failure changes nothing.
+                    madvise(base, length, MadviseAdvice(options.access));
+                    close(fd);
+                    *result = new PosixMmapReadableFile(static_cast<char*>(base), length);
+                    return Ok;
+                }
+            }
+            // Fall back to pread, e.g. for an empty file.
+        }
+        posix_fadvise(fd, 0, 0, FadviseAdvice(options.access));
+        *result = new PosixRandomAccessFile(fd);
+        return Ok;
+    }
+
+    Status NewWritableFile(const std::string& fname, WritableFile** result) override {
+        int fd = open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return IOError;
+        }
+        *result = new PosixWritableFile(fd);
+        return Ok;
+    }
+
+    Status GetFileSize(const std::string& fname, uint64_t* size) override {
+        struct stat st;
+        if (stat(fname.c_str(), &st) != 0) {
+            return errno == ENOENT ? NotFound : IOError;
+        }
+        *size = st.st_size;
+        return Ok;
+    }
+
+    Status RemoveFile(const std::string& fname) override {
+        return unlink(fname.c_str()) == 0 ? Ok : IOError;
+    }
+
+    Status RenameFile(const std::string& src, const std::string& target) override {
+        return rename(src.c_str(), target.c_str()) == 0 ? Ok : IOError;
+    }
+
+    Status CreateDir(const std::string& dirname) override {
+        return mkdir(dirname.c_str(), 0755) == 0 || errno == EEXIST ? Ok : IOError;
+    }
+
+    Status GetChildren(const std::string& dirname, std::vector<std::string>* result) override {
+        result->clear();
+        DIR* d = opendir(dirname.c_str());
+        if (d == nullptr) {
+            return errno == ENOENT ? NotFound : IOError;
+        }
+        struct dirent* entry;
+        while ((entry = readdir(d)) != nullptr) {
+            result->push_back(entry->d_name);
+        }
+        closedir(d);
+        return Ok;
+    }
+};
+
+}  // namespace
+
+Env* Env::Default() {
+    static PosixEnv* env = new PosixEnv();
+    return env;
+}
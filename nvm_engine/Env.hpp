@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "include/db.hpp"
+
+// Files the sorted-table tier reads and writes, in the shape of leveldb's
+// Env. Tables live on a regular file system, either a DAX-mounted pmem one
+// or an SSD.
+
+// How a file opened for reading will be read; passed to the kernel as
+// madvise/posix_fadvise hints.
+enum AccessPattern {
+    kAccessNormal,
+    // Point lookups: no readahead.
+    kAccessRandom,
+    // Scans such as compaction: aggressive readahead.
+    kAccessSequential
+};
+
+struct FileOptions {
+    // Map the file and hand out pointers into the mapping instead of
+    // copying into the caller's scratch. On a DAX file system the reads go
+    // straight to pmem; on others they hit the page cache.
+    bool use_mmap = true;
+    // Fault the whole mapping in at open time (MAP_POPULATE), so that first
+    // reads do not take page faults. Only with use_mmap.
+    bool populate = false;
+    AccessPattern access = kAccessRandom;
+};
+
+// A file read at random offsets from many threads at once.
+class RandomAccessFile {
+public:
+    RandomAccessFile() = default;
+    virtual ~RandomAccessFile();
+
+    // Reads up to `n` bytes from `offset`. `*result` may point into
+    // `scratch`, which must hold `n` bytes, or elsewhere when the file can
+    // hand out its data without copying.
+    virtual Status Read(uint64_t offset, size_t n, Slice* result, char* scratch) const = 0;
+
+    // True if Read never uses its scratch, which may then be nullptr. The
+    // data it returns stays valid as long as the file.
+    virtual bool ReadsWithoutCopy() const {
+        return false;
+    }
+
+private:
+    RandomAccessFile(const RandomAccessFile&);
+    void operator=(const RandomAccessFile&);
+};
+
+// A file written front to back by one thread.
+class WritableFile {
+public:
+    WritableFile() = default;
+    virtual ~WritableFile();
+
+    virtual Status Append(const Slice& data) = 0;
+    virtual Status Flush() = 0;
+    // Makes everything appended so far durable.
+    virtual Status Sync() = 0;
+    virtual Status Close() = 0;
+
+private:
+    WritableFile(const WritableFile&);
+    void operator=(const WritableFile&);
+};
+
+class Env {
+public:
+    Env() = default;
+    virtual ~Env();
+
+    // The process-wide POSIX environment; never deleted.
+    static Env* Default();
+
+    virtual Status NewRandomAccessFile(const std::string& fname, const FileOptions& options,
+                                       RandomAccessFile** result) = 0;
+    // Creates the file, truncating an existing one.
+    virtual Status NewWritableFile(const std::string& fname, WritableFile** result) = 0;
+    virtual Status GetFileSize(const std::string& fname, uint64_t* size) = 0;
+    virtual Status RemoveFile(const std::string& fname) = 0;
+    virtual Status RenameFile(const std::string& src, const std::string& target) = 0;
+    virtual Status CreateDir(const std::string& dirname) = 0;
+    // Names, not paths, of the entries of a directory.
+    virtual Status GetChildren(const std::string& dirname, std::vector<std::string>* result) = 0;
+
+private:
+    Env(const Env&);
+    void operator=(const Env&);
+};
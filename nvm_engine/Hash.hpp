@@ -0,0 +1,61 @@
+#pragma once
+
+#include <nmmintrin.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// 64-bit MurmurHash64A. Used for index placement and for the checksum of
+// log records, so it must stay stable across releases.
+inline uint64_t Hash64(const char* data, size_t n, uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    uint64_t h = seed ^ (n * m);
+    const char* end = data + (n & ~static_cast<size_t>(7));
+
+    while (data != end) {
+        uint64_t k;
+        memcpy(&k, data, sizeof(k));
+        data += sizeof(k);
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (n & 7) {
+    case 7: h ^= uint64_t(static_cast<unsigned char>(data[6])) << 48;  // fall through
+    case 6: h ^= uint64_t(static_cast<unsigned char>(data[5])) << 40;  // fall through
+    case 5: h ^= uint64_t(static_cast<unsigned char>(data[4])) << 32;  // fall through
+    case 4: h ^= uint64_t(static_cast<unsigned char>(data[3])) << 24;  // fall through
+    case 3: h ^= uint64_t(static_cast<unsigned char>(data[2])) << 16;  // fall through
+    case 2: h ^= uint64_t(static_cast<unsigned char>(data[1])) << 8;  // fall through
+    case 1: h ^= uint64_t(static_cast<unsigned char>(data[0]));
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// CRC32C with the SSE4.2 instruction. Guards the blocks of sorted tables.
+inline uint32_t Crc32c(const char* data, size_t n, uint32_t crc = 0) {
+    uint64_t c = ~crc;
+    for (; n >= 8; data += 8, n -= 8) {
+        uint64_t w;
+        memcpy(&w, data, sizeof(w));
+        c = _mm_crc32_u64(c, w);
+    }
+    uint32_t c32 = (uint32_t)c;
+    for (; n > 0; ++data, --n) {
+        c32 = _mm_crc32_u8(c32, (uint8_t)*data);
+    }
+    return ~c32;
+}
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+#include "HugePages.hpp"
+#include "ValueRef.hpp"
+
+// Open-addressing hash table from a 64-bit key hash to a ValueHandle, laid
+// out like a Swiss table: every bucket is one cache line holding a 16-byte
+// control word with a one-byte tag per slot, followed by the slots' 32-bit
+// handles. A lookup compares its tag against the whole control word with
+// one SSE compare and only looks at the handles whose tag matched. The
+// table does not store keys, callers confirm a candidate slot by comparing
+// the key kept behind its handle.
+//
+// Buckets are probed linearly. Each bucket counts the keys that were
+// placed past it on their way from their home bucket, as in F14, so a
+// lookup stops at the first bucket that no key overflowed, and erasing a
+// key empties its slot and takes it off the counts on its way. No
+// tombstones are left behind: probe lengths depend only on the keys the
+// index holds now, however many a flush has erased.
+// The bucket count need not be a power of two; the home bucket is picked by
+// multiply-shift, so the index can be sized to whatever DRAM is left.
+//
+// A slot costs 5.33 bytes. The index only has to hold the keys in the slot
+// store and in the log: a flush moves log keys out into tables. The default
+// of 3GB holds 604M slots, which leaves room in the 4GB round 1 DRAM budget
+// for the stripes, the inline arena and a flush (see Options).
+//
+// Writers to one key are serialised by the stripe the key hashes to; a
+// stripe also carries a sequence counter so that readers can detect that a
+// DRAM-resident value was rewritten under them (seqlock), and a list of
+// writers waiting for the holder of its lock to write for them.
+class HashIndex {
+public:
+    static const int kSlotsPerBucket = 12;
+
+    typedef std::atomic<ValueHandle> Slot;
+
+    struct Waiter {
+        Waiter* next;
+    };
+
+    struct Stripe {
+        std::atomic<uint32_t> lock;
+        std::atomic<uint32_t> seq;
+        std::atomic<Waiter*> waiters;
+    };
+
+    explicit HashIndex(size_t slots, const PageOptions& pages = PageOptions()) {
+        size_t n = std::max<size_t>(1, (slots + kSlotsPerBucket - 1) / kSlotsPerBucket);
+        bucket_count_ = n;
+        buckets_ = static_cast<Bucket*>(MapZeroed(n * sizeof(Bucket), pages, &buckets_mapped_));
+        stripes_ = static_cast<Stripe*>(
+            MapZeroed(kStripes * sizeof(Stripe), pages, &stripes_mapped_));
+    }
+
+    ~HashIndex() {
+        UnmapPages(buckets_, buckets_mapped_);
+        UnmapPages(stripes_, stripes_mapped_);
+    }
+
+    // Faults in the whole index with `threads` threads, so that Sets do not
+    // take the first-touch faults. Only before the index is used.
+    void Prefault(int threads) {
+        PrefaultPages(buckets_, bucket_count_ * sizeof(Bucket), threads);
+        PrefaultPages(stripes_, kStripes * sizeof(Stripe), threads);
+    }
+
+    // Hash bits are split three ways: the low 32 bits pick the home bucket,
+    // bits 40..59 the stripe and the top byte is the tag.
+    Stripe* StripeFor(uint64_t hash) {
+        return &stripes_[(hash >> 40) & (kStripes - 1)];
+    }
+
+    // Whether `handle` refers to a value, as opposed to an empty slot or a
+    // slot that is claimed but not published yet.
+    static bool IsLive(ValueHandle handle) {
+        return handle != kEmpty && handle != kPending;
+    }
+
+    // Walks the probe sequence of `hash` and returns the first live slot
+    // whose tag matches and whose handle satisfies `match`, or nullptr once
+    // a bucket that no key overflowed has been searched. The number of
+    // buckets looked at goes to `*probed` if given.
+    template <typename Match>
+    Slot* Find(uint64_t hash, Match&& match, size_t* probed = nullptr) {
+        const __m128i needle = _mm_set1_epi8((char)Tag(hash));
+        size_t n = 0;
+        Slot* found = nullptr;
+        for (size_t b = Home(hash); n < bucket_count_; b = Next(b)) {
+            Bucket* bucket = &buckets_[b];
+            ++n;
+            for (uint32_t hits = TagHits(bucket, needle); hits != 0; hits &= hits - 1) {
+                Slot* slot = &bucket->slots[__builtin_ctz(hits)];
+                ValueHandle handle = slot->load(std::memory_order_acquire);
+                if (IsLive(handle) && match(handle)) {
+                    found = slot;
+                    break;
+                }
+            }
+            if (found != nullptr || bucket->overflow.load(std::memory_order_acquire) == 0) {
+                break;
+            }
+        }
+        if (probed != nullptr) {
+            *probed = n;
+        }
+        return found;
+    }
+
+    // Starts loading the home bucket of `hash` into the cache.
+    void Prefetch(uint64_t hash) const {
+        _mm_prefetch(reinterpret_cast<const char*>(&buckets_[Home(hash)]), _MM_HINT_T0);
+    }
+
+    // The first live handle in the home bucket of `hash` whose tag matches,
+    // or 0. Only a guess for what Find will return, used to prefetch.
+    ValueHandle Peek(uint64_t hash) const {
+        const Bucket* bucket = &buckets_[Home(hash)];
+        const __m128i needle = _mm_set1_epi8((char)Tag(hash));
+        for (uint32_t hits = TagHits(bucket, needle); hits != 0; hits &= hits - 1) {
+            ValueHandle handle = bucket->slots[__builtin_ctz(hits)].load(std::memory_order_relaxed);
+            if (IsLive(handle)) {
+                return handle;
+            }
+        }
+        return 0;
+    }
+
+    // Like Find, but when the key is absent claims a slot for it, the
+    // first empty one of its probe sequence. A claimed slot reads as not
+    // live until the caller stores a handle into it, or hands it back with
+    // Abandon. Must be called with the key's stripe locked. Returns nullptr
+    // only when the table is full.
+    template <typename Match>
+    Slot* FindOrInsert(uint64_t hash, Match&& match, bool* inserted) {
+        const uint8_t tag = Tag(hash);
+        const __m128i needle = _mm_set1_epi8((char)tag);
+        const size_t home = Home(hash);
+        size_t first_empty = bucket_count_;
+
+        for (size_t b = home, n = 0; n < bucket_count_; b = Next(b), ++n) {
+            Bucket* bucket = &buckets_[b];
+            for (uint32_t hits = TagHits(bucket, needle); hits != 0; hits &= hits - 1) {
+                Slot* slot = &bucket->slots[__builtin_ctz(hits)];
+                ValueHandle handle = slot->load(std::memory_order_acquire);
+                if (IsLive(handle) && match(handle)) {
+                    *inserted = false;
+                    return slot;
+                }
+            }
+            if (first_empty == bucket_count_ && SlotsEqual(bucket, kEmpty) != 0) {
+                first_empty = b;
+            }
+            if (bucket->overflow.load(std::memory_order_acquire) == 0) {
+                break;
+            }
+        }
+        if (first_empty == bucket_count_) {
+            first_empty = home;
+        }
+
+        // The buckets passed are counted before the slot is claimed, so
+        // that a lookup that finds the key also walks far enough.
+        for (size_t b = home; b != first_empty; b = Next(b)) {
+            buckets_[b].overflow.fetch_add(1, std::memory_order_relaxed);
+        }
+        for (size_t b = first_empty, n = Distance(home, first_empty); n < bucket_count_;
+             b = Next(b), ++n) {
+            Bucket* bucket = &buckets_[b];
+            for (uint32_t empty = SlotsEqual(bucket, kEmpty); empty != 0; empty &= empty - 1) {
+                int i = __builtin_ctz(empty);
+                if (Claim(bucket, i, tag)) {
+                    *inserted = true;
+                    return &bucket->slots[i];
+                }
+            }
+            bucket->overflow.fetch_add(1, std::memory_order_relaxed);
+        }
+        Uncount(home, bucket_count_);
+        return nullptr;
+    }
+
+    // Returns a slot claimed by FindOrInsert for `hash` whose value could
+    // not be stored. Caller holds the stripe lock.
+    void Abandon(uint64_t hash, Slot* slot) {
+        Erase(hash, slot);
+    }
+
+    // Removes the published value of the key with `hash`: empties its slot
+    // and takes the key off the overflow counts of the buckets before it.
+    // Caller holds the stripe lock.
+    void Erase(uint64_t hash, Slot* slot) {
+        size_t b = (reinterpret_cast<char*>(slot) - reinterpret_cast<char*>(buckets_)) /
+                   sizeof(Bucket);
+        slot->store(kEmpty, std::memory_order_release);
+        Uncount(Home(hash), Distance(Home(hash), b));
+    }
+
+    static void Lock(Stripe* stripe) {
+        while (stripe->lock.exchange(1, std::memory_order_acquire) != 0) {
+            while (stripe->lock.load(std::memory_order_relaxed) != 0) {
+                __builtin_ia32_pause();
+            }
+        }
+    }
+
+    static bool TryLock(Stripe* stripe) {
+        return stripe->lock.load(std::memory_order_relaxed) == 0 &&
+               stripe->lock.exchange(1, std::memory_order_acquire) == 0;
+    }
+
+    static void Unlock(Stripe* stripe) {
+        stripe->lock.store(0, std::memory_order_release);
+    }
+
+    // Queues `waiter` on the stripe until a holder of its lock takes it.
+    static void AddWaiter(Stripe* stripe, Waiter* waiter) {
+        Waiter* head = stripe->waiters.load(std::memory_order_relaxed);
+        do {
+            waiter->next = head;
+        } while (!stripe->waiters.compare_exchange_weak(head, waiter, std::memory_order_release,
+                                                        std::memory_order_relaxed));
+    }
+
+    // Dequeues every waiter, the newest first. Caller holds the stripe lock.
+    static Waiter* TakeWaiters(Stripe* stripe) {
+        if (stripe->waiters.load(std::memory_order_relaxed) == nullptr) {
+            return nullptr;
+        }
+        return stripe->waiters.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    // Brackets an in-place rewrite of data readers may be copying.
+    static void BeginWrite(Stripe* stripe) {
+        stripe->seq.store(stripe->seq.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void EndWrite(Stripe* stripe) {
+        stripe->seq.store(stripe->seq.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_release);
+    }
+
+    static uint32_t ReadBegin(Stripe* stripe) {
+        uint32_t seq;
+        while ((seq = stripe->seq.load(std::memory_order_acquire)) & 1) {
+            __builtin_ia32_pause();
+        }
+        return seq;
+    }
+
+    static bool ReadRetry(Stripe* stripe, uint32_t seq) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return stripe->seq.load(std::memory_order_relaxed) != seq;
+    }
+
+    size_t Capacity() const {
+        return bucket_count_ * kSlotsPerBucket;
+    }
+
+private:
+    static const size_t kStripes = 1 << 20;
+
+    static const ValueHandle kEmpty = 0;
+    static const ValueHandle kPending = 0xffffffff;
+
+    struct alignas(64) Bucket {
+        std::atomic<uint8_t> tags[kSlotsPerBucket];
+        // Keys in later buckets whose probe sequence passed this one.
+        std::atomic<uint32_t> overflow;
+        Slot slots[kSlotsPerBucket];
+    };
+    static_assert(sizeof(Bucket) == 64, "a bucket must fill one cache line");
+
+    static uint8_t Tag(uint64_t hash) {
+        return (uint8_t)(hash >> 56);
+    }
+
+    // Multiply-shift instead of a modulo.
+    size_t Home(uint64_t hash) const {
+        return (size_t)(((hash & 0xffffffffULL) * bucket_count_) >> 32);
+    }
+
+    size_t Next(size_t b) const {
+        return b + 1 < bucket_count_ ? b + 1 : 0;
+    }
+
+    // Buckets from `from` forward to `to`.
+    size_t Distance(size_t from, size_t to) const {
+        return to >= from ? to - from : to + bucket_count_ - from;
+    }
+
+    // Takes a key off the overflow counts of the `n` buckets from `home`.
+    void Uncount(size_t home, size_t n) {
+        for (size_t b = home; n > 0; b = Next(b), --n) {
+            buckets_[b].overflow.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Bitmap of the slots whose tag equals the broadcast `needle`.
+    static uint32_t TagHits(const Bucket* bucket, __m128i needle) {
+        __m128i tags = _mm_load_si128(reinterpret_cast<const __m128i*>(bucket));
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(tags, needle)) &
+               ((1U << kSlotsPerBucket) - 1);
+    }
+
+    // Bitmap of the slots currently holding `handle`.
+    static uint32_t SlotsEqual(const Bucket* bucket, ValueHandle handle) {
+        const __m128i needle = _mm_set1_epi32((int)handle);
+        const __m128i* slots = reinterpret_cast<const __m128i*>(bucket->slots);
+        uint32_t mask = 0;
+        for (int i = 0; i < kSlotsPerBucket / 4; ++i) {
+            __m128i eq = _mm_cmpeq_epi32(_mm_load_si128(slots + i), needle);
+            mask |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << (4 * i);
+        }
+        return mask;
+    }
+
+    static bool Claim(Bucket* bucket, int i, uint8_t tag) {
+        ValueHandle expected = kEmpty;
+        if (!bucket->slots[i].compare_exchange_strong(expected, kPending)) {
+            return false;
+        }
+        bucket->tags[i].store(tag, std::memory_order_release);
+        return true;
+    }
+
+    static void* MapZeroed(size_t bytes, const PageOptions& pages, size_t* mapped) {
+        void* p = MapPages(bytes, pages, mapped);
+        if (p == nullptr) {
+            abort();
+        }
+        return p;
+    }
+
+    size_t bucket_count_;
+    Bucket* buckets_;
+    Stripe* stripes_;
+    size_t buckets_mapped_;
+    size_t stripes_mapped_;
+
+    HashIndex(const HashIndex&);
+    void operator=(const HashIndex&);
+};
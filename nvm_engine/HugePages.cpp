@@ -0,0 +1,128 @@
+#include "HugePages.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+static const size_t kTransparentHugePageSize = 2UL << 20;
+// Prefault threads take work in chunks of this size.
+static const size_t kPrefaultChunk = 64UL << 20;
+
+static size_t RoundUp(size_t n, size_t unit) {
+    return (n + unit - 1) / unit * unit;
+}
+
+static int Log2(size_t n) {
+    int log = 0;
+    while ((size_t)1 << (log + 1) <= n) {
+        ++log;
+    }
+    return log;
+}
+
+void* MapPages(size_t bytes, const PageOptions& options, size_t* mapped) {
+    if (options.huge_pages) {
+        // Without MAP_NORESERVE, so that a short pool fails here and not
+        // with SIGBUS on first touch.
+        size_t length = RoundUp(bytes, options.huge_page_size);
+        void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                           (Log2(options.huge_page_size) << MAP_HUGE_SHIFT),
+                       -1, 0);
+        if (p != MAP_FAILED) {
+            *mapped = length;
+            return p;
+        }
+
+        // Transparent huge pages only cover whole aligned 2MB ranges.
+        length = RoundUp(bytes, kTransparentHugePageSize);
+        p = MapAligned(length, kTransparentHugePageSize);
+        if (p == nullptr) {
+            return nullptr;
+        }
+        madvise(p, length, MADV_HUGEPAGE);
+        *mapped = length;
+        return p;
+    }
+
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    *mapped = bytes;
+    return p;
+}
+
+void UnmapPages(void* p, size_t mapped) {
+    if (p != nullptr) {
+        munmap(p, mapped);
+    }
+}
+
+void* MapAligned(size_t bytes, size_t align) {
+    // Map `align` more and trim to an aligned start.
+    size_t reserve = bytes + align;
+    void* p = mmap(nullptr, reserve, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    char* base = static_cast<char*>(p);
+    char* aligned = reinterpret_cast<char*>(RoundUp(reinterpret_cast<uintptr_t>(base), align));
+    if (aligned > base) {
+        munmap(base, aligned - base);
+    }
+    if (base + reserve > aligned + bytes) {
+        munmap(aligned + bytes, base + reserve - (aligned + bytes));
+    }
+    return aligned;
+}
+
+static void PrefaultRange(char* begin, char* end) {
+    if (madvise(begin, end - begin, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+    // Kernels before 5.14: a write that stores back what it read faults
+    // the page in writable and leaves it as it was.
+    static const size_t kPageSize = (size_t)sysconf(_SC_PAGESIZE);
+    for (char* p = begin; p < end; p += kPageSize) {
+        volatile char* v = p;
+        *v = *v;
+    }
+}
+
+void PrefaultPages(void* p, size_t bytes, int threads) {
+    if (p == nullptr || bytes == 0) {
+        return;
+    }
+    char* begin = static_cast<char*>(p);
+    size_t chunks = (bytes + kPrefaultChunk - 1) / kPrefaultChunk;
+    std::atomic<size_t> next(0);
+    auto work = [&] {
+        for (size_t i; (i = next.fetch_add(1)) < chunks;) {
+            size_t offset = i * kPrefaultChunk;
+            size_t n = bytes - offset < kPrefaultChunk ? bytes - offset : kPrefaultChunk;
+            PrefaultRange(begin + offset, begin + offset + n);
+        }
+    };
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < threads && (size_t)i < chunks; ++i) {
+        helpers.push_back(std::thread(work));
+    }
+    work();
+    for (size_t i = 0; i < helpers.size(); ++i) {
+        helpers[i].join();
+    }
+}
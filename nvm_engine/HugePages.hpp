@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+// How the large DRAM structures, the index and the inline arena, are
+// backed. Their probes land on random pages, so with 4KB pages nearly every
+// one also misses the TLB.
+struct PageOptions {
+    // Explicit huge pages of huge_page_size (2MB or 1GB) from the hugetlb
+    // pool; when the pool cannot supply the whole region, normal pages
+    // advised to become transparent huge pages.
+    bool huge_pages = false;
+    size_t huge_page_size = 2UL << 20;
+};
+
+// Maps at least `bytes` of zeroed anonymous memory and sets `*mapped` to the
+// length to unmap. Without huge pages the memory is only reserved, and
+// faulted in as it is touched. Returns nullptr on failure.
+void* MapPages(size_t bytes, const PageOptions& options, size_t* mapped);
+
+void UnmapPages(void* p, size_t mapped);
+
+// Maps `bytes` of zeroed anonymous memory at an address aligned to `align`,
+// a power of two, so that the kernel can back it with pages that large.
+// Another mapping may be put over it with MAP_FIXED. Returns nullptr on
+// failure.
+void* MapAligned(size_t bytes, size_t align);
+
+// Faults in every page of [p, p + bytes) for writing, split among
+// `threads` threads, without changing the contents. Nothing else may write
+// to the region meanwhile.
+void PrefaultPages(void* p, size_t bytes, int threads);
@@ -2,11 +2,20 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <algorithm>
 #include <atomic>
+#include <type_traits>
 
 #include "Allocator.hpp"
 
+// Lock-free skip list whose nodes carry their key inline, after rocksdb's.
+// `Comparator` compares two encoded keys (`const char*`) and an encoded key
+// with a DecodedType, which decode_key produces once per search. Keys are
+// placed with AllocateKey and then linked in with Insert, or with
+// InsertConcurrently from several threads at once. Nodes are never removed;
+// their memory goes away with the allocator.
+
 template<class Comparator>
 class InlineSkipList {
 private:
@@ -20,6 +29,10 @@ public:
                           int32_t max_height = 12,
                           int32_t branching_factor = 4);
 
+    // Allocates room for a key of `key_size` bytes in a new node; the caller
+    // writes the key there and passes the same pointer to Insert.
+    char* AllocateKey(size_t key_size);
+
     Splice* AllocateSplice();
     bool Insert(const char* key);
     bool InsertConcurrently(const char* key);
@@ -46,13 +59,15 @@ public:
     private:
         const InlineSkipList* list_;
         Node* node_;
-    }
+    };
 
 private:
     const uint16_t kMaxHeight_;
     const uint16_t kBranching_;
     const uint32_t kScaledInverseBranching_;
 
+    static const uint32_t kRandomMask = 0x7fffffff;
+
     Comparator const compare_;
 	Allocator* const allocator_;
     Node* const head_;
@@ -65,7 +80,7 @@ private:
 
     int RandomHeight();
 
-    Node* AllocateNode(size_t key_size, int heifht);
+    Node* AllocateNode(size_t key_size, int height);
 
     bool Equal(const char* a, const char* b) const {
         return (compare_(a, b) == 0);
@@ -75,7 +90,16 @@ private:
         return (compare_(a, b) < 0);
     }
 
-    bool KeyAfterNode(const char* key Node* n) const;
+    // Whether `key` sorts after the key of `n`; a null `n` is the end of
+    // the list and sorts after every key.
+    bool KeyIsAfterNode(const char* key, Node* n) const {
+        return n != nullptr && compare_(n->Key(), key) < 0;
+    }
+
+    bool KeyIsAfterNode(const DecodedKey& key, Node* n) const {
+        return n != nullptr && compare_(n->Key(), key) < 0;
+    }
+
     Node* FindGreaterOrEqual(const char* key) const;
     Node* FindLessThan(const char* key, Node** prev = nullptr) const;
       Node* FindLessThan(const char* key, Node** prev, Node* root, int top_level, int bottom_level) const;
@@ -126,7 +150,7 @@ struct InlineSkipList<Comparator>::Node {
         return ((&next_[0] - n)->load(std::memory_order_acquire));
     }
 
-    void SetNext(int n, Node* n) {
+    void SetNext(int n, Node* x) {
         assert(n >= 0);
         (&next_[0] - n)->store(x, std::memory_order_release);
     }
@@ -194,7 +218,7 @@ inline void InlineSkipList<Comparator>::Iterator::Prev() {
 
 template<class Comparator>
 inline void InlineSkipList<Comparator>::Iterator::Seek(const char* target) {
-    node_ = list_->FindGreaterorEqual(target);
+    node_ = list_->FindGreaterOrEqual(target);
 }
 
 template <class Comparator>
@@ -204,7 +228,7 @@ inline void InlineSkipList<Comparator>::Iterator::SeekForPrev(
     if (!Valid()) {
       SeekToLast();
     }
-    while (Valid() && list_->LessThan(target, key())) {
+    while (Valid() && list_->LessThan(target, Key())) {
       Prev();
     }
 }
@@ -224,13 +248,19 @@ inline void InlineSkipList<Comparator>::Iterator::SeekToLast() {
 
 template <class Comparator>
 int InlineSkipList<Comparator>::RandomHeight() {
-    auto rnd = Random::GetTLSInstance();
+    // xorshift32 per thread; heights only need to be roughly geometric.
+    static thread_local uint32_t rnd = 2463534242U;
 
     // Increase height with probability 1 in kBranching
     int height = 1;
-    while (height < kMaxHeight_ && height < kMaxPossibleHeight &&
-          rnd->Next() < kScaledInverseBranching_) {
-      height++;
+    while (height < kMaxHeight_ && height < kMaxPossibleHeight) {
+        rnd ^= rnd << 13;
+        rnd ^= rnd >> 17;
+        rnd ^= rnd << 5;
+        if ((rnd & kRandomMask) >= kScaledInverseBranching_) {
+            break;
+        }
+        height++;
     }
     assert(height > 0);
     assert(height <= kMaxHeight_);
@@ -253,7 +283,7 @@ InlineSkipList<Comparator>::FindGreaterOrEqual(const char* key) const {
     while (true) {
         Node* next = x->Next(level);
           if (next != nullptr) {
-            PREFETCH(next->Next(level), 0, 1);
+            __builtin_prefetch(next->Next(level), 0, 1);
           }
           // Make sure the lists are sorted
           assert(x == head_ || next == nullptr || KeyIsAfterNode(next->Key(), x));
@@ -296,7 +326,7 @@ InlineSkipList<Comparator>::FindLessThan(const char* key, Node** prev,
     assert(x != nullptr);
     Node* next = x->Next(level);
     if (next != nullptr) {
-      PREFETCH(next->Next(level), 0, 1);
+      __builtin_prefetch(next->Next(level), 0, 1);
     }
     assert(x == head_ || next == nullptr || KeyIsAfterNode(next->Key(), x));
     assert(x == head_ || KeyIsAfterNode(key_decoded, x));
@@ -350,7 +380,7 @@ uint64_t InlineSkipList<Comparator>::EstimateCount(const char* key) const {
 		assert(x == head_ || compare_(x->Key(), key_decoded) < 0);
 		Node* next = x->Next(level);
 		if (next != nullptr) {
-		PREFETCH(next->Next(level), 0, 1);
+		__builtin_prefetch(next->Next(level), 0, 1);
 		}
 		if (next == nullptr || compare_(next->Key(), key_decoded) >= 0) {
 		if (level == 0) {
@@ -374,9 +404,9 @@ InlineSkipList<Comparator>::InlineSkipList(const Comparator cmp,
                                            int32_t branching_factor)
     : kMaxHeight_(static_cast<uint16_t>(max_height)),
       kBranching_(static_cast<uint16_t>(branching_factor)),
-      kScaledInverseBranching_((Random::kMaxNext + 1) / kBranching_),
-      allocator_(allocator),
+      kScaledInverseBranching_((kRandomMask + 1) / kBranching_),
       compare_(cmp),
+      allocator_(allocator),
       head_(AllocateNode(0, max_height)),
       max_height_(1),
       seq_splice_(AllocateSplice()) {
@@ -390,10 +420,10 @@ InlineSkipList<Comparator>::InlineSkipList(const Comparator cmp,
 	}
 }
 
-// template <class Comparator>
-// char* InlineSkipList<Comparator>::AllocateKey(size_t key_size) {
-//   return const_cast<char*>(AllocateNode(key_size, RandomHeight())->Key());
-// }
+template <class Comparator>
+char* InlineSkipList<Comparator>::AllocateKey(size_t key_size) {
+  return const_cast<char*>(AllocateNode(key_size, RandomHeight())->Key());
+}
 
 template<class Comparator>
 typename InlineSkipList<Comparator>::Node*
@@ -402,7 +432,7 @@ InlineSkipList<Comparator>::AllocateNode(size_t key_size, int height) {
 	char* raw = allocator_->AllocateAligned(prefix + sizeof(Node) + key_size);
 	Node* x = reinterpret_cast<Node*>(raw + prefix);
 	x->StashHeight(height);
-	reutrn x;
+	return x;
 }
 
 
@@ -443,11 +473,11 @@ void InlineSkipList<Comparator>::FindSpliceForLevel(const DecodedKey& key,
 	while (true) {
 		Node* next = before->Next(level);
 		if (next != nullptr) {
-		PREFETCH(next->Next(level), 0, 1);
+		__builtin_prefetch(next->Next(level), 0, 1);
 		}
 		if (prefetch_before == true) {
 		if (next != nullptr && level>0) {
-			PREFETCH(next->Next(level-1), 0, 1);
+			__builtin_prefetch(next->Next(level-1), 0, 1);
 		}
 		}
 		assert(before == head_ || next == nullptr ||
@@ -481,7 +511,7 @@ bool InlineSkipList<Comparator>::Insert(const char* key, Splice* splice,
                                         bool allow_partial_splice_fix) {
 	Node* x = reinterpret_cast<Node*>(const_cast<char*>(key)) - 1;
 	const DecodedKey key_decoded = compare_.decode_key(key);
-	int height = x->UnstashHeight();
+	int height = x->UnStashHeight();
 	assert(height >= 1 && height <= kMaxHeight_);
 
 	int max_height = max_height_.load(std::memory_order_relaxed);
@@ -546,12 +576,12 @@ bool InlineSkipList<Comparator>::Insert(const char* key, Splice* splice,
 		for (int i = 0; i < height; ++i) {
 		while (true) {
 			// Checking for duplicate keys on the level 0 is sufficient
-			if (UNLIKELY(i == 0 && splice->next_[i] != nullptr &&
+			if ((i == 0 && splice->next_[i] != nullptr &&
 						compare_(x->Key(), splice->next_[i]->Key()) >= 0)) {
 			// duplicate key
 			return false;
 			}
-			if (UNLIKELY(i == 0 && splice->prev_[i] != head_ &&
+			if ((i == 0 && splice->prev_[i] != head_ &&
 						compare_(splice->prev_[i]->Key(), x->Key()) >= 0)) {
 			// duplicate key
 			return false;
@@ -580,12 +610,12 @@ bool InlineSkipList<Comparator>::Insert(const char* key, Splice* splice,
 									&splice->prev_[i], &splice->next_[i]);
 		}
 		// Checking for duplicate keys on the level 0 is sufficient
-		if (UNLIKELY(i == 0 && splice->next_[i] != nullptr &&
+		if ((i == 0 && splice->next_[i] != nullptr &&
 					compare_(x->Key(), splice->next_[i]->Key()) >= 0)) {
 			// duplicate key
 			return false;
 		}
-		if (UNLIKELY(i == 0 && splice->prev_[i] != head_ &&
+		if ((i == 0 && splice->prev_[i] != head_ &&
 					compare_(splice->prev_[i]->Key(), x->Key()) >= 0)) {
 			// duplicate key
 			return false;
@@ -43,6 +43,9 @@ public:
             c->next = cleanup_.next;
             cleanup_.next = c;
         }
+        c->function = func;
+        c->arg1 = arg1;
+        c->arg2 = arg2;
     }
 
 private:
@@ -68,8 +71,8 @@ public:
     virtual void SeekToLast() { }
     virtual void Next() { assert(false); }
     virtual void Prev() { assert(false); }
-    Slice key() const { assert(false); return {}; }
-    Slice value() const { assert(false); return {}; }
+    virtual Slice key() { assert(false); return {}; }
+    virtual Slice value() { assert(false); return {}; }
     virtual Status status() const { return status_; }
 private:
     Status status_;
@@ -0,0 +1,155 @@
+#include "MergingIterator.hpp"
+
+#include <vector>
+
+namespace {
+
+// After leveldb's MergingIterator. The children are few (the inputs of one
+// compaction), so the smallest one is found by a linear scan.
+class MergingIterator : public Iterator {
+public:
+    MergingIterator(const Comparator* comparator, Iterator** children, int n)
+        : comparator_(comparator),
+          children_(children, children + n),
+          current_(nullptr),
+          direction_(kForward) {}
+
+    ~MergingIterator() override {
+        for (size_t i = 0; i < children_.size(); ++i) {
+            delete children_[i];
+        }
+    }
+
+    bool Valid() const override {
+        return current_ != nullptr;
+    }
+
+    void SeekToFirst() override {
+        for (size_t i = 0; i < children_.size(); ++i) {
+            children_[i]->SeekToFirst();
+        }
+        FindSmallest();
+        direction_ = kForward;
+    }
+
+    void SeekToLast() override {
+        for (size_t i = 0; i < children_.size(); ++i) {
+            children_[i]->SeekToLast();
+        }
+        FindLargest();
+        direction_ = kReverse;
+    }
+
+    void Seek(const Slice& target) override {
+        for (size_t i = 0; i < children_.size(); ++i) {
+            children_[i]->Seek(target);
+        }
+        FindSmallest();
+        direction_ = kForward;
+    }
+
+    void Next() override {
+        assert(Valid());
+        // After moving backward, the other children sit before key(); move
+        // them to the first entry after it.
+        if (direction_ != kForward) {
+            Slice k = key();
+            for (size_t i = 0; i < children_.size(); ++i) {
+                Iterator* child = children_[i];
+                if (child != current_) {
+                    child->Seek(k);
+                    if (child->Valid() && comparator_->Compare(k, child->key()) == 0) {
+                        child->Next();
+                    }
+                }
+            }
+            direction_ = kForward;
+        }
+        current_->Next();
+        FindSmallest();
+    }
+
+    void Prev() override {
+        assert(Valid());
+        if (direction_ != kReverse) {
+            Slice k = key();
+            for (size_t i = 0; i < children_.size(); ++i) {
+                Iterator* child = children_[i];
+                if (child != current_) {
+                    child->Seek(k);
+                    if (child->Valid()) {
+                        child->Prev();
+                    } else {
+                        child->SeekToLast();
+                    }
+                }
+            }
+            direction_ = kReverse;
+        }
+        current_->Prev();
+        FindLargest();
+    }
+
+    Slice key() override {
+        assert(Valid());
+        return current_->key();
+    }
+
+    Slice value() override {
+        assert(Valid());
+        return current_->value();
+    }
+
+    Status status() const override {
+        for (size_t i = 0; i < children_.size(); ++i) {
+            if (children_[i]->status() != Ok) {
+                return children_[i]->status();
+            }
+        }
+        return Ok;
+    }
+
+private:
+    enum Direction { kForward, kReverse };
+
+    void FindSmallest() {
+        Iterator* smallest = nullptr;
+        for (size_t i = 0; i < children_.size(); ++i) {
+            Iterator* child = children_[i];
+            if (child->Valid() &&
+                (smallest == nullptr || comparator_->Compare(child->key(), smallest->key()) < 0)) {
+                smallest = child;
+            }
+        }
+        current_ = smallest;
+    }
+
+    void FindLargest() {
+        Iterator* largest = nullptr;
+        for (size_t i = children_.size(); i-- > 0;) {
+            Iterator* child = children_[i];
+            if (child->Valid() &&
+                (largest == nullptr || comparator_->Compare(child->key(), largest->key()) > 0)) {
+                largest = child;
+            }
+        }
+        current_ = largest;
+    }
+
+    const Comparator* const comparator_;
+    std::vector<Iterator*> children_;
+    Iterator* current_;
+    Direction direction_;
+};
+
+}  // namespace
+
+Iterator* NewMergingIterator(const Comparator* comparator, Iterator** children, int n) {
+    if (n == 0) {
+        return new EmptyIterator(Ok);
+    }
+    if (n == 1) {
+        return children[0];
+    }
+    return new MergingIterator(comparator, children, n);
+}
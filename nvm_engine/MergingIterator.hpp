@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Comparator.hpp"
+#include "Iterator.hpp"
+
+// Iterates over the union of `children[0..n-1]` in key order. A key present
+// in several children is yielded once per child, the lowest-indexed child
+// first. Takes ownership of the children.
+Iterator* NewMergingIterator(const Comparator* comparator, Iterator** children, int n);
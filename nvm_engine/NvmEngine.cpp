@@ -1,19 +1,988 @@
 #include "NvmEngine.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "FixedKey.hpp"
+#include "InlineSkiplist.hpp"
+#include "ShardedEngine.hpp"
+
+static const uint64_t kKeyHashSeed = 0x9ae16a3b2f90404fULL;
+
+static const size_t kMaxMultiGetDepth = 64;
+
+static const uint64_t kSuperblockMagic = 0x31766b6d6d76706eULL;
+static const size_t kSuperblockSize = 4096;
+
+static const int kMaxOpenFilesFloor = 16;
+
+static const uint64_t kSnapshotPending = ~0ULL;
+// A snapshot taken before any write must not be numbered 0, which stands
+// for no snapshot.
+static const uint64_t kFirstSequence = 2;
+
+namespace {
+
+// A live log record waiting to be flushed, as kept in the flush's skip
+// list. The key follows the header.
+struct FlushEntry {
+    uint32_t location;
+    uint32_t key_size;
+
+    const char* key() const {
+        return reinterpret_cast<const char*>(this + 1);
+    }
+};
+
+struct FlushEntryComparator {
+    typedef Slice DecodedType;
+
+    const Comparator* comparator;
+
+    Slice decode_key(const char* entry) const {
+        const FlushEntry* e = reinterpret_cast<const FlushEntry*>(entry);
+        return Slice(const_cast<char*>(e->key()), e->key_size);
+    }
+
+    int operator()(const char* a, const char* b) const {
+        return comparator->Compare(decode_key(a), decode_key(b));
+    }
+
+    int operator()(const char* a, const Slice& b) const {
+        return comparator->Compare(decode_key(a), b);
+    }
+};
+
+typedef InlineSkipList<FlushEntryComparator> FlushList;
+
+// Walks the sorted flush entries and hands out the values of their log
+// records.
+class FlushIterator : public Iterator {
+public:
+    FlushIterator(const FlushList* list, const PmemLog* log) : iter_(list), log_(log) {}
+
+    bool Valid() const override {
+        return iter_.Valid();
+    }
+
+    void SeekToFirst() override {
+        iter_.SeekToFirst();
+    }
+
+    void SeekToLast() override {
+        iter_.SeekToLast();
+    }
+
+    void Seek(const Slice& target) override {
+        // Only the key part of a probe entry is compared.
+        std::string probe(sizeof(FlushEntry) + target.size(), '\0');
+        FlushEntry* e = reinterpret_cast<FlushEntry*>(&probe[0]);
+        e->key_size = target.size();
+        memcpy(&probe[sizeof(FlushEntry)], target.data(), target.size());
+        iter_.Seek(probe.data());
+    }
+
+    void Next() override {
+        iter_.Next();
+    }
+
+    void Prev() override {
+        iter_.Prev();
+    }
+
+    Slice key() override {
+        const FlushEntry* e = Entry();
+        return Slice(const_cast<char*>(e->key()), e->key_size);
+    }
+
+    Slice value() override {
+        const LogRecord* record = log_->Record(Entry()->location);
+        value_.clear();
+        AppendTableValue(&value_, (RecordType)record->type, record->expire,
+                         Slice(const_cast<char*>(record->value()), record->value_size));
+        return Slice(&value_[0], value_.size());
+    }
+
+    Status status() const override {
+        return Ok;
+    }
+
+private:
+    const FlushEntry* Entry() const {
+        return reinterpret_cast<const FlushEntry*>(iter_.Key());
+    }
+
+    FlushList::Iterator iter_;
+    const PmemLog* const log_;
+    std::string value_;
+};
+
+}  // namespace
+
 Status DB::CreateOrOpen(const std::string& name, DB** dbptr, FILE* log_file) {
-    return NvmEngine::CreateOrOpen(name, dbptr);
+    Options options;
+    options.info_log = log_file;
+    return NvmEngine::CreateOrOpen(name, dbptr, options);
 }
 
 DB::~DB() {}
 
+Snapshot::~Snapshot() {}
+
 Status NvmEngine::CreateOrOpen(const std::string& name, DB** dbptr) {
+    return CreateOrOpen(name, dbptr, Options());
+}
+
+Status NvmEngine::CreateOrOpen(const std::string& name, DB** dbptr, const Options& options) {
+    if (ShardedEngine::IsSharded(name, options)) {
+        return ShardedEngine::Open(name, options, dbptr);
+    }
+    NvmEngine* engine = new NvmEngine(options);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (options.index_prefault_threads > 0) {
+        engine->index_.Prefault(options.index_prefault_threads);
+        engine->inline_arena_.Prefault(options.index_prefault_threads);
+    }
+    bool created = false;
+    Status s = PmemFile::Open(name, options.pmem_size, options.pmem_map_sync, &engine->file_);
+    if (s == Ok && options.pmem_prefault_threads > 0) {
+        PrefaultPages(engine->file_->base(), engine->file_->size(),
+                      options.pmem_prefault_threads);
+    }
+    if (options.index_prefault_threads > 0 || options.pmem_prefault_threads > 0) {
+        // Includes mapping the file, which is cheap next to faulting it in.
+        RecordTick(engine->stats_, PREFAULT_MICROS,
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count());
+    }
+    if (s == Ok) {
+        s = engine->OpenStores(&created);
+    }
+    if (s == Ok) {
+        s = engine->OpenTables(options.table_path.empty() ? name + ".tables"
+                                                          : options.table_path);
+    }
+    if (s != Ok) {
+        delete engine;
+        return s;
+    }
+    engine->log_->SetFlushedGeneration(engine->versions_->flushed_generation());
+    // A file just laid out holds no records, and scanning its log headers
+    // would fault in a page per segment for nothing.
+    if (!created) {
+        engine->Recover();
+    }
+    if (engine->stats_ != nullptr) {
+        engine->stats_->StartDumping(options.info_log, options.stats_dump_period_sec,
+                                     options.max_log_file_size, options.info_log_label);
+    }
+    if (options.background_threads > 0) {
+        engine->background_ = new ThreadPool(options.background_threads);
+        std::lock_guard<std::mutex> l(engine->bg_mutex_);
+        if (engine->log_->FreeSegments() < engine->flush_trigger_) {
+            engine->MaybeScheduleFlushLocked();
+        }
+        engine->MaybeScheduleCompactionLocked();
+    }
+    *dbptr = engine;
     return Ok;
 }
+
+NvmEngine::NvmEngine(const Options& options)
+    : options_(options),
+      stats_(options.statistics ? new Statistics(options.trace_sample_period) : nullptr),
+      tracer_(stats_ != nullptr ? stats_->tracer() : nullptr),
+      file_(nullptr),
+      log_(nullptr),
+      slots_(nullptr),
+      index_(options.index_slots, options.index_pages),
+      inline_arena_(options.inline_value_threshold > 0 ? options.inline_arena_size : 0,
+                    kLocationUnit, options.index_pages),
+      last_sequence_(kFirstSequence - 1),
+      newest_snapshot_(0),
+      oldest_snapshot_(0),
+      table_cache_(nullptr),
+      versions_(nullptr),
+      background_(nullptr),
+      rate_limiter_(options.compaction_bytes_per_sec > 0
+                        ? new RateLimiter(options.compaction_bytes_per_sec)
+                        : nullptr),
+      flush_trigger_(0),
+      flush_scheduled_(false),
+      compaction_scheduled_(false),
+      shutting_down_(false),
+      flushes_completed_(0),
+      last_flush_status_(Ok) {
+    // Burn the first unit so that no inline record sits at location 0.
+    inline_arena_.AllocateAligned(kLocationUnit);
+}
+
+NvmEngine::~NvmEngine() {
+    {
+        std::unique_lock<std::mutex> l(bg_mutex_);
+        shutting_down_ = true;
+        bg_cv_.wait(l, [this] { return !flush_scheduled_ && !compaction_scheduled_; });
+    }
+    delete background_;
+    delete rate_limiter_;
+    delete versions_;
+    delete table_cache_;
+    delete stats_;
+    delete log_;
+    delete slots_;
+    delete file_;
+}
+
+Status NvmEngine::OpenStores(bool* created) {
+    Superblock* sb = reinterpret_cast<Superblock*>(file_->base());
+    *created = sb->magic != kSuperblockMagic;
+    if (*created) {
+        size_t space = (file_->size() - kSuperblockSize) & ~(kLocationUnit - 1);
+        size_t slot_space = 0;
+        if (options_.fixed_value_size > 0) {
+            slot_space = (size_t)(space * options_.fixed_store_fraction) & ~(kLocationUnit - 1);
+        }
+        Superblock layout;
+        layout.magic = 0;
+        layout.slot_offset = kSuperblockSize;
+        layout.slot_size = slot_space;
+        layout.slot_pools = slot_space > 0 ? options_.pool_count : 0;
+        layout.key_size = options_.fixed_key_size;
+        layout.value_size = options_.fixed_value_size;
+        layout.log_offset = kSuperblockSize + slot_space;
+        layout.log_size = std::min(space - slot_space, kMaxLocationSpace);
+        layout.log_pools = options_.pool_count;
+        layout.log_segment_size = options_.log_segment_size;
+        // The magic goes last, so a crash while laying out the file leaves
+        // it to be laid out again.
+        memcpy(sb, &layout, sizeof(layout));
+        file_->Persist(sb, sizeof(layout));
+        sb->magic = kSuperblockMagic;
+        file_->Persist(&sb->magic, sizeof(sb->magic));
+    }
+
+    if (sb->log_offset + sb->log_size > file_->size() ||
+        sb->slot_offset + sb->slot_size > file_->size()) {
+        return IOError;
+    }
+    Status s = PmemLog::Open(file_, sb->log_offset, sb->log_size, sb->log_pools,
+                             sb->log_segment_size, &log_, stats_);
+    if (s == Ok && sb->slot_size > 0) {
+        s = SlotStore::Open(file_, sb->slot_offset, sb->slot_size, sb->slot_pools, sb->key_size,
+                            sb->value_size, &slots_, stats_);
+    }
+    if (s == Ok) {
+        flush_trigger_ = std::max<size_t>(
+            1, (size_t)(log_->segment_count() * options_.flush_free_fraction));
+    }
+    return s;
+}
+
+Status NvmEngine::OpenTables(const std::string& dirname) {
+    table_cache_ = new TableCache(dirname, options_,
+                                  std::max(options_.max_open_files, kMaxOpenFilesFloor), stats_);
+    versions_ = new VersionSet(dirname, options_, table_cache_, stats_);
+    return versions_->Recover();
+}
+
+uint64_t NvmEngine::HashKey(const Slice& key) {
+    return KeyHash(key, kKeyHashSeed);
+}
+
+bool NvmEngine::KeyMatches(ValueHandle handle, const Slice& key, uint32_t* version) {
+    if (IsSlotHandle(handle)) {
+        uint32_t slot = HandleSlot(handle);
+        if (!KeyEqual(slots_->Key(slot), slots_->key_size(), key)) {
+            return false;
+        }
+        *version = slots_->Version(slot);
+    } else if (HandleEncoding(handle) == kEncodingRawUncompressed) {
+        InlineRecord* record = InlineAt(handle);
+        if (!KeyEqual(record->key(), record->key_size, key)) {
+            return false;
+        }
+        *version = record->version;
+    } else {
+        const LogRecord* record = log_->Record(HandleLocation(handle));
+        if (!KeyEqual(record->key(), record->key_size, key)) {
+            return false;
+        }
+        *version = record->version;
+    }
+    return true;
+}
+
+NvmEngine::InlineRecord* NvmEngine::InlineAt(ValueHandle handle) const {
+    return reinterpret_cast<InlineRecord*>(
+        inline_arena_.At((size_t)HandleLocation(handle) << kLocationShift));
+}
+
+bool NvmEngine::Append(const Slice& key, const Slice& value, uint32_t version, RecordType type,
+                       uint32_t expire, ValueHandle* handle) {
+    uint32_t slot;
+    if (slots_ != nullptr && type == kTypeValue && expire == 0 && slots_->Fits(key, value) &&
+        slots_->Append(key, value, version, &slot)) {
+        *handle = EncodeSlotHandle(slot);
+        return true;
+    }
+    KVSRef ref;
+    if (!log_->Append(key, value, version, type, expire, &ref)) {
+        return false;
+    }
+    *handle = EncodePmemHandle(log_->Location(ref));
+    return true;
+}
+
+void NvmEngine::Publish(HashIndex::Stripe* stripe, HashIndex::Slot* slot, const Slice& key,
+                        const Slice& value, uint32_t version, bool inlinable,
+                        ValueHandle handle) {
+    if (inlinable && value.size() <= options_.inline_value_threshold) {
+        ValueHandle old = slot->load(std::memory_order_relaxed);
+        InlineRecord* record = nullptr;
+        if (HashIndex::IsLive(old) && HandleEncoding(old) == kEncodingRawUncompressed) {
+            record = InlineAt(old);
+        } else {
+            size_t capacity = options_.inline_value_threshold;
+            char* mem = inline_arena_.AllocateAligned(sizeof(InlineRecord) + key.size() + capacity);
+            if (mem != nullptr) {
+                record = reinterpret_cast<InlineRecord*>(mem);
+                record->key_size = key.size();
+                record->capacity = capacity;
+                memcpy(record->key(), key.data(), key.size());
+            }
+        }
+        if (record != nullptr) {
+            HashIndex::BeginWrite(stripe);
+            record->version = version;
+            record->value_size = value.size();
+            memcpy(record->value(), value.data(), value.size());
+            HashIndex::EndWrite(stripe);
+            handle = EncodeInlineHandle(
+                (uint32_t)(inline_arena_.Offset(reinterpret_cast<char*>(record)) >> kLocationShift));
+        }
+    }
+
+    slot->store(handle, std::memory_order_release);
+}
+
 Status NvmEngine::Get(const Slice& key, std::string* value) {
-    return Ok;
+    return Lookup(key, HashKey(key), value);
 }
+
+Status NvmEngine::Lookup(const Slice& key, uint64_t hash, std::string* value) {
+    HashIndex::Stripe* stripe = index_.StripeFor(hash);
+    RecordTick(stats_, GET_CALLS);
+    if (tracer_ != nullptr) {
+        tracer_->Begin(TRACE_GET);
+    }
+
+    ReadEpochs::Slot* epoch = epochs_.Enter();
+    while (true) {
+        uint32_t seq = HashIndex::ReadBegin(stripe);
+        size_t probed;
+        bool inline_value = false;
+        // Only log records are deletions or expire.
+        bool deleted = false;
+        uint32_t expire = 0;
+        HashIndex::Slot* slot = index_.Find(hash, [&](ValueHandle handle) {
+            Tracer::Mark(TRACE_GET_INDEX);
+            if (IsSlotHandle(handle)) {
+                uint32_t slot = HandleSlot(handle);
+                bool match = KeyEqual(slots_->Key(slot), slots_->key_size(), key);
+                Tracer::Mark(TRACE_GET_READ);
+                if (!match) {
+                    return false;
+                }
+                value->assign(slots_->Value(slot), slots_->value_size());
+            } else if (HandleEncoding(handle) == kEncodingRawUncompressed) {
+                InlineRecord* record = InlineAt(handle);
+                bool match = KeyEqual(record->key(), record->key_size, key);
+                Tracer::Mark(TRACE_GET_READ);
+                if (!match) {
+                    return false;
+                }
+                // The record may be rewritten concurrently; a torn size is
+                // clamped here and the read retried below.
+                uint32_t size = record->value_size;
+                value->assign(record->value(), size < record->capacity ? size : record->capacity);
+                inline_value = true;
+            } else {
+                const LogRecord* record = log_->Record(HandleLocation(handle));
+                bool match = KeyEqual(record->key(), record->key_size, key);
+                Tracer::Mark(TRACE_GET_READ);
+                if (!match) {
+                    return false;
+                }
+                deleted = record->type == kTypeDeletion;
+                expire = record->expire;
+                value->assign(record->value(), record->value_size);
+            }
+            Tracer::Mark(TRACE_GET_COPY);
+            return true;
+        }, &probed);
+        Tracer::Mark(TRACE_GET_INDEX);
+        RecordTick(stats_, INDEX_LOOKUPS);
+        RecordTick(stats_, INDEX_BUCKETS_PROBED, probed);
+        if (probed > 1) {
+            RecordTick(stats_, INDEX_LONG_PROBES);
+        }
+        if (!HashIndex::ReadRetry(stripe, seq)) {
+            epochs_.Exit(epoch);
+            if (tracer_ != nullptr) {
+                tracer_->End();
+            }
+            if (slot == nullptr) {
+                break;
+            }
+            // The index entry shadows whatever the tables hold for the key.
+            if (deleted) {
+                return NotFound;
+            }
+            if (IsExpired(expire, NowSeconds())) {
+                RecordTick(stats_, GET_EXPIRED);
+                return NotFound;
+            }
+            RecordTick(stats_, GET_FOUND);
+            RecordTick(stats_, inline_value ? GET_INLINE_HITS : GET_PMEM_READS);
+            return Ok;
+        }
+        RecordTick(stats_, GET_SEQLOCK_RETRIES);
+    }
+
+    // Keys the index does not have may have been flushed. A flush installs
+    // its tables before it unlinks the keys, so a key is always in one of
+    // the two.
+    RecordTick(stats_, GET_TABLE_LOOKUPS);
+    Status s = versions_->Get(key, value);
+    if (s == Ok) {
+        RecordTick(stats_, GET_FOUND);
+        RecordTick(stats_, GET_TABLE_HITS);
+    }
+    return s;
+}
+
+void NvmEngine::PrefetchValue(ValueHandle handle) const {
+    const char* record;
+    if (IsSlotHandle(handle)) {
+        record = slots_->Key(HandleSlot(handle));
+    } else if (HandleEncoding(handle) == kEncodingRawUncompressed) {
+        record = reinterpret_cast<const char*>(InlineAt(handle));
+    } else {
+        record = reinterpret_cast<const char*>(log_->Record(HandleLocation(handle)));
+    }
+    // Header, a 16-byte key and an 80-byte value span two lines; a slot
+    // without the header may still straddle two.
+    _mm_prefetch(record, _MM_HINT_T0);
+    _mm_prefetch(record + 64, _MM_HINT_T0);
+}
+
+// Group prefetching: for a group of keys, first prefetch every home bucket,
+// then peek at the buckets and prefetch every candidate record, and only
+// then run the ordinary lookups, which now mostly hit the cache. The misses
+// of a group overlap instead of being paid one after another.
+void NvmEngine::MultiGet(size_t n, const Slice* keys, std::string* values, Status* statuses) {
+    const size_t depth = std::max<size_t>(1, std::min(options_.multiget_depth, kMaxMultiGetDepth));
+    uint64_t hashes[kMaxMultiGetDepth];
+
+    for (size_t start = 0; start < n; start += depth) {
+        size_t group = std::min(depth, n - start);
+        for (size_t i = 0; i < group; ++i) {
+            hashes[i] = HashKey(keys[start + i]);
+            index_.Prefetch(hashes[i]);
+        }
+        for (size_t i = 0; i < group; ++i) {
+            ValueHandle handle = index_.Peek(hashes[i]);
+            if (handle != 0) {
+                PrefetchValue(handle);
+            }
+        }
+        for (size_t i = 0; i < group; ++i) {
+            statuses[start + i] = Lookup(keys[start + i], hashes[i], &values[start + i]);
+        }
+    }
+}
+
 Status NvmEngine::Set(const Slice& key, const Slice& value) {
+    RecordTick(stats_, SET_CALLS);
+    return Write(key, value, kTypeValue, 0);
+}
+
+Status NvmEngine::Set(const Slice& key, const Slice& value, uint32_t ttl) {
+    RecordTick(stats_, SET_CALLS);
+    return Write(key, value, kTypeValue, ttl != 0 ? NowSeconds() + ttl : 0);
+}
+
+Status NvmEngine::Delete(const Slice& key) {
+    RecordTick(stats_, DELETE_CALLS);
+    return Write(key, Slice(), kTypeDeletion, 0);
+}
+
+Status NvmEngine::Write(const Slice& key, const Slice& value, RecordType type, uint32_t expire) {
+    if (tracer_ != nullptr) {
+        tracer_->Begin(TRACE_SET);
+    }
+    WriteRequest w;
+    w.key = key;
+    w.value = value;
+    w.type = type;
+    w.expire = expire;
+    w.hash = HashKey(key);
+    HashIndex::Stripe* stripe = index_.StripeFor(w.hash);
+
+    while (true) {
+        w.status = Ok;
+        w.log_full = false;
+        w.done.store(false, std::memory_order_relaxed);
+        HashIndex::AddWaiter(stripe, &w);
+        // Whoever gets the lock writes for everyone queued on the stripe,
+        // so the loser waits for its request to be done, or for the lock
+        // to do it itself.
+        while (!w.done.load(std::memory_order_acquire)) {
+            if (!HashIndex::TryLock(stripe)) {
+                __builtin_ia32_pause();
+                continue;
+            }
+            ReadEpochs::Slot* write = writes_.Enter();
+            CommitWrites(HashIndex::TakeWaiters(stripe));
+            HashIndex::Unlock(stripe);
+            writes_.Exit(write);
+        }
+        // The stripe is released while waiting, as the flush takes it to
+        // unlink what it moved.
+        if (!w.log_full || !WaitForLogSpace()) {
+            break;
+        }
+        RecordTick(stats_, WRITE_STALLS);
+    }
+    Tracer::Mark(TRACE_SET_PUBLISH);
+    if (tracer_ != nullptr) {
+        tracer_->End();
+    }
+    if (w.status != Ok) {
+        RecordTick(stats_, SET_FAILED);
+    } else if (log_->FreeSegments() < flush_trigger_ ||
+               (slots_ != nullptr && slots_->ReuseDue())) {
+        MaybeScheduleFlush();
+    }
+    return w.status;
+}
+
+void NvmEngine::CommitWrites(HashIndex::Waiter* batch) {
+    while (batch != nullptr) {
+        // Move the requests for the key of the first one into a group,
+        // keeping their order.
+        WriteRequest* group = static_cast<WriteRequest*>(batch);
+        batch = batch->next;
+        WriteRequest* tail = group;
+        size_t count = 1;
+        for (HashIndex::Waiter** link = &batch; *link != nullptr;) {
+            WriteRequest* r = static_cast<WriteRequest*>(*link);
+            if (r->hash == group->hash && r->key == group->key) {
+                *link = r->next;
+                tail->next = r;
+                tail = r;
+                ++count;
+            } else {
+                link = &r->next;
+            }
+        }
+        tail->next = nullptr;
+
+        // The newest write stands for the group; if it fails, the next
+        // newest is tried.
+        while (group != nullptr) {
+            WriteRequest* next = Next(group);
+            if (WriteLocked(group, count)) {
+                RecordTick(stats_, WRITES_COMBINED, count - 1);
+                for (WriteRequest* r = next; r != nullptr;) {
+                    WriteRequest* after = Next(r);
+                    r->status = Ok;
+                    r->done.store(true, std::memory_order_release);
+                    r = after;
+                }
+                next = nullptr;
+            }
+            group->done.store(true, std::memory_order_release);
+            group = next;
+            --count;
+        }
+    }
+}
+
+bool NvmEngine::WriteLocked(WriteRequest* w, uint64_t count) {
+    HashIndex::Stripe* stripe = index_.StripeFor(w->hash);
+    uint32_t version = 0;
+    bool inserted;
+    HashIndex::Slot* slot = index_.FindOrInsert(w->hash, [&](ValueHandle handle) {
+        return KeyMatches(handle, w->key, &version);
+    }, &inserted);
+    Tracer::Mark(TRACE_SET_INDEX);
+    if (slot == nullptr) {
+        w->status = OutOfMemory;
+        return false;
+    }
+    std::string ignored;
+    if (w->type == kTypeDeletion && inserted && versions_->Get(w->key, &ignored) == NotFound) {
+        // Nothing to delete; a tombstone would only take up space.
+        index_.Abandon(w->hash, slot);
+        return true;
+    }
+    ValueHandle handle;
+    if (!Append(w->key, w->value, version + 1, w->type, w->expire, &handle)) {
+        if (inserted) {
+            index_.Abandon(w->hash, slot);
+        }
+        w->status = OutOfMemory;
+        w->log_full = log_->Fits(w->key, w->value);
+        return false;
+    }
+    // The numbers are taken before the snapshot flag is read; see
+    // GetSnapshot. A group's numbers are consecutive, so no snapshot falls
+    // between them and sees a value that was never written.
+    uint64_t sequence = last_sequence_.fetch_add(count) + 1;
+    uint64_t newest_snapshot = newest_snapshot_.load();
+    if (newest_snapshot != 0) {
+        SaveOverwritten(w->key, w->hash, slot, inserted, sequence, oldest_snapshot_.load(),
+                        newest_snapshot);
+    }
+    ValueHandle old = slot->load(std::memory_order_relaxed);
+    Publish(stripe, slot, w->key, w->value, version + 1,
+            w->type == kTypeValue && w->expire == 0 && !IsSlotHandle(handle), handle);
+    // Only now that the new record is durable and the slot unreachable.
+    if (!inserted && IsSlotHandle(old)) {
+        slots_->Kill(HandleSlot(old));
+    }
+    return true;
+}
+
+bool NvmEngine::ReadValue(ValueHandle handle, std::string* value) {
+    if (IsSlotHandle(handle)) {
+        value->assign(slots_->Value(HandleSlot(handle)), slots_->value_size());
+    } else if (HandleEncoding(handle) == kEncodingRawUncompressed) {
+        InlineRecord* record = InlineAt(handle);
+        value->assign(record->value(), record->value_size);
+    } else {
+        const LogRecord* record = log_->Record(HandleLocation(handle));
+        if (record->type == kTypeDeletion || IsExpired(record->expire, NowSeconds())) {
+            return false;
+        }
+        value->assign(record->value(), record->value_size);
+    }
+    return true;
+}
+
+void NvmEngine::SaveOverwritten(const Slice& key, uint64_t hash, HashIndex::Slot* slot,
+                                bool inserted, uint64_t sequence, uint64_t oldest_snapshot,
+                                uint64_t newest_snapshot) {
+    ValueHandle old = slot->load(std::memory_order_relaxed);
+    bool saved = overwritten_.Save(key, hash, sequence, oldest_snapshot, newest_snapshot,
+                                   [&](std::string* value) {
+        // A key new to the index may still be in the tables.
+        if (inserted) {
+            return versions_->Get(key, value) == Ok;
+        }
+        return ReadValue(old, value);
+    });
+    if (saved) {
+        RecordTick(stats_, SNAPSHOT_VALUES_SAVED);
+    }
+}
+
+const Snapshot* NvmEngine::GetSnapshot() {
+    std::lock_guard<std::mutex> l(snapshots_mutex_);
+    // A write numbered after the snapshot takes its number after the flag
+    // is set, so it sees the flag and saves the value it replaces. The
+    // writes numbered up to the snapshot are waited out, so that reads at
+    // the snapshot find all of them published.
+    newest_snapshot_.store(kSnapshotPending);
+    uint64_t sequence = last_sequence_.load();
+    SnapshotImpl* snapshot = snapshots_.New(sequence);
+    oldest_snapshot_.store(snapshots_.oldest());
+    newest_snapshot_.store(sequence);
+    writes_.Synchronize();
+    return snapshot;
+}
+
+void NvmEngine::ReleaseSnapshot(const Snapshot* snapshot) {
+    std::lock_guard<std::mutex> l(snapshots_mutex_);
+    snapshots_.Delete(static_cast<const SnapshotImpl*>(snapshot));
+    newest_snapshot_.store(snapshots_.empty() ? 0 : snapshots_.newest());
+    oldest_snapshot_.store(snapshots_.empty() ? 0 : snapshots_.oldest());
+    // Under the mutex, so that no snapshot is taken meanwhile whose values
+    // the trim would miss.
+    std::vector<uint64_t> live;
+    snapshots_.Sequences(&live);
+    overwritten_.Trim(live);
+}
+
+Status NvmEngine::Get(const Snapshot* snapshot, const Slice& key, std::string* value) {
+    if (snapshot == nullptr) {
+        return Get(key, value);
+    }
+    // The current value first: a write saves the value it replaces before
+    // it publishes its own, so if the current value is too new for the
+    // snapshot, the one it replaced is found below.
+    uint64_t hash = HashKey(key);
+    Status s = Lookup(key, hash, value);
+    overwritten_.Get(key, hash, static_cast<const SnapshotImpl*>(snapshot)->sequence(), &s,
+                     value);
+    return s;
+}
+
+void NvmEngine::Recover() {
+    log_->Recover([this](uint32_t location, const LogRecord* record) {
+        Slice key(const_cast<char*>(record->key()), record->key_size);
+        Slice value(const_cast<char*>(record->value()), record->value_size);
+        RecoverRecord(key, value, record->version,
+                      record->type == kTypeValue && record->expire == 0,
+                      EncodePmemHandle(location));
+    });
+    if (slots_ != nullptr) {
+        slots_->Recover([this](uint32_t slot) {
+            Slice key(const_cast<char*>(slots_->Key(slot)), slots_->key_size());
+            Slice value(const_cast<char*>(slots_->Value(slot)), slots_->value_size());
+            RecoverRecord(key, value, slots_->Version(slot), false, EncodeSlotHandle(slot));
+        });
+        // Nothing reads them yet.
+        std::vector<uint32_t> killed;
+        slots_->TakeKilled(&killed);
+        slots_->Reuse(killed);
+    }
+}
+
+void NvmEngine::RecoverRecord(const Slice& key, const Slice& value, uint32_t version,
+                              bool inlinable, ValueHandle handle) {
+    uint64_t hash = HashKey(key);
+    uint32_t current = 0;
+    bool inserted;
+    HashIndex::Slot* slot = index_.FindOrInsert(hash, [&](ValueHandle h) {
+        return KeyMatches(h, key, &current);
+    }, &inserted);
+    if (slot == nullptr) {
+        return;
+    }
+    // Pools and stores are replayed one after another, so an older version
+    // of the key may show up after a newer one. The slot that lost is
+    // killed, as a crash may have come before the write did it.
+    ValueHandle old = slot->load(std::memory_order_relaxed);
+    if (!inserted && (int32_t)(version - current) <= 0) {
+        if (IsSlotHandle(handle)) {
+            slots_->Kill(HandleSlot(handle));
+        }
+        return;
+    }
+    if (!inserted && IsSlotHandle(old)) {
+        slots_->Kill(HandleSlot(old));
+    }
+    Publish(index_.StripeFor(hash), slot, key, value, version, inlinable, handle);
+}
+
+void NvmEngine::MaybeScheduleFlush() {
+    if (background_ == nullptr || flush_scheduled_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<std::mutex> l(bg_mutex_);
+    MaybeScheduleFlushLocked();
+}
+
+void NvmEngine::MaybeScheduleFlushLocked() {
+    if (background_ == nullptr || flush_scheduled_ || shutting_down_) {
+        return;
+    }
+    flush_scheduled_ = true;
+    background_->Schedule([this] { BackgroundFlush(); });
+}
+
+void NvmEngine::MaybeScheduleCompactionLocked() {
+    if (background_ == nullptr || compaction_scheduled_ || shutting_down_ ||
+        !versions_->NeedsCompaction()) {
+        return;
+    }
+    compaction_scheduled_ = true;
+    background_->Schedule([this] { BackgroundCompaction(); });
+}
+
+void NvmEngine::BackgroundFlush() {
+    Status s = shutting_down_ ? Ok : FlushLog();
+    std::lock_guard<std::mutex> l(bg_mutex_);
+    flush_scheduled_ = false;
+    ++flushes_completed_;
+    last_flush_status_ = s;
+    MaybeScheduleCompactionLocked();
+    bg_cv_.notify_all();
+}
+
+void NvmEngine::BackgroundCompaction() {
+    Status s = shutting_down_ ? Ok : versions_->CompactOnce(rate_limiter_, &shutting_down_);
+    std::lock_guard<std::mutex> l(bg_mutex_);
+    compaction_scheduled_ = false;
+    // Go on while levels are over their limits; after an error, leave it
+    // to the next flush to try again.
+    if (s == Ok) {
+        MaybeScheduleCompactionLocked();
+    }
+    bg_cv_.notify_all();
+}
+
+bool NvmEngine::WaitForLogSpace() {
+    std::unique_lock<std::mutex> l(bg_mutex_);
+    if (background_ == nullptr || shutting_down_) {
+        return false;
+    }
+    uint64_t seen = flushes_completed_;
+    MaybeScheduleFlushLocked();
+    bg_cv_.wait(l, [&] { return flushes_completed_ != seen || shutting_down_; });
+    return last_flush_status_ == Ok && log_->FreeSegments() > 0;
+}
+
+void NvmEngine::ReuseKilledSlots() {
+    std::vector<uint32_t> killed;
+    slots_->TakeKilled(&killed);
+    if (killed.empty()) {
+        return;
+    }
+    // Gets read slots under epochs_, and writers compare the keys of the
+    // slots they probe under writes_.
+    epochs_.Synchronize();
+    writes_.Synchronize();
+    slots_->Reuse(killed);
+}
+
+Status NvmEngine::FlushLog() {
+    if (slots_ != nullptr) {
+        ReuseKilledSlots();
+    }
+    std::vector<uint32_t> frozen;
+    frozen.swap(unflushed_);
+    log_->Freeze(&frozen);
+    if (frozen.empty()) {
+        return Ok;
+    }
+    uint64_t generation = 0;
+    for (size_t i = 0; i < frozen.size(); ++i) {
+        generation = std::max(generation, log_->Generation(frozen[i]));
+    }
+
+    // Only the record the index refers to is flushed, one per key at most,
+    // so no key is in the tables of two batches. Its older records may be
+    // in any batch, though, and would outlive it at recovery if its
+    // segments were given up on their own. So the segments stay in the log
+    // until the edit of the last batch marks them all flushed at once.
+    size_t next = 0;
+    while (next < frozen.size()) {
+        size_t bytes = log_->SegmentUsage(frozen[next]);
+        size_t end = next + 1;
+        while (end < frozen.size() &&
+               bytes + log_->SegmentUsage(frozen[end]) <= options_.max_flush_batch_size) {
+            bytes += log_->SegmentUsage(frozen[end]);
+            ++end;
+        }
+        std::vector<uint32_t> batch(frozen.begin() + next, frozen.begin() + end);
+        Status s = FlushSegments(batch, end == frozen.size() ? generation : 0);
+        if (s != Ok) {
+            // The tables of the batches before stay installed; flushing
+            // their records again only shadows them with equal values.
+            unflushed_.swap(frozen);
+            return s;
+        }
+        next = end;
+    }
+
+    // Recovery no longer needs the segments. Their records stay readable
+    // until every Get that may have found them through the index is done.
+    log_->Retire(frozen);
+    for (size_t i = 0; i < frozen.size(); ++i) {
+        log_->ForEachRecord(frozen[i], [&](uint32_t location, const LogRecord* record) {
+            Slice key(const_cast<char*>(record->key()), record->key_size);
+            uint64_t hash = HashKey(key);
+            ValueHandle location_handle = EncodePmemHandle(location);
+            HashIndex::Stripe* stripe = index_.StripeFor(hash);
+            HashIndex::Lock(stripe);
+            // Inline copies stay. A Set since the flush began has moved the
+            // key on; leave it be.
+            HashIndex::Slot* slot = index_.Find(hash, [&](ValueHandle handle) {
+                return handle == location_handle;
+            });
+            if (slot != nullptr) {
+                index_.Erase(hash, slot);
+            }
+            HashIndex::Unlock(stripe);
+        });
+    }
+    epochs_.Synchronize();
+    log_->Release(frozen);
     return Ok;
 }
 
-NvmEngine::~NvmEngine() {}
+Status NvmEngine::FlushSegments(const std::vector<uint32_t>& batch, uint64_t flushed_generation) {
+    // Node sizes are bounded by the records', which take at least one
+    // location unit each; the arena only faults in what it hands out.
+    size_t bytes = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        bytes += log_->SegmentUsage(batch[i]);
+    }
+    Arena arena(3 * bytes + (64 << 10));
+    FlushEntryComparator comparator = { options_.comparator };
+    FlushList list(comparator, &arena);
+
+    // A record is live if the index still refers to it: by its location,
+    // or by an inline copy of the same version.
+    uint64_t records = 0;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        log_->ForEachRecord(batch[i], [&](uint32_t location, const LogRecord* record) {
+            Slice key(const_cast<char*>(record->key()), record->key_size);
+            uint64_t hash = HashKey(key);
+            ValueHandle location_handle = EncodePmemHandle(location);
+            HashIndex::Stripe* stripe = index_.StripeFor(hash);
+            HashIndex::Lock(stripe);
+            HashIndex::Slot* slot = index_.Find(hash, [&](ValueHandle handle) {
+                if (handle == location_handle) {
+                    return true;
+                }
+                if (!IsSlotHandle(handle) && HandleEncoding(handle) == kEncodingRawUncompressed) {
+                    InlineRecord* inline_record = InlineAt(handle);
+                    return inline_record->version == record->version &&
+                           KeyEqual(inline_record->key(), inline_record->key_size, key);
+                }
+                return false;
+            });
+            HashIndex::Unlock(stripe);
+            if (slot == nullptr) {
+                return;
+            }
+            char* mem = list.AllocateKey(sizeof(FlushEntry) + key.size());
+            FlushEntry* entry = reinterpret_cast<FlushEntry*>(mem);
+            entry->location = location;
+            entry->key_size = key.size();
+            memcpy(mem + sizeof(FlushEntry), key.data(), key.size());
+            list.Insert(mem);
+            ++records;
+        });
+    }
+
+    VersionEdit edit;
+    edit.flushed_generation = flushed_generation;
+    std::vector<FileRef> outputs;
+    FlushIterator iter(&list, log_);
+    // Deletions and expired values of keys no table holds go no further.
+    std::shared_ptr<const Version> base = versions_->current();
+    Status s = versions_->WriteTables(&iter, *base, 0, nullptr, nullptr, &outputs);
+    uint64_t bytes_written = 0;
+    if (s == Ok && (!outputs.empty() || flushed_generation != 0)) {
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            edit.added.push_back(std::make_pair(0, outputs[i]));
+            bytes_written += outputs[i]->file_size;
+        }
+        s = versions_->LogAndApply(edit);
+    }
+    if (s != Ok) {
+        return s;
+    }
+
+    RecordTick(stats_, FLUSHES);
+    RecordTick(stats_, FLUSH_RECORDS, records);
+    RecordTick(stats_, FLUSH_BYTES_WRITTEN, bytes_written);
+    return Ok;
+}
@@ -3,19 +3,232 @@
 
 #include "include/db.hpp"
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "Arena.hpp"
+#include "HashIndex.hpp"
+#include "Options.hpp"
+#include "PmemFile.hpp"
+#include "PmemLog.hpp"
+#include "RateLimiter.hpp"
+#include "ReadEpochs.hpp"
+#include "SlotStore.hpp"
+#include "Snapshot.hpp"
+#include "Statistics.hpp"
+#include "Table.hpp"
+#include "ThreadPool.hpp"
+#include "VersionSet.hpp"
+
 class NvmEngine : DB {
 public:
     /**
-     * @param 
+     * @param
      * name: file in AEP(exist)
      * dbptr: pointer of db object
      *
      */
     static Status CreateOrOpen(const std::string& name, DB** dbptr);
+    static Status CreateOrOpen(const std::string& name, DB** dbptr, const Options& options);
     Status Get(const Slice& key, std::string* value);
     Status Set(const Slice& key, const Slice& value);
+    Status Set(const Slice& key, const Slice& value, uint32_t ttl);
+    Status Delete(const Slice& key);
+    void MultiGet(size_t n, const Slice* keys, std::string* values, Status* statuses);
+    const Snapshot* GetSnapshot();
+    void ReleaseSnapshot(const Snapshot* snapshot);
+    Status Get(const Snapshot* snapshot, const Slice& key, std::string* value);
     ~NvmEngine();
 private:
+    // DRAM copy of a small value, kept next to its key. The value area is
+    // always inline_value_threshold bytes, so later updates are done in
+    // place under the stripe's seqlock.
+    struct InlineRecord {
+        uint32_t version;
+        uint32_t key_size;
+        uint32_t value_size;
+        uint32_t capacity;
+
+        char* key() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+
+        char* value() {
+            return key() + key_size;
+        }
+    };
+
+    // First block of the file: where the log and the slot store live. It is
+    // written when the file is created, so a file keeps its layout when it
+    // is reopened with other options.
+    struct Superblock {
+        uint64_t magic;
+        uint64_t log_offset;
+        uint64_t log_size;
+        uint64_t log_pools;
+        uint64_t slot_offset;
+        uint64_t slot_size;
+        uint64_t slot_pools;
+        uint64_t key_size;
+        uint64_t value_size;
+        // Zero in files laid out before the log had segments, which then
+        // get one segment per pool.
+        uint64_t log_segment_size;
+    };
+
+    // A Set or Delete queued on its stripe. Whoever holds the stripe lock
+    // fills in the status and then sets `done`.
+    struct WriteRequest : HashIndex::Waiter {
+        Slice key;
+        Slice value;
+        RecordType type;
+        uint32_t expire;
+        uint64_t hash;
+        Status status;
+        // The log had no free segment; the owner waits for a flush and
+        // queues the request again.
+        bool log_full;
+        std::atomic<bool> done;
+    };
+
+    static WriteRequest* Next(WriteRequest* r) {
+        return static_cast<WriteRequest*>(r->next);
+    }
+
+    explicit NvmEngine(const Options& options);
+
+    // Reads the layout from the superblock, or lays out a new file and sets
+    // `*created`.
+    Status OpenStores(bool* created);
+
+    // Opens the sorted tables in `dirname`.
+    Status OpenTables(const std::string& dirname);
+
+    static uint64_t HashKey(const Slice& key);
+
+    InlineRecord* InlineAt(ValueHandle handle) const;
+
+    // Starts loading the record behind `handle` into the cache.
+    void PrefetchValue(ValueHandle handle) const;
+
+    // Returns whether `handle` refers to `key`, and the version stored
+    // behind it.
+    bool KeyMatches(ValueHandle handle, const Slice& key, uint32_t* version);
+
+    Status Lookup(const Slice& key, uint64_t hash, std::string* value);
+
+    // Sets, overwrites or deletes a key.
+    Status Write(const Slice& key, const Slice& value, RecordType type, uint32_t expire);
+
+    // Does the writes queued on a stripe, whose lock the caller holds. Of
+    // the writes to one key only the newest is persisted: they raced, so
+    // it may as well have come last, and the older ones complete with it.
+    void CommitWrites(HashIndex::Waiter* batch);
+
+    // Writes `w` and numbers it as the last of `count` writes to its key.
+    // Returns false and sets its status if it fails.
+    bool WriteLocked(WriteRequest* w, uint64_t count);
+
+    // Writes the record to the slot store if it is a plain value that fits
+    // there, else to the log, and returns the handle of the durable copy.
+    bool Append(const Slice& key, const Slice& value, uint32_t version, RecordType type,
+                uint32_t expire, ValueHandle* handle);
+
+    // Installs the record that was just made durable at `handle` into
+    // `slot`, copying it inline when it is `inlinable` and small enough.
+    // Only log values that do not expire are inlinable: slots stay in the
+    // index so that a later write can kill them. Caller holds the stripe
+    // lock.
+    void Publish(HashIndex::Stripe* stripe, HashIndex::Slot* slot, const Slice& key,
+                 const Slice& value, uint32_t version, bool inlinable, ValueHandle handle);
+
+    // Copies the value behind a live `handle`; returns false if it is a
+    // deletion or has expired. Caller holds the stripe lock.
+    bool ReadValue(ValueHandle handle, std::string* value);
+
+    // Saves the value the write numbered `sequence` is about to replace in
+    // `slot` for the snapshots that may read it. Caller holds the stripe
+    // lock.
+    void SaveOverwritten(const Slice& key, uint64_t hash, HashIndex::Slot* slot, bool inserted,
+                         uint64_t sequence, uint64_t oldest_snapshot, uint64_t newest_snapshot);
+
+    void Recover();
+    void RecoverRecord(const Slice& key, const Slice& value, uint32_t version, bool inlinable,
+                       ValueHandle handle);
+
+    // Background work. The Locked variants expect bg_mutex_ to be held.
+    void MaybeScheduleFlush();
+    void MaybeScheduleFlushLocked();
+    void MaybeScheduleCompactionLocked();
+    void BackgroundFlush();
+    void BackgroundCompaction();
+
+    // Moves the live records of every segment written so far into level 0
+    // tables, in batches of at most max_flush_batch_size bytes, then
+    // unlinks them from the index and frees the segments. Killed slots are
+    // made reusable on the way.
+    Status FlushLog();
+    // Writes the live records of one batch to level 0 tables and installs
+    // them. A `flushed_generation` other than 0 goes into the same edit.
+    Status FlushSegments(const std::vector<uint32_t>& segments, uint64_t flushed_generation);
+
+    void ReuseKilledSlots();
+
+    // Blocks a Set that found the log full until a flush has finished.
+    // Returns whether the log has room again.
+    bool WaitForLogSpace();
+
+    const Options options_;
+    Statistics* stats_;
+    Tracer* tracer_;
+    PmemFile* file_;
+    PmemLog* log_;
+    // Null when the file has no slot store.
+    SlotStore* slots_;
+    HashIndex index_;
+    Arena inline_arena_;
+
+    // Reads of log records that a flush must wait out before it reuses
+    // their segments.
+    ReadEpochs epochs_;
+
+    // Sequence number of the last write. Numbers live in DRAM only, as
+    // snapshots do not outlast the process.
+    std::atomic<uint64_t> last_sequence_;
+    // Writes between taking a sequence number and publishing the value,
+    // which a new snapshot waits out so that it sees all the writes it
+    // covers.
+    ReadEpochs writes_;
+    std::mutex snapshots_mutex_;
+    SnapshotList snapshots_;
+    // Sequence number of the newest snapshot, 0 if there is none, or
+    // kSnapshotPending while one is being taken, when writes must save
+    // every value they replace.
+    std::atomic<uint64_t> newest_snapshot_;
+    // Sequence number of the oldest snapshot, 0 if there is none. No
+    // snapshot older than it is ever taken again.
+    std::atomic<uint64_t> oldest_snapshot_;
+    OverwrittenValues overwritten_;
+
+    TableCache* table_cache_;
+    VersionSet* versions_;
+    // Null when background work is off.
+    ThreadPool* background_;
+    RateLimiter* rate_limiter_;
+    // A flush is due once fewer segments than this are free.
+    size_t flush_trigger_;
+
+    std::mutex bg_mutex_;
+    std::condition_variable bg_cv_;
+    std::atomic<bool> flush_scheduled_;
+    bool compaction_scheduled_;
+    std::atomic<bool> shutting_down_;
+    uint64_t flushes_completed_;
+    Status last_flush_status_;
+    // Segments of a flush that failed, retried by the next flush.
+    std::vector<uint32_t> unflushed_;
 };
 
 #endif
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "Comparator.hpp"
+#include "HugePages.hpp"
+
+class Cache;
+
+struct Options {
+    // Bytes of persistent memory mapped for the value stores (74GB by
+    // default, the round 1 budget).
+    size_t pmem_size = 79456894976UL;
+
+    // Map a file on a DAX filesystem with MAP_SYNC, so that writes are
+    // durable once flushed from the cache. libpmem decides this itself.
+    bool pmem_map_sync = true;
+
+    // Fault in the whole file at open with this many threads, so that the
+    // first Sets do not take the faults. On DAX a fault is also where the
+    // filesystem allocates the block; on any other filesystem this dirties
+    // the whole file in the page cache. 0 faults pages in on first use.
+    int pmem_prefault_threads = 0;
+
+    // Records whose key and value are exactly this large go to a dense
+    // store of fixed-size slots that takes fixed_store_fraction of
+    // pmem_size; all others go to the log. A value size of 0 gives the log
+    // the whole file. The layout is fixed when the file is created.
+    size_t fixed_key_size = 16;
+    size_t fixed_value_size = 80;
+    double fixed_store_fraction = 0.5;
+
+    // The log is cut into segments of this many bytes, the unit in which
+    // its space is flushed to sorted tables and reused. Fixed when the file
+    // is created; 0 gives each pool one segment.
+    size_t log_segment_size = 64UL << 20;
+
+    // The log and the slot store are each split into this many pools. Each
+    // writer thread appends to its own pool, so appends never contend as
+    // long as there are no more writer threads than pools.
+    size_t pool_count = 16;
+
+    // Number of slots of the DRAM hash index, rounded up to whole buckets
+    // of 12 slots. The defaults of the DRAM structures fit the 4GB round 1
+    // budget together: 3GB of index, its 16MB of stripes, 256MB of inline
+    // records and the sort of one max_flush_batch_size flush batch, with
+    // the rest left for tables and threads.
+    size_t index_slots = 12UL * (48UL << 20);
+
+    // Values no larger than this are additionally kept inline in a DRAM
+    // record next to their key, so a Get never touches pmem for them.
+    // 0 disables inlining.
+    size_t inline_value_threshold = 32;
+
+    // Upper bound on the DRAM used by inline records. Once exhausted, new
+    // keys fall back to being served from pmem.
+    size_t inline_arena_size = 256UL << 20;
+
+    // Pages under the index and the inline arena. Huge pages spare random
+    // probes most TLB misses, but a sparsely filled index then occupies
+    // whole 2MB pages.
+    PageOptions index_pages;
+
+    // Fault in the index and the inline arena at open with this many
+    // threads, so that the first Sets do not take the faults. It commits
+    // all of their memory up front. 0 faults pages in on first use.
+    int index_prefault_threads = 0;
+
+    // Lookups MultiGet keeps in flight at once. Each costs a DRAM miss on
+    // the index and then a miss on the record; a group this deep hides
+    // both behind each other. At most 64.
+    size_t multiget_depth = 16;
+
+    // Split the engine into this many shards that share nothing (see
+    // ShardedEngine) and route keys to them by hash. pmem_size,
+    // index_slots, inline_arena_size, background_threads and
+    // max_log_file_size are divided among them. Fixed when the engine is
+    // created; 1 runs one engine on the named file itself.
+    size_t shards = 1;
+
+    // Count gets, sets, log appends and index probes. Costs a few
+    // uncontended adds per operation.
+    bool statistics = true;
+
+    // With statistics on, time one in this many Gets and Sets of each
+    // thread stage by stage with rdtsc; the summary goes into the dumps.
+    // 0 disables tracing.
+    uint32_t trace_sample_period = 1024;
+
+    // Where the counters are dumped, every stats_dump_period_sec seconds
+    // (0 disables the periodic dumps) and once more on close. Dumps stop
+    // before the file would grow past max_log_file_size; the contest caps
+    // the log at 5MB.
+    FILE* info_log = nullptr;
+    unsigned stats_dump_period_sec = 10;
+    size_t max_log_file_size = 5UL << 20;
+    // Put into the dumped lines, to tell apart engines that share
+    // info_log, such as the shards of one engine.
+    std::string info_log_label;
+
+    // Sorted tables. Keys are ordered by `comparator`; data blocks are cut
+    // once they reach about block_size bytes, and every
+    // block_restart_interval-th key in a block is stored in full.
+    const Comparator* comparator = BytewiseComparator();
+    size_t block_size = 4096;
+    int block_restart_interval = 16;
+
+    // Bits per key of each table's Bloom filter, which Gets consult before
+    // reading the table's index. 10 gives about 1% false positives; 0
+    // builds no filters.
+    int bloom_bits_per_key = 10;
+
+    // How table files are read for Gets (see FileOptions): mapped, so that
+    // blocks are used in place, and optionally faulted in when opened.
+    bool use_mmap_reads = true;
+    bool populate_table_files = false;
+
+    // Check the CRC of mapped data blocks on every read. Blocks copied into
+    // DRAM, and the index and filter blocks, are always checked.
+    bool verify_checksums = false;
+
+    // Cache of data blocks read from sorted tables, keyed by table file
+    // number and block offset and charged by block size (see
+    // NewLRUCache). Owned by the caller; nullptr caches nothing. Blocks
+    // handed out by the file without a copy are never cached, so with
+    // use_mmap_reads the cache only holds blocks of files that could not
+    // be mapped.
+    Cache* block_cache = nullptr;
+
+    // Directory the log is flushed to as sorted tables; empty means the
+    // pmem file's name followed by ".tables". It may be on pmem or an SSD.
+    std::string table_path;
+
+    // Threads that flush the log and compact tables in the background. 0
+    // turns both off; Sets then fail once the log is full.
+    int background_threads = 2;
+
+    // A flush starts once fewer than this fraction of the log's segments
+    // are free. It moves the live records of every segment written so far
+    // into level 0 tables and frees the segments.
+    double flush_free_fraction = 0.25;
+
+    // A flush sorts the records of at most this many bytes of segments at
+    // a time in DRAM, in up to three times as much memory, and writes
+    // each such batch to its own level 0 tables.
+    size_t max_flush_batch_size = 128UL << 20;
+
+    // Leveled compaction: level 0 is merged into level 1 once it has
+    // level0_compaction_trigger tables, and level n >= 1 into level n + 1
+    // once it holds more than max_bytes_for_level_base times
+    // max_bytes_for_level_multiplier^(n-1) bytes. Outputs are cut at
+    // target_file_size bytes.
+    int level0_compaction_trigger = 4;
+    uint64_t max_bytes_for_level_base = 256UL << 20;
+    int max_bytes_for_level_multiplier = 10;
+    size_t target_file_size = 64UL << 20;
+
+    // Caps the bytes per second compactions write, so that they leave
+    // bandwidth to Gets; 0 means no cap. Flushes are never capped, as
+    // writers may be waiting on them.
+    size_t compaction_bytes_per_sec = 0;
+
+    // Tables the table cache keeps open.
+    int max_open_files = 1000;
+};
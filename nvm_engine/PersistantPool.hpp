@@ -11,29 +11,8 @@
 #include <snappy.h>
 #include <libpmem.h>
 #include <libpmemobj.h>
-struct KVSHdr {
-    unsigned char encoding;
-};
-
-struct KVSRef {
-    //指定插入值的编码
-    struct KVSHdr hdr;
-
-    unsigned int size;
-    unsigned int pool_index;
-
-    //pmem池中的偏移
-    size_t off_in_pool;
-};
-
-enum ValueEncoding {
-    kEncodingRawCompressed = 0x0,
-    kEncodingRawUncompressed = 0x01,
-    kEncodingPtrCompressed = 0x02,
-    kEncodingPtrUncompressed = 0x03,
-    kEncodingUnknown
-};
 
+#include "ValueRef.hpp"
 
 struct Pool {
     PMEMobjpool* pool;
@@ -65,6 +44,11 @@ static size_t pool_count_;
 static std::atomic<size_t> next_pool_index_(0);
 
 static size_t kvs_value_thres_ = 0;
+// Actions handed to one pmemobj_publish call. Every action takes a redo log
+// entry and the lane's built-in redo log only fits a few dozen of them;
+// going past that makes libpmemobj allocate an extension log on pmem, which
+// costs far more than the extra publish call.
+static size_t kvs_publish_batch_ = 32;
 static bool compress_value_ = false;
 static size_t dcpmm_avail_size_min_ = 0;
 
@@ -166,13 +150,12 @@ ValueEncoding KVSGetEncoding(const void *ptr) {
 }
 
 inline static bool ReservePmem(size_t size, unsigned int* p_pool_index,
-                                PMEMoid* p_oid, pobj_action** p_pact) {
+                                PMEMoid* p_oid, PobjAction* pact) {
 
     size_t pool_index = (next_pool_index_++) % pool_count_;
     size_t retry_loop = pool_count_;
 
     PMEMoid oid;
-    auto* pact = new PobjAction;
 
     for (size_t i = 0; i < retry_loop; ++i) {
         auto* pool = pools_[pool_index].pool;
@@ -181,7 +164,6 @@ inline static bool ReservePmem(size_t size, unsigned int* p_pool_index,
             *p_pool_index = pool_index;
             *p_oid = oid;
             pact->pool_index = pool_index;
-            *p_pact = pact;
             return true;
         }
         pool_index++;
@@ -190,11 +172,10 @@ inline static bool ReservePmem(size_t size, unsigned int* p_pool_index,
         }
     }
     dcpmm_is_avail_ = false;
-    delete pact;
     return false;
 }
 
-inline static bool KVSEncodeValue(const Slice& value, bool compress, KVSRef* ref, pobj_action** p_pact) {
+inline static bool KVSEncodeValue(const Slice& value, bool compress, KVSRef* ref, PobjAction* pact) {
     assert(pools_);
     if (!dcpmm_is_avail_) {
         return false;
@@ -203,7 +184,7 @@ inline static bool KVSEncodeValue(const Slice& value, bool compress, KVSRef* ref
     if (!compress) {
         PMEMoid oid;
         if (!ReservePmem(sizeof(struct KVSHdr) + value.size(), &(ref->pool_index),
-                        &oid, p_pact)) {
+                        &oid, pact)) {
         return false;
         }
         void *buf = pmemobj_direct(oid);
@@ -221,7 +202,7 @@ inline static bool KVSEncodeValue(const Slice& value, bool compress, KVSRef* ref
         snappy::RawCompress(value.data(), value.size(), compressed, &outsize);
         PMEMoid oid;
         if (!ReservePmem(sizeof(struct KVSHdr) + outsize, &(ref->pool_index),
-                        &oid, p_pact)) {
+                        &oid, pact)) {
             delete[] compressed;
             return false;
         }
@@ -357,29 +338,47 @@ bool KVSGetCompressKnob() {
     return compress_value_;
 }
 
-int KVSPublish(struct pobj_action** pact_array, size_t actvcnt) {
+void KVSSetPublishBatch(size_t batch) {
+    assert(batch > 0);
+    kvs_publish_batch_ = batch;
+}
+
+size_t KVSGetPublishBatch() {
+    return kvs_publish_batch_;
+}
+
+// Groups the reservations made by KVSEncodeValue by pool and publishes
+// them. The per-pool staging vectors belong to the calling thread and keep
+// their capacity across calls. Each one is sized to the publish batch when
+// its pool is first staged to, or after the batch grows, so once warmed up
+// a publish does not touch the heap.
+int KVSPublish(const PobjAction* pacts, size_t actvcnt) {
     assert(pools_);
-    auto* pacts_of_pools = new std::vector<struct pobj_action>[pool_count_];
+    static thread_local std::vector<std::vector<struct pobj_action>> staged;
+    if (staged.size() < pool_count_) {
+        staged.resize(pool_count_);
+    }
+
     for (size_t i = 0; i < actvcnt; i++) {
-        auto* pact = (struct PobjAction*)pact_array[i];
-        assert(pact->pool_index < pool_count_);
-        pacts_of_pools[pact->pool_index].push_back(*((struct pobj_action*)pact));
-        delete pact;
+        unsigned int pool_index = pacts[i].pool_index;
+        assert(pool_index < pool_count_);
+        auto& pending = staged[pool_index];
+        if (pending.capacity() < kvs_publish_batch_) {
+            pending.reserve(kvs_publish_batch_);
+        }
+        pending.push_back(pacts[i]);
+        if (pending.size() >= kvs_publish_batch_) {
+            pmemobj_publish(pools_[pool_index].pool, pending.data(), pending.size());
+            pending.clear();
+        }
     }
     for (size_t i = 0; i < pool_count_; i++) {
-        auto* pool = pools_[i].pool;
-        auto& pacts = pacts_of_pools[i];
-        auto* data = pacts.data();
-        size_t count = pacts.size();
-        size_t index = 0;
-        while(index < count) {
-        auto n = std::min(count - index, 32UL);
-        pmemobj_publish(pool, data + index, n);
-        index += n;
+        auto& pending = staged[i];
+        if (!pending.empty()) {
+            pmemobj_publish(pools_[i].pool, pending.data(), pending.size());
+            pending.clear();
         }
-        assert(index == count);
     }
-    delete[] pacts_of_pools;
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#ifdef USE_LIBPMEM
+#include <libpmem.h>
+#endif
+
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+
+#include "include/db.hpp"
+#include "HugePages.hpp"
+
+#ifndef MAP_SHARED_VALIDATE
+#define MAP_SHARED_VALIDATE 0x03
+#endif
+#ifndef MAP_SYNC
+#define MAP_SYNC 0x80000
+#endif
+
+// A pmem file mapped into memory as a whole. The stores built on it are
+// handed regions of the mapping and persist their writes through it.
+// Without libpmem the mapping is 2MB aligned, so that a file on a DAX
+// filesystem gets PMD mappings, and asks for MAP_SYNC if `map_sync`. A DAX
+// file mapped so is pmem whose writes are durable once flushed from the
+// cache; any other file is mapped MAP_SHARED, so that data survives a
+// process crash through the page cache. Lines are written back with clwb,
+// which leaves them cached, where the CPU has it, else with clflushopt,
+// else with clflush.
+class PmemFile {
+public:
+    static Status Open(const std::string& path, size_t size, bool map_sync,
+                       PmemFile** fileptr) {
+        PmemFile* file = new PmemFile();
+#ifdef USE_LIBPMEM
+        file->base_ = (char*)pmem_map_file(path.c_str(), size, PMEM_FILE_CREATE, 0666,
+                                           &file->mapped_len_, &file->is_pmem_);
+        if (file->base_ == nullptr) {
+            delete file;
+            return IOError;
+        }
+#else
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+        if (fd < 0) {
+            delete file;
+            return IOError;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, size) != 0)) {
+            close(fd);
+            delete file;
+            return IOError;
+        }
+        void* base = MapAligned(size, kPmdSize);
+        if (base != nullptr && map_sync) {
+            // Refused up front by files not on DAX.
+            file->is_pmem_ = mmap(base, size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED_VALIDATE | MAP_SYNC | MAP_FIXED, fd, 0) != MAP_FAILED;
+        }
+        if (base != nullptr && !file->is_pmem_ &&
+            mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            munmap(base, size);
+            base = nullptr;
+        }
+        close(fd);
+        if (base == nullptr) {
+            delete file;
+            return IOError;
+        }
+        file->base_ = (char*)base;
+        file->mapped_len_ = size;
+        file->flush_ = ProbeFlush();
+#endif
+        *fileptr = file;
+        return Ok;
+    }
+
+    ~PmemFile() {
+        if (base_ != nullptr) {
+#ifdef USE_LIBPMEM
+            pmem_unmap(base_, mapped_len_);
+#else
+            munmap(base_, mapped_len_);
+#endif
+        }
+    }
+
+    char* base() const {
+        return base_;
+    }
+
+    size_t size() const {
+        return mapped_len_;
+    }
+
+    void Persist(const void* addr, size_t len) const {
+#ifdef USE_LIBPMEM
+        if (is_pmem_) {
+            pmem_persist(addr, len);
+        } else {
+            pmem_msync(addr, len);
+        }
+#else
+        // Otherwise the file lives in the page cache, which already
+        // survives a process crash.
+        if (is_pmem_) {
+            uintptr_t line = (uintptr_t)addr & ~(uintptr_t)(kCacheLineSize - 1);
+            uintptr_t end = (uintptr_t)addr + len;
+            switch (flush_) {
+            case kFlushClwb:
+                for (; line < end; line += kCacheLineSize) {
+                    Clwb((const void*)line);
+                }
+                break;
+            case kFlushClflushopt:
+                for (; line < end; line += kCacheLineSize) {
+                    Clflushopt((const void*)line);
+                }
+                break;
+            default:
+                for (; line < end; line += kCacheLineSize) {
+                    _mm_clflush((const void*)line);
+                }
+                break;
+            }
+            _mm_sfence();
+        }
+#endif
+    }
+
+private:
+    static const size_t kPmdSize = 2UL << 20;
+    static const size_t kCacheLineSize = 64;
+
+    enum Flush {
+        kFlushClflush,
+        kFlushClflushopt,
+        kFlushClwb,
+    };
+
+    // The best write-back the CPU has, from cpuid leaf 7.
+    static Flush ProbeFlush() {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            return kFlushClflush;
+        }
+        if (ebx & (1u << 24)) {
+            return kFlushClwb;
+        }
+        if (ebx & (1u << 23)) {
+            return kFlushClflushopt;
+        }
+        return kFlushClflush;
+    }
+
+    // Spelled out in bytes, as the build does not enable -mclwb or
+    // -mclflushopt: clwb is xsaveopt with a 0x66 prefix, clflushopt is
+    // clflush with one.
+    static void Clwb(const void* line) {
+        asm volatile(".byte 0x66; xsaveopt %0" : "+m"(*(volatile char*)line));
+    }
+
+    static void Clflushopt(const void* line) {
+        asm volatile(".byte 0x66; clflush %0" : "+m"(*(volatile char*)line));
+    }
+
+    PmemFile() : base_(nullptr), mapped_len_(0), is_pmem_(0), flush_(kFlushClflush) {}
+
+    char* base_;
+    size_t mapped_len_;
+    int is_pmem_;
+    Flush flush_;
+
+    PmemFile(const PmemFile&);
+    void operator=(const PmemFile&);
+};
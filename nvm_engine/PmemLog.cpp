@@ -0,0 +1,311 @@
+#include "PmemLog.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "Hash.hpp"
+
+static const uint64_t kChecksumSeed = 0x6c6f67636b73756dULL;
+static const uint64_t kSegmentMagic = 0x746e656d6765736cULL;
+// Marks a segment whose records were flushed, as opposed to one never used.
+static const uint64_t kRetiredMagic = 0x646572697465726cULL;
+
+static std::atomic<size_t> next_pool_index_(0);
+
+Status PmemLog::Open(PmemFile* file, size_t offset, size_t size, size_t pool_count,
+                     size_t segment_size, PmemLog** logptr, Statistics* statistics) {
+    if (size > kMaxLocationSpace || offset % kLocationUnit != 0 || offset + size > file->size() ||
+        pool_count == 0) {
+        return IOError;
+    }
+    if (segment_size == 0 || segment_size > size / pool_count) {
+        segment_size = size / pool_count;
+    }
+    segment_size &= ~(kLocationUnit - 1);
+    if (segment_size < 2 * kLocationUnit) {
+        return IOError;
+    }
+
+    PmemLog* log = new PmemLog();
+    log->file_ = file;
+    log->base_ = file->base() + offset;
+    log->segment_size_ = segment_size;
+    log->segment_count_ = size / segment_size;
+
+    void* mem = nullptr;
+    if (posix_memalign(&mem, alignof(Pool), pool_count * sizeof(Pool)) != 0) {
+        delete log;
+        return OutOfMemory;
+    }
+    log->pools_ = static_cast<Pool*>(mem);
+    log->pool_count_ = pool_count;
+    log->statistics_ = statistics;
+    for (size_t i = 0; i < pool_count; ++i) {
+        Pool* pool = new (&log->pools_[i]) Pool;
+        pool->segment = kNoSegment;
+        pool->tail = 0;
+        pool->busy = false;
+    }
+
+    log->generations_.assign(log->segment_count_, 0);
+    log->tails_.assign(log->segment_count_, 0);
+    for (size_t i = 0; i < log->segment_count_; ++i) {
+        log->free_.insert(log->free_.end(), (uint32_t)i);
+    }
+    log->free_count_ = log->free_.size();
+
+    *logptr = log;
+    return Ok;
+}
+
+PmemLog::~PmemLog() {
+    if (pools_ != nullptr) {
+        for (size_t i = 0; i < pool_count_; ++i) {
+            pools_[i].~Pool();
+        }
+        free(pools_);
+    }
+}
+
+uint32_t PmemLog::Checksum(uint32_t version, const Slice& key, const Slice& value,
+                           uint64_t generation) {
+    uint32_t fields[3] = { version, (uint32_t)key.size(), (uint32_t)value.size() };
+    uint64_t h = Hash64(reinterpret_cast<const char*>(fields), sizeof(fields),
+                        kChecksumSeed ^ generation);
+    h = Hash64(key.data(), key.size(), h);
+    h = Hash64(value.data(), value.size(), h);
+    return (uint32_t)h;
+}
+
+uint32_t PmemLog::RecordChecksum(const LogRecord& header, const Slice& key, const Slice& value,
+                                 uint64_t generation) {
+    uint32_t fields[5] = { header.version, header.key_size, header.type, header.value_size,
+                           header.expire };
+    uint64_t h = Hash64(reinterpret_cast<const char*>(fields), sizeof(fields),
+                        kChecksumSeed ^ generation);
+    h = Hash64(key.data(), key.size(), h);
+    h = Hash64(value.data(), value.size(), h);
+    return (uint32_t)h;
+}
+
+size_t PmemLog::RecordSize(size_t key_size, size_t value_size) {
+    return (sizeof(LogRecord) + key_size + value_size + kLocationUnit - 1) & ~(kLocationUnit - 1);
+}
+
+void PmemLog::SealLocked(Pool* pool, bool empty) {
+    if (pool->segment == kNoSegment || (pool->tail <= kLocationUnit && !empty)) {
+        return;
+    }
+    std::lock_guard<std::mutex> l(mutex_);
+    tails_[pool->segment] = pool->tail;
+    sealed_.push_back(pool->segment);
+    sealed_count_.store(sealed_.size(), std::memory_order_relaxed);
+    pool->segment = kNoSegment;
+    pool->tail = 0;
+}
+
+bool PmemLog::NextSegmentLocked(Pool* pool) {
+    SealLocked(pool);
+    if (pool->segment != kNoSegment) {
+        // The current segment is still empty; nothing fits in it.
+        return false;
+    }
+    uint32_t segment;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> l(mutex_);
+        if (free_.empty()) {
+            return false;
+        }
+        segment = *free_.begin();
+        free_.erase(free_.begin());
+        free_count_.store(free_.size(), std::memory_order_relaxed);
+        generation = next_generation_++;
+        generations_[segment] = generation;
+    }
+    SegmentHeader* header = Header(segment);
+    header->generation = generation;
+    file_->Persist(&header->generation, sizeof(header->generation));
+    header->magic = kSegmentMagic;
+    file_->Persist(&header->magic, sizeof(header->magic));
+    pool->segment = segment;
+    pool->tail = kLocationUnit;
+    return true;
+}
+
+bool PmemLog::TryAppend(Pool* pool, const Slice& key, const Slice& value, uint32_t version,
+                        RecordType type, uint32_t expire, KVSRef* ref) {
+    size_t record_size = RecordSize(key.size(), value.size());
+    if (!Fits(key, value)) {
+        return false;
+    }
+
+    LockPool(pool);
+    if (pool->segment == kNoSegment || pool->tail + record_size > segment_size_) {
+        if (!NextSegmentLocked(pool)) {
+            UnlockPool(pool);
+            return false;
+        }
+    }
+    size_t off = pool->tail;
+    pool->tail += record_size;
+
+    LogRecord header;
+    header.version = version;
+    header.key_size = key.size();
+    header.type = type;
+    header.value_size = value.size();
+    header.expire = expire;
+    header.checksum = RecordChecksum(header, key, value, generations_[pool->segment]);
+
+    char* dst = base_ + pool->segment * segment_size_ + off;
+    memcpy(dst, &header, sizeof(header));
+    memcpy(dst + sizeof(header), key.data(), key.size());
+    memcpy(dst + sizeof(header) + key.size(), value.data(), value.size());
+    Tracer::Mark(TRACE_SET_COPY);
+    file_->Persist(dst, record_size);
+    Tracer::Mark(TRACE_SET_PERSIST);
+
+    ref->hdr.encoding = kEncodingPtrUncompressed;
+    ref->size = value.size();
+    ref->pool_index = pool->segment;
+    ref->off_in_pool = off;
+    UnlockPool(pool);
+    RecordTick(statistics_, LOG_APPENDS);
+    RecordTick(statistics_, LOG_BYTES_PERSISTED, record_size);
+    return true;
+}
+
+bool PmemLog::Append(const Slice& key, const Slice& value, uint32_t version, RecordType type,
+                     uint32_t expire, KVSRef* ref) {
+    static thread_local size_t thread_pool = next_pool_index_++;
+
+    size_t pool_index = thread_pool % pool_count_;
+    for (size_t i = 0; i < pool_count_; ++i) {
+        if (TryAppend(&pools_[pool_index], key, value, version, type, expire, ref)) {
+            return true;
+        }
+        RecordTick(statistics_, LOG_POOL_RETRIES);
+        if (++pool_index >= pool_count_) {
+            pool_index = 0;
+        }
+    }
+    return false;
+}
+
+size_t PmemLog::Scan(uint32_t segment,
+                     const std::function<void(uint32_t location, const LogRecord* record)>& visit) const {
+    const char* start = base_ + segment * segment_size_;
+    uint64_t generation = reinterpret_cast<const SegmentHeader*>(start)->generation;
+    size_t off = kLocationUnit;
+    while (off + sizeof(LogRecord) <= segment_size_) {
+        const LogRecord* record = reinterpret_cast<const LogRecord*>(start + off);
+        size_t record_size = RecordSize(record->key_size, record->value_size);
+        if (record->key_size > segment_size_ || record->value_size > segment_size_ ||
+            off + record_size > segment_size_) {
+            break;
+        }
+        Slice key(const_cast<char*>(record->key()), record->key_size);
+        Slice value(const_cast<char*>(record->value()), record->value_size);
+        if (record->checksum != RecordChecksum(*record, key, value, generation)) {
+            break;
+        }
+        if (visit) {
+            visit((uint32_t)((segment * segment_size_ + off) >> kLocationShift), record);
+        }
+        off += record_size;
+    }
+    return off;
+}
+
+void PmemLog::SetFlushedGeneration(uint64_t generation) {
+    flushed_generation_ = generation;
+    next_generation_ = std::max(next_generation_, generation + 1);
+}
+
+void PmemLog::Recover(const std::function<void(uint32_t location, const LogRecord* record)>& visit) {
+    std::vector<std::pair<uint64_t, uint32_t>> valid;
+    for (size_t i = 0; i < segment_count_; ++i) {
+        const SegmentHeader* header = Header((uint32_t)i);
+        // A flushed segment may not have been retired yet.
+        if (header->magic == kSegmentMagic && header->generation > flushed_generation_) {
+            valid.push_back(std::make_pair(header->generation, (uint32_t)i));
+        } else if (header->magic != kSegmentMagic && header->magic != kRetiredMagic) {
+            break;
+        }
+    }
+    std::sort(valid.begin(), valid.end());
+
+    std::vector<bool> used(segment_count_, false);
+    for (size_t i = 0; i < valid.size(); ++i) {
+        uint32_t segment = valid[i].second;
+        used[segment] = true;
+        generations_[segment] = valid[i].first;
+        tails_[segment] = Scan(segment, visit);
+        next_generation_ = std::max(next_generation_, valid[i].first + 1);
+    }
+
+    // The newest segments go back to the pools, as they were most likely
+    // the ones being appended to.
+    size_t pool = 0;
+    sealed_.clear();
+    for (size_t i = valid.size(); i-- > 0;) {
+        uint32_t segment = valid[i].second;
+        if (pool < pool_count_ && tails_[segment] + kLocationUnit < segment_size_) {
+            pools_[pool].segment = segment;
+            pools_[pool].tail = tails_[segment];
+            ++pool;
+        } else {
+            sealed_.push_back(segment);
+        }
+    }
+    std::reverse(sealed_.begin(), sealed_.end());
+
+    free_.clear();
+    for (size_t i = 0; i < segment_count_; ++i) {
+        if (!used[i]) {
+            free_.insert(free_.end(), (uint32_t)i);
+        }
+    }
+    free_count_ = free_.size();
+    sealed_count_ = sealed_.size();
+}
+
+void PmemLog::Freeze(std::vector<uint32_t>* batch) {
+    // A segment left empty by recovery is frozen too, as its generation
+    // may be older than that of a segment in the batch.
+    for (size_t i = 0; i < pool_count_; ++i) {
+        LockPool(&pools_[i]);
+        SealLocked(&pools_[i], true);
+        UnlockPool(&pools_[i]);
+    }
+    std::lock_guard<std::mutex> l(mutex_);
+    batch->insert(batch->end(), sealed_.begin(), sealed_.end());
+    sealed_.clear();
+    sealed_count_ = 0;
+}
+
+void PmemLog::ForEachRecord(uint32_t segment,
+                            const std::function<void(uint32_t location, const LogRecord* record)>& visit) const {
+    Scan(segment, visit);
+}
+
+size_t PmemLog::SegmentUsage(uint32_t segment) const {
+    return tails_[segment] - kLocationUnit;
+}
+
+void PmemLog::Retire(const std::vector<uint32_t>& batch) {
+    for (size_t i = 0; i < batch.size(); ++i) {
+        SegmentHeader* header = Header(batch[i]);
+        header->magic = kRetiredMagic;
+        file_->Persist(&header->magic, sizeof(header->magic));
+    }
+}
+
+void PmemLog::Release(const std::vector<uint32_t>& batch) {
+    std::lock_guard<std::mutex> l(mutex_);
+    free_.insert(batch.begin(), batch.end());
+    free_count_.store(free_.size(), std::memory_order_relaxed);
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "include/db.hpp"
+#include "PmemFile.hpp"
+#include "Statistics.hpp"
+#include "ValueRef.hpp"
+
+// On-media layout of one log entry. The key and the value follow the header
+// back to back; the whole record is padded to kLocationUnit bytes so the
+// index can address it with a 32-bit location.
+struct LogRecord {
+    uint32_t checksum;
+    uint32_t version;
+    uint32_t key_size : 24;
+    // A RecordType; a deletion has no value.
+    uint32_t type : 8;
+    uint32_t value_size;
+    // When the value expires, in seconds since the epoch; 0 if never.
+    uint32_t expire;
+
+    const char* key() const {
+        return reinterpret_cast<const char*>(this + 1);
+    }
+
+    const char* value() const {
+        return key() + key_size;
+    }
+};
+
+// An append-only value log on a region of a pmem file. The region is cut
+// into segments, each starting with a header that carries the generation it
+// was handed out in. Every writer thread is bound to one pool and appends to
+// the pool's current segment under that pool's lock, so a crash can only
+// tear the last record of each segment and recovery stops at the first
+// record whose checksum fails. Record checksums are seeded with the
+// generation, so records a segment held before it was last reused never
+// pass for current ones.
+//
+// Full segments are sealed and wait to be frozen into a batch, whose live
+// records the engine moves to sorted tables before it releases the batch's
+// segments for reuse.
+class PmemLog {
+public:
+    // Lays the log out over `size` bytes of `file` from `offset`, which
+    // must be a multiple of kLocationUnit, in segments of `segment_size`
+    // bytes. A zero segment size gives every pool one segment. Appends are
+    // counted in `statistics` when it is not null.
+    static Status Open(PmemFile* file, size_t offset, size_t size, size_t pool_count,
+                       size_t segment_size, PmemLog** logptr, Statistics* statistics = nullptr);
+    ~PmemLog();
+
+    // Appends and persists a record in the calling thread's pool, falling
+    // back to the other pools when it is full. Returns false when the log
+    // has no free segment left.
+    bool Append(const Slice& key, const Slice& value, uint32_t version, RecordType type,
+                uint32_t expire, KVSRef* ref);
+
+    // Whether a record of this key and value fits into a segment at all.
+    bool Fits(const Slice& key, const Slice& value) const {
+        return RecordSize(key.size(), value.size()) + kLocationUnit <= segment_size_;
+    }
+
+    // Location of a record in kLocationUnit units from the start of the
+    // region. Segment headers take the first unit of each segment, so no
+    // record is at 0.
+    uint32_t Location(const KVSRef& ref) const {
+        return (uint32_t)((ref.pool_index * segment_size_ + ref.off_in_pool) >> kLocationShift);
+    }
+
+    const LogRecord* Record(uint32_t location) const {
+        return reinterpret_cast<const LogRecord*>(base_ + ((size_t)location << kLocationShift));
+    }
+
+    // Segments of generations up to `generation` have been flushed to
+    // tables: Recover skips them, and segments handed out from now on are
+    // numbered after them. Call it before Recover and before the first
+    // Append.
+    void SetFlushedGeneration(uint64_t generation);
+
+    // Replays the valid records of every segment not yet flushed, oldest
+    // segment first. Segments with room left become the pools' current
+    // segments again; the others are sealed. Not thread-safe; call it
+    // before the log is shared.
+    void Recover(const std::function<void(uint32_t location, const LogRecord* record)>& visit);
+
+    // Seals the pools' current segments and moves every sealed segment into
+    // `*batch`, in the order they were sealed. Every segment handed out and
+    // every record appended before the call is then in the batch, and
+    // every later one outside it.
+    void Freeze(std::vector<uint32_t>* batch);
+
+    // Generation a segment in a batch was handed out in.
+    uint64_t Generation(uint32_t segment) const {
+        return generations_[segment];
+    }
+
+    // Visits the valid records of a sealed segment in append order.
+    void ForEachRecord(uint32_t segment,
+                       const std::function<void(uint32_t location, const LogRecord* record)>& visit) const;
+
+    // Bytes of a sealed segment that hold records.
+    size_t SegmentUsage(uint32_t segment) const;
+
+    // Invalidates the headers of a flushed batch, so that recovery skips
+    // its segments. Their records stay readable until Release.
+    void Retire(const std::vector<uint32_t>& batch);
+
+    // Makes the segments of a retired batch free for reuse. Records there
+    // must no longer be referenced.
+    void Release(const std::vector<uint32_t>& batch);
+
+    size_t FreeSegments() const {
+        return free_count_.load(std::memory_order_relaxed);
+    }
+
+    size_t SealedSegments() const {
+        return sealed_count_.load(std::memory_order_relaxed);
+    }
+
+    size_t segment_count() const {
+        return segment_count_;
+    }
+
+    size_t segment_size() const {
+        return segment_size_;
+    }
+
+    size_t pool_count() const {
+        return pool_count_;
+    }
+
+    // Checksum of a version, key and value, seeded with `generation`. The
+    // slot store's records have no other fields.
+    static uint32_t Checksum(uint32_t version, const Slice& key, const Slice& value,
+                             uint64_t generation = 0);
+
+    // Checksum of a log record's header fields, key and value, seeded with
+    // the generation of the segment it is in.
+    static uint32_t RecordChecksum(const LogRecord& header, const Slice& key, const Slice& value,
+                                   uint64_t generation);
+
+private:
+    static const uint32_t kNoSegment = ~0U;
+
+    struct SegmentHeader {
+        uint64_t magic;
+        uint64_t generation;
+    };
+
+    struct alignas(64) Pool {
+        uint32_t segment;
+        size_t tail;
+        std::atomic<bool> busy;
+    };
+
+    PmemLog() : file_(nullptr), base_(nullptr), segment_size_(0), segment_count_(0),
+                pools_(nullptr), pool_count_(0), next_generation_(1), flushed_generation_(0),
+                free_count_(0),
+                sealed_count_(0), statistics_(nullptr) {}
+
+    static size_t RecordSize(size_t key_size, size_t value_size);
+
+    SegmentHeader* Header(uint32_t segment) const {
+        return reinterpret_cast<SegmentHeader*>(base_ + segment * segment_size_);
+    }
+
+    // Scans a segment and returns the offset just past its last valid
+    // record.
+    size_t Scan(uint32_t segment,
+                const std::function<void(uint32_t location, const LogRecord* record)>& visit) const;
+
+    // Seals the pool's segment if it has records, or even when it is empty
+    // if `empty`. Caller holds the pool.
+    void SealLocked(Pool* pool, bool empty = false);
+    // Gives the pool a fresh segment. Caller holds the pool.
+    bool NextSegmentLocked(Pool* pool);
+
+    bool TryAppend(Pool* pool, const Slice& key, const Slice& value, uint32_t version,
+                   RecordType type, uint32_t expire, KVSRef* ref);
+
+    static void LockPool(Pool* pool) {
+        while (pool->busy.exchange(true, std::memory_order_acquire)) {
+            __builtin_ia32_pause();
+        }
+    }
+
+    static void UnlockPool(Pool* pool) {
+        pool->busy.store(false, std::memory_order_release);
+    }
+
+    PmemFile* file_;
+    char* base_;
+    size_t segment_size_;
+    size_t segment_count_;
+    Pool* pools_;
+    size_t pool_count_;
+
+    // Guards the lists of segments and the generation counter.
+    std::mutex mutex_;
+    uint64_t next_generation_;
+    uint64_t flushed_generation_;
+    std::vector<uint64_t> generations_;
+    // Where each sealed segment's records end.
+    std::vector<size_t> tails_;
+    // Handed out lowest first, so the segments ever used form a prefix of
+    // the log and recovery can stop at the first one never used.
+    std::set<uint32_t> free_;
+    std::vector<uint32_t> sealed_;
+    std::atomic<size_t> free_count_;
+    std::atomic<size_t> sealed_count_;
+
+    Statistics* statistics_;
+
+    PmemLog(const PmemLog&);
+    void operator=(const PmemLog&);
+};
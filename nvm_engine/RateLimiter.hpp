@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "Env.hpp"
+
+// Token bucket shared by the background writers: Request blocks until the
+// bytes fit under the rate. The bucket holds at most a tenth of a second's
+// worth, so an idle period does not turn into a burst.
+class RateLimiter {
+public:
+    explicit RateLimiter(size_t bytes_per_sec)
+        : rate_(bytes_per_sec),
+          available_(0),
+          last_refill_(std::chrono::steady_clock::now()) {}
+
+    void Request(size_t bytes) {
+        std::unique_lock<std::mutex> l(mutex_);
+        Refill();
+        available_ -= (double)bytes;
+        if (available_ < 0) {
+            // Pay the debt by sleeping; other requests queue on the mutex.
+            std::chrono::duration<double> wait(-available_ / rate_);
+            std::this_thread::sleep_for(wait);
+            Refill();
+        }
+    }
+
+private:
+    void Refill() {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - last_refill_;
+        last_refill_ = now;
+        available_ += elapsed.count() * rate_;
+        if (available_ > rate_ / 10) {
+            available_ = rate_ / 10;
+        }
+    }
+
+    const double rate_;
+    std::mutex mutex_;
+    double available_;
+    std::chrono::steady_clock::time_point last_refill_;
+
+    RateLimiter(const RateLimiter&);
+    void operator=(const RateLimiter&);
+};
+
+// Charges every append to `limiter` before passing it on. Owns `base`.
+class RateLimitedFile : public WritableFile {
+public:
+    RateLimitedFile(WritableFile* base, RateLimiter* limiter) : base_(base), limiter_(limiter) {}
+
+    ~RateLimitedFile() override {
+        delete base_;
+    }
+
+    Status Append(const Slice& data) override {
+        limiter_->Request(data.size());
+        return base_->Append(data);
+    }
+
+    Status Flush() override {
+        return base_->Flush();
+    }
+
+    Status Sync() override {
+        return base_->Sync();
+    }
+
+    Status Close() override {
+        return base_->Close();
+    }
+
+private:
+    WritableFile* const base_;
+    RateLimiter* const limiter_;
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Tracks which threads are in the middle of a lock-free read of the log, so
+// that a flush can wait out every read that may still use a location it has
+// unlinked from the index before the location's segment is reused.
+//
+// Each thread gets a cache line with a counter that is odd while the thread
+// reads; only the owner writes it, so entering a read costs a store and a
+// fence. Threads beyond kMaxSlots share the last line and count themselves
+// in and out with atomic adds.
+//
+// A thread finds its line through a small per-thread cache of the objects
+// it used last, and otherwise by looking for the line it claimed, so that a
+// thread that goes back and forth between several objects (an engine has
+// two, a sharded engine two per shard) keeps one line in each.
+class ReadEpochs {
+public:
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> seq;
+        // The thread the line belongs to; set once when it is claimed.
+        std::atomic<uint64_t> owner;
+    };
+
+    ReadEpochs() : id_(NextId()), next_slot_(0) {
+        void* mem = nullptr;
+        if (posix_memalign(&mem, alignof(Slot), kMaxSlots * sizeof(Slot)) != 0) {
+            abort();
+        }
+        slots_ = static_cast<Slot*>(mem);
+        for (size_t i = 0; i < kMaxSlots; ++i) {
+            new (&slots_[i]) Slot;
+            slots_[i].seq.store(0, std::memory_order_relaxed);
+            slots_[i].owner.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~ReadEpochs() {
+        for (size_t i = 0; i < kMaxSlots; ++i) {
+            slots_[i].~Slot();
+        }
+        free(slots_);
+    }
+
+    Slot* Enter() {
+        Slot* slot = Local();
+        if (slot != Shared()) {
+            slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_relaxed);
+        } else {
+            slot->seq.fetch_add(1, std::memory_order_relaxed);
+        }
+        // Orders the store before the index reads that follow; pairs with
+        // the fence in Synchronize.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return slot;
+    }
+
+    void Exit(Slot* slot) {
+        if (slot != Shared()) {
+            slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1,
+                            std::memory_order_release);
+        } else {
+            slot->seq.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    // Returns once every read that entered before the call has exited.
+    // Reads that enter later see the index as it was at the call.
+    void Synchronize() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        size_t used = next_slot_.load(std::memory_order_relaxed);
+        if (used > kMaxSlots - 1) {
+            used = kMaxSlots - 1;
+        }
+        for (size_t i = 0; i < used; ++i) {
+            uint64_t seq = slots_[i].seq.load(std::memory_order_acquire);
+            if (seq & 1) {
+                while (slots_[i].seq.load(std::memory_order_acquire) == seq) {
+                    __builtin_ia32_pause();
+                }
+            }
+        }
+        // The shared line only says how many are inside; wait until that
+        // drops to zero once.
+        while (Shared()->seq.load(std::memory_order_acquire) != 0) {
+            __builtin_ia32_pause();
+        }
+    }
+
+private:
+    static const size_t kMaxSlots = 256;
+
+    static const size_t kCachedObjects = 8;
+
+    // Process-unique, for objects and for threads alike.
+    static uint64_t NextId() {
+        static std::atomic<uint64_t> next_id(1);
+        return next_id++;
+    }
+
+    Slot* Shared() const {
+        return &slots_[kMaxSlots - 1];
+    }
+
+    // Keyed by a process-unique id like Statistics::Local, so an object at
+    // a recycled address is not mistaken for an old one.
+    Slot* Local() {
+        struct Cached {
+            uint64_t id;
+            Slot* slot;
+        };
+        static thread_local Cached cache[kCachedObjects];
+        static thread_local size_t next_victim = 0;
+        for (size_t i = 0; i < kCachedObjects; ++i) {
+            if (cache[i].id == id_) {
+                return cache[i].slot;
+            }
+        }
+        Cached* entry = &cache[next_victim++ % kCachedObjects];
+        entry->id = id_;
+        entry->slot = Claim();
+        return entry->slot;
+    }
+
+    // The line of the calling thread, claimed on its first use of this
+    // object.
+    Slot* Claim() {
+        static thread_local uint64_t thread_id = NextId();
+        size_t used = next_slot_.load(std::memory_order_acquire);
+        for (size_t i = 0; i < used && i < kMaxSlots - 1; ++i) {
+            if (slots_[i].owner.load(std::memory_order_acquire) == thread_id) {
+                return &slots_[i];
+            }
+        }
+        size_t i = next_slot_.fetch_add(1, std::memory_order_relaxed);
+        if (i >= kMaxSlots - 1) {
+            return Shared();
+        }
+        slots_[i].owner.store(thread_id, std::memory_order_release);
+        return &slots_[i];
+    }
+
+    const uint64_t id_;
+    std::atomic<size_t> next_slot_;
+    Slot* slots_;
+
+    ReadEpochs(const ReadEpochs&);
+    void operator=(const ReadEpochs&);
+};
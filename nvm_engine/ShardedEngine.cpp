@@ -0,0 +1,219 @@
+#include "ShardedEngine.hpp"
+
+#include <algorithm>
+
+#include "Coding.hpp"
+#include "Env.hpp"
+#include "FixedKey.hpp"
+#include "Hash.hpp"
+#include "NvmEngine.hpp"
+
+static const uint64_t kShardsMagic = 0x7364726168736d6eULL;
+static const size_t kShardsFileSize = 16;
+// Not the seed the shards hash with, so that the keys of one shard still
+// spread over its whole index.
+static const uint64_t kShardHashSeed = 0x3c6ef372fe94f82bULL;
+
+class ShardedEngine::ShardedSnapshot : public Snapshot {
+public:
+    std::vector<const Snapshot*> shards;
+};
+
+bool ShardedEngine::IsSharded(const std::string& name, const Options& options) {
+    uint64_t size;
+    if (Env::Default()->GetFileSize(name, &size) != Ok || size == 0) {
+        return options.shards > 1;
+    }
+    size_t count;
+    return size == kShardsFileSize && ReadOrCreateCount(name, &count) == Ok;
+}
+
+Status ShardedEngine::ReadOrCreateCount(const std::string& name, size_t* count) {
+    Env* env = Env::Default();
+    uint64_t size;
+    if (env->GetFileSize(name, &size) == Ok && size > 0) {
+        if (size != kShardsFileSize) {
+            return IOError;
+        }
+        FileOptions file_options;
+        file_options.use_mmap = false;
+        RandomAccessFile* file = nullptr;
+        Status s = env->NewRandomAccessFile(name, file_options, &file);
+        if (s != Ok) {
+            return s;
+        }
+        char scratch[kShardsFileSize];
+        Slice input;
+        s = file->Read(0, kShardsFileSize, &input, scratch);
+        delete file;
+        if (s != Ok) {
+            return s;
+        }
+        if (input.size() != kShardsFileSize || DecodeFixed64(input.data()) != kShardsMagic ||
+            DecodeFixed32(input.data() + 12) != Crc32c(input.data(), 12)) {
+            return IOError;
+        }
+        *count = DecodeFixed32(input.data() + 8);
+        return *count > 0 ? Ok : IOError;
+    }
+
+    // Written aside and renamed into place, like the MANIFEST.
+    std::string record;
+    PutFixed64(&record, kShardsMagic);
+    PutFixed32(&record, (uint32_t)*count);
+    PutFixed32(&record, Crc32c(record.data(), record.size()));
+    std::string tmp = name + ".tmp";
+    WritableFile* file = nullptr;
+    Status s = env->NewWritableFile(tmp, &file);
+    if (s != Ok) {
+        return s;
+    }
+    s = file->Append(Slice(&record[0], record.size()));
+    if (s == Ok) {
+        s = file->Sync();
+    }
+    Status close = file->Close();
+    if (s == Ok) {
+        s = close;
+    }
+    delete file;
+    if (s == Ok) {
+        s = env->RenameFile(tmp, name);
+    }
+    if (s != Ok) {
+        env->RemoveFile(tmp);
+    }
+    return s;
+}
+
+Options ShardedEngine::ShardOptions(const Options& options, size_t shards, size_t i) {
+    Options o = options;
+    o.shards = 1;
+    o.pmem_size = options.pmem_size / shards;
+    o.index_slots = (options.index_slots + shards - 1) / shards;
+    o.inline_arena_size = options.inline_arena_size / shards;
+    // Pools stay as many, as every writer thread may write to every shard.
+    if (options.background_threads > 0) {
+        o.background_threads = std::max(1, options.background_threads / (int)shards);
+    }
+    if (!options.table_path.empty()) {
+        o.table_path = options.table_path + "." + std::to_string(i);
+    }
+    // The shards dump into the one info_log, which must stay under the
+    // limit as a whole.
+    o.max_log_file_size = options.max_log_file_size / shards;
+    o.info_log_label = "shard" + std::to_string(i);
+    return o;
+}
+
+Status ShardedEngine::Open(const std::string& name, const Options& options, DB** dbptr) {
+    size_t count = options.shards;
+    Status s = ReadOrCreateCount(name, &count);
+    if (s != Ok) {
+        return s;
+    }
+    ShardedEngine* engine = new ShardedEngine();
+    for (size_t i = 0; i < count; ++i) {
+        DB* shard = nullptr;
+        s = NvmEngine::CreateOrOpen(name + "." + std::to_string(i), &shard,
+                                    ShardOptions(options, count, i));
+        if (s != Ok) {
+            delete engine;
+            return s;
+        }
+        engine->shards_.push_back(shard);
+    }
+    *dbptr = engine;
+    return Ok;
+}
+
+ShardedEngine::~ShardedEngine() {
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        delete shards_[i];
+    }
+}
+
+size_t ShardedEngine::ShardFor(const Slice& key) const {
+    // Multiply-shift instead of a modulo.
+    uint64_t hash = KeyHash(key, kShardHashSeed);
+    return (size_t)(((hash >> 32) * shards_.size()) >> 32);
+}
+
+Status ShardedEngine::Get(const Slice& key, std::string* value) {
+    return shards_[ShardFor(key)]->Get(key, value);
+}
+
+Status ShardedEngine::Set(const Slice& key, const Slice& value) {
+    return shards_[ShardFor(key)]->Set(key, value);
+}
+
+Status ShardedEngine::Set(const Slice& key, const Slice& value, uint32_t ttl) {
+    return shards_[ShardFor(key)]->Set(key, value, ttl);
+}
+
+Status ShardedEngine::Delete(const Slice& key) {
+    return shards_[ShardFor(key)]->Delete(key);
+}
+
+void ShardedEngine::MultiGet(size_t n, const Slice* keys, std::string* values,
+                             Status* statuses) {
+    // Each shard gets one MultiGet of its keys, gathered in order; the
+    // results are scattered back.
+    static thread_local std::vector<uint32_t> shard_of;
+    static thread_local std::vector<Slice> shard_keys;
+    static thread_local std::vector<std::string> shard_values;
+    static thread_local std::vector<Status> shard_statuses;
+    shard_of.resize(n);
+    shard_keys.resize(n);
+    shard_values.resize(n);
+    shard_statuses.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        shard_of[i] = (uint32_t)ShardFor(keys[i]);
+    }
+    for (size_t s = 0; s < shards_.size(); ++s) {
+        size_t m = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (shard_of[i] == s) {
+                shard_keys[m++] = keys[i];
+            }
+        }
+        if (m == 0) {
+            continue;
+        }
+        shards_[s]->MultiGet(m, shard_keys.data(), shard_values.data(), shard_statuses.data());
+        for (size_t i = 0, j = 0; j < m; ++i) {
+            if (shard_of[i] == s) {
+                values[i].swap(shard_values[j]);
+                statuses[i] = shard_statuses[j];
+                ++j;
+            }
+        }
+    }
+}
+
+const Snapshot* ShardedEngine::GetSnapshot() {
+    ShardedSnapshot* snapshot = new ShardedSnapshot();
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        snapshot->shards.push_back(shards_[i]->GetSnapshot());
+    }
+    return snapshot;
+}
+
+void ShardedEngine::ReleaseSnapshot(const Snapshot* snapshot) {
+    if (snapshot == nullptr) {
+        return;
+    }
+    const ShardedSnapshot* s = static_cast<const ShardedSnapshot*>(snapshot);
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        shards_[i]->ReleaseSnapshot(s->shards[i]);
+    }
+    delete s;
+}
+
+Status ShardedEngine::Get(const Snapshot* snapshot, const Slice& key, std::string* value) {
+    if (snapshot == nullptr) {
+        return Get(key, value);
+    }
+    size_t i = ShardFor(key);
+    return shards_[i]->Get(static_cast<const ShardedSnapshot*>(snapshot)->shards[i], key, value);
+}
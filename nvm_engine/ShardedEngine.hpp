@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "include/db.hpp"
+#include "Options.hpp"
+
+// Options::shards engines behind one DB, sharing nothing: each shard has
+// its own pmem file, index, log, slot store, inline arena, tables,
+// background threads and statistics, so writers to different shards never
+// touch the same cache lines. Keys are routed by a hash independent of the
+// one the shards index by.
+//
+// Shard i lives in "<name>.<i>" (and "<name>.<i>.tables"); `name` itself
+// only records the shard count, which is fixed when the engine is created.
+class ShardedEngine : public DB {
+public:
+    // Whether `name` is a sharded engine, or, if it is new or empty, is to
+    // become one with `options`.
+    static bool IsSharded(const std::string& name, const Options& options);
+
+    static Status Open(const std::string& name, const Options& options, DB** dbptr);
+
+    Status Get(const Slice& key, std::string* value) override;
+    Status Set(const Slice& key, const Slice& value) override;
+    Status Set(const Slice& key, const Slice& value, uint32_t ttl) override;
+    Status Delete(const Slice& key) override;
+    void MultiGet(size_t n, const Slice* keys, std::string* values, Status* statuses) override;
+
+    // A snapshot of every shard, taken one after another. It still sees
+    // every Set that returned before GetSnapshot and none that started
+    // after it returned.
+    const Snapshot* GetSnapshot() override;
+    void ReleaseSnapshot(const Snapshot* snapshot) override;
+    Status Get(const Snapshot* snapshot, const Slice& key, std::string* value) override;
+
+    ~ShardedEngine();
+
+private:
+    class ShardedSnapshot;
+
+    ShardedEngine() {}
+
+    // Reads the shard count from `name`, or records `*count` in a new one.
+    static Status ReadOrCreateCount(const std::string& name, size_t* count);
+
+    // What each shard gets of the budgets in `options`.
+    static Options ShardOptions(const Options& options, size_t shards, size_t i);
+
+    size_t ShardFor(const Slice& key) const;
+
+    std::vector<DB*> shards_;
+
+    ShardedEngine(const ShardedEngine&);
+    void operator=(const ShardedEngine&);
+};
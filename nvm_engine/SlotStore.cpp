@@ -0,0 +1,184 @@
+#include "SlotStore.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "PmemLog.hpp"
+
+static std::atomic<size_t> next_pool_index_(0);
+
+Status SlotStore::Open(PmemFile* file, size_t offset, size_t size, size_t pool_count,
+                       size_t key_size, size_t value_size, SlotStore** storeptr,
+                       Statistics* statistics) {
+    size_t record_size = key_size + value_size;
+    if (record_size == 0 || pool_count == 0 || offset + size > file->size()) {
+        return IOError;
+    }
+
+    size_t pool_size = (size / pool_count) & ~(kLocationUnit - 1);
+    size_t slots = pool_size > kLocationUnit ? (pool_size - kLocationUnit) / (sizeof(Meta) + record_size) : 0;
+    if (slots > kMaxSlots / pool_count) {
+        slots = kMaxSlots / pool_count;
+    }
+    if (slots == 0) {
+        return IOError;
+    }
+
+    SlotStore* store = new SlotStore();
+    void* mem = nullptr;
+    if (posix_memalign(&mem, alignof(Pool), pool_count * sizeof(Pool)) != 0) {
+        delete store;
+        return OutOfMemory;
+    }
+    store->file_ = file;
+    store->pools_ = static_cast<Pool*>(mem);
+    store->pool_count_ = pool_count;
+    store->slots_per_pool_ = (uint32_t)slots;
+    store->key_size_ = key_size;
+    store->value_size_ = value_size;
+    store->record_size_ = record_size;
+    store->statistics_ = statistics;
+
+    size_t meta_size = (slots * sizeof(Meta) + kLocationUnit - 1) & ~(kLocationUnit - 1);
+    for (size_t i = 0; i < pool_count; ++i) {
+        Pool* pool = new (&store->pools_[i]) Pool;
+        char* base = file->base() + offset + i * pool_size;
+        pool->meta = reinterpret_cast<Meta*>(base);
+        pool->records = base + meta_size;
+        pool->tail = 0;
+        pool->busy = false;
+    }
+
+    *storeptr = store;
+    return Ok;
+}
+
+SlotStore::~SlotStore() {
+    if (pools_ != nullptr) {
+        for (size_t i = 0; i < pool_count_; ++i) {
+            pools_[i].~Pool();
+        }
+        free(pools_);
+    }
+}
+
+bool SlotStore::TryAppend(size_t pool_index, const Slice& key, const Slice& value,
+                          uint32_t version, uint32_t* slot) {
+    Pool* pool = &pools_[pool_index];
+    LockPool(pool);
+    uint32_t index;
+    if (!pool->free.empty()) {
+        index = pool->free.back();
+        pool->free.pop_back();
+    } else if (pool->tail < slots_per_pool_) {
+        index = pool->tail++;
+    } else {
+        UnlockPool(pool);
+        return false;
+    }
+
+    // The record goes first; the meta word that makes it valid is written
+    // with one 8-byte store once the record is durable. Until then a reused
+    // slot fails its checksum, which recovery takes for a killed slot.
+    char* dst = pool->records + (size_t)index * record_size_;
+    memcpy(dst, key.data(), key_size_);
+    memcpy(dst + key_size_, value.data(), value_size_);
+    Tracer::Mark(TRACE_SET_COPY);
+    file_->Persist(dst, record_size_);
+    Meta meta;
+    meta.checksum = PmemLog::Checksum(version, key, value);
+    meta.version = version;
+    memcpy(&pool->meta[index], &meta, sizeof(meta));
+    file_->Persist(&pool->meta[index], sizeof(meta));
+    Tracer::Mark(TRACE_SET_PERSIST);
+
+    UnlockPool(pool);
+    RecordTick(statistics_, SLOT_APPENDS);
+    RecordTick(statistics_, SLOT_BYTES_PERSISTED, record_size_ + sizeof(meta));
+    *slot = (uint32_t)pool_index * slots_per_pool_ + index;
+    return true;
+}
+
+bool SlotStore::Append(const Slice& key, const Slice& value, uint32_t version, uint32_t* slot) {
+    static thread_local size_t thread_pool = next_pool_index_++;
+
+    size_t pool_index = thread_pool % pool_count_;
+    for (size_t i = 0; i < pool_count_; ++i) {
+        if (TryAppend(pool_index, key, value, version, slot)) {
+            return true;
+        }
+        RecordTick(statistics_, SLOT_POOL_RETRIES);
+        if (++pool_index >= pool_count_) {
+            pool_index = 0;
+        }
+    }
+    exhausted_.store(true, std::memory_order_relaxed);
+    return false;
+}
+
+void SlotStore::Kill(uint32_t slot) {
+    Pool* pool = &pools_[slot / slots_per_pool_];
+    Meta* meta = &pool->meta[slot % slots_per_pool_];
+    char* record = pool->records + (size_t)(slot % slots_per_pool_) * record_size_;
+    Slice key(record, key_size_);
+    Slice value(record + key_size_, value_size_);
+    uint32_t dead = ~PmemLog::Checksum(meta->version, key, value);
+    if (meta->checksum == dead) {
+        return;
+    }
+    memcpy(&meta->checksum, &dead, sizeof(dead));
+    file_->Persist(&meta->checksum, sizeof(dead));
+    LockPool(pool);
+    pool->killed.push_back(slot % slots_per_pool_);
+    UnlockPool(pool);
+    killed_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SlotStore::TakeKilled(std::vector<uint32_t>* slots) {
+    for (size_t i = 0; i < pool_count_; ++i) {
+        Pool* pool = &pools_[i];
+        LockPool(pool);
+        for (size_t j = 0; j < pool->killed.size(); ++j) {
+            slots->push_back((uint32_t)i * slots_per_pool_ + pool->killed[j]);
+        }
+        killed_.fetch_sub(pool->killed.size(), std::memory_order_relaxed);
+        pool->killed.clear();
+        UnlockPool(pool);
+    }
+}
+
+void SlotStore::Reuse(const std::vector<uint32_t>& slots) {
+    for (size_t i = 0; i < slots.size(); ++i) {
+        Pool* pool = &pools_[slots[i] / slots_per_pool_];
+        LockPool(pool);
+        pool->free.push_back(slots[i] % slots_per_pool_);
+        UnlockPool(pool);
+    }
+    if (!slots.empty()) {
+        exhausted_.store(false, std::memory_order_relaxed);
+    }
+}
+
+void SlotStore::Recover(const std::function<void(uint32_t slot)>& visit) {
+    for (size_t i = 0; i < pool_count_; ++i) {
+        Pool* pool = &pools_[i];
+        uint32_t index = 0;
+        for (; index < slots_per_pool_; ++index) {
+            const Meta& meta = pool->meta[index];
+            if (meta.version == 0) {
+                break;
+            }
+            char* record = pool->records + (size_t)index * record_size_;
+            Slice key(record, key_size_);
+            Slice value(record + key_size_, value_size_);
+            // Killed, or torn while it was written again.
+            if (meta.checksum != PmemLog::Checksum(meta.version, key, value)) {
+                pool->free.push_back(index);
+                continue;
+            }
+            visit((uint32_t)i * slots_per_pool_ + index);
+        }
+        pool->tail = index;
+    }
+}
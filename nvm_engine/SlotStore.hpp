@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "include/db.hpp"
+#include "PmemFile.hpp"
+#include "Statistics.hpp"
+#include "ValueRef.hpp"
+
+// A store of fixed-size records on a region of a pmem file, for the one
+// key and value size that dominates the workload (16 and 80 bytes in both
+// rounds of the contest). Records are packed back to back with no header
+// and addressed by slot number, so a 96-byte record takes 96 bytes instead
+// of the log's 128.
+//
+// What a header would hold, the checksum and the version, lives in a dense
+// side table at the head of each pool, 8 bytes per slot. The version
+// orders overwrites of a key across pools on recovery, and the checksum
+// catches a slot torn by a crash.
+//
+// Every record that a newer one of its key replaces is killed, its checksum
+// inverted, so that only the newest record of a key is ever live on pmem:
+// the newer one may be flushed out of the log, or be a deletion that goes
+// away, and nothing could then tell the old one apart from a current value.
+// Killed slots are handed out again once no reader can still see them.
+//
+// Like the log, the region is cut into pools that writer threads are bound
+// to. Slots of a pool are first filled in order, so recovery scans each
+// pool up to the first slot that was never written.
+class SlotStore {
+public:
+    // Lays the store out over `size` bytes of `file` from `offset`, for
+    // records of exactly `key_size` and `value_size` bytes.
+    static Status Open(PmemFile* file, size_t offset, size_t size, size_t pool_count,
+                       size_t key_size, size_t value_size, SlotStore** storeptr,
+                       Statistics* statistics = nullptr);
+    ~SlotStore();
+
+    bool Fits(const Slice& key, const Slice& value) const {
+        return key.size() == key_size_ && value.size() == value_size_;
+    }
+
+    // Writes and persists a record in a free slot of the calling thread's
+    // pool, falling back to the other pools when it is full. Returns false
+    // when every slot is taken.
+    bool Append(const Slice& key, const Slice& value, uint32_t version, uint32_t* slot);
+
+    // Marks a slot whose record a newer one of its key has replaced, once
+    // the newer one is durable and no longer reachable through the slot.
+    // Recovery skips it from then on.
+    void Kill(uint32_t slot);
+
+    // Slots killed since the last call. They are free for reuse once every
+    // read that may have found them before they were killed is done.
+    void TakeKilled(std::vector<uint32_t>* slots);
+    void Reuse(const std::vector<uint32_t>& slots);
+
+    // Whether an Append found every slot taken while killed slots wait to
+    // be reused.
+    bool ReuseDue() const {
+        return exhausted_.load(std::memory_order_relaxed) &&
+               killed_.load(std::memory_order_relaxed) > 0;
+    }
+
+    const char* Key(uint32_t slot) const {
+        return RecordAt(slot);
+    }
+
+    const char* Value(uint32_t slot) const {
+        return RecordAt(slot) + key_size_;
+    }
+
+    uint32_t Version(uint32_t slot) const {
+        return MetaAt(slot)->version;
+    }
+
+    size_t key_size() const {
+        return key_size_;
+    }
+
+    size_t value_size() const {
+        return value_size_;
+    }
+
+    // Replays the valid live slots of every pool, makes the killed and torn
+    // ones free and positions each pool's tail after the last slot ever
+    // written. Not thread-safe; call it before the store is shared.
+    void Recover(const std::function<void(uint32_t slot)>& visit);
+
+private:
+    struct Meta {
+        uint32_t checksum;
+        uint32_t version;
+    };
+
+    // Everything but the mapping is guarded by `busy`.
+    struct alignas(64) Pool {
+        Meta* meta;
+        char* records;
+        uint32_t tail;
+        std::atomic<bool> busy;
+        // Indexes in the pool of slots that may be written again, and of
+        // those killed but maybe still read.
+        std::vector<uint32_t> free;
+        std::vector<uint32_t> killed;
+    };
+
+    SlotStore() : file_(nullptr), pools_(nullptr), pool_count_(0), slots_per_pool_(0),
+                  key_size_(0), value_size_(0), record_size_(0), statistics_(nullptr),
+                  killed_(0), exhausted_(false) {}
+
+    static void LockPool(Pool* pool) {
+        while (pool->busy.exchange(true, std::memory_order_acquire)) {
+            __builtin_ia32_pause();
+        }
+    }
+
+    static void UnlockPool(Pool* pool) {
+        pool->busy.store(false, std::memory_order_release);
+    }
+
+    const char* RecordAt(uint32_t slot) const {
+        const Pool& pool = pools_[slot / slots_per_pool_];
+        return pool.records + (size_t)(slot % slots_per_pool_) * record_size_;
+    }
+
+    const Meta* MetaAt(uint32_t slot) const {
+        return &pools_[slot / slots_per_pool_].meta[slot % slots_per_pool_];
+    }
+
+    bool TryAppend(size_t pool_index, const Slice& key, const Slice& value, uint32_t version,
+                   uint32_t* slot);
+
+    PmemFile* file_;
+    Pool* pools_;
+    size_t pool_count_;
+    uint32_t slots_per_pool_;
+    size_t key_size_;
+    size_t value_size_;
+    size_t record_size_;
+    Statistics* statistics_;
+    std::atomic<size_t> killed_;
+    std::atomic<bool> exhausted_;
+
+    SlotStore(const SlotStore&);
+    void operator=(const SlotStore&);
+};
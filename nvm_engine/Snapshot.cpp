@@ -0,0 +1,83 @@
+#include "Snapshot.hpp"
+
+#include <algorithm>
+
+bool OverwrittenValues::Save(const Slice& key, uint64_t hash, uint64_t sequence,
+                             uint64_t oldest_snapshot, uint64_t newest_snapshot,
+                             const std::function<bool(std::string*)>& read) {
+    Shard* shard = ShardFor(hash);
+    std::lock_guard<std::mutex> l(shard->mutex);
+    std::string k = key.to_string();
+    auto it = shard->values.find(k);
+    uint64_t since = it == shard->values.end() ? 0 : it->second.back().until;
+    if (it != shard->values.end()) {
+        // Ordered by `until`, so the unreadable ones are a prefix. The last
+        // one stays, as the next value's `since` comes from it.
+        std::vector<Value>& values = it->second;
+        size_t dead = 0;
+        while (dead + 1 < values.size() && values[dead].until <= oldest_snapshot) {
+            ++dead;
+        }
+        values.erase(values.begin(), values.begin() + dead);
+    }
+    if (since > newest_snapshot) {
+        return false;
+    }
+    if (it == shard->values.end()) {
+        it = shard->values.emplace(k, std::vector<Value>()).first;
+    }
+    it->second.push_back(Value());
+    Value& v = it->second.back();
+    v.since = since;
+    v.until = sequence;
+    v.found = read(&v.value);
+    return true;
+}
+
+bool OverwrittenValues::Get(const Slice& key, uint64_t hash, uint64_t snapshot, Status* s,
+                            std::string* value) {
+    Shard* shard = ShardFor(hash);
+    std::lock_guard<std::mutex> l(shard->mutex);
+    auto it = shard->values.find(key.to_string());
+    if (it == shard->values.end()) {
+        return false;
+    }
+    // The first value replaced after the snapshot is the one it saw.
+    const std::vector<Value>& values = it->second;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (values[i].until > snapshot) {
+            if (values[i].found) {
+                value->assign(values[i].value);
+                *s = Ok;
+            } else {
+                *s = NotFound;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void OverwrittenValues::Trim(const std::vector<uint64_t>& snapshots) {
+    for (size_t i = 0; i < kShards; ++i) {
+        Shard* shard = &shards_[i];
+        std::lock_guard<std::mutex> l(shard->mutex);
+        if (snapshots.empty()) {
+            shard->values.clear();
+            continue;
+        }
+        for (auto it = shard->values.begin(); it != shard->values.end();) {
+            std::vector<Value>& values = it->second;
+            values.erase(std::remove_if(values.begin(), values.end(), [&](const Value& v) {
+                // Kept if some snapshot falls in [since, until).
+                auto s = std::lower_bound(snapshots.begin(), snapshots.end(), v.since);
+                return s == snapshots.end() || *s >= v.until;
+            }), values.end());
+            if (values.empty()) {
+                it = shard->values.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "include/db.hpp"
+
+// A snapshot is the sequence number of the last write it sees.
+class SnapshotImpl : public Snapshot {
+public:
+    explicit SnapshotImpl(uint64_t sequence) : sequence_(sequence), prev_(this), next_(this) {}
+
+    uint64_t sequence() const {
+        return sequence_;
+    }
+
+private:
+    friend class SnapshotList;
+
+    const uint64_t sequence_;
+    // Neighbours in the list, which is circular and doubly linked.
+    SnapshotImpl* prev_;
+    SnapshotImpl* next_;
+};
+
+// The live snapshots, oldest first, as in leveldb. Snapshots are taken in
+// sequence order, so appending keeps the list sorted. Not thread-safe.
+class SnapshotList {
+public:
+    SnapshotList() : head_(0) {}
+
+    ~SnapshotList() {
+        while (!empty()) {
+            Delete(head_.next_);
+        }
+    }
+
+    bool empty() const {
+        return head_.next_ == &head_;
+    }
+
+    uint64_t oldest() const {
+        return head_.next_->sequence_;
+    }
+
+    uint64_t newest() const {
+        return head_.prev_->sequence_;
+    }
+
+    SnapshotImpl* New(uint64_t sequence) {
+        SnapshotImpl* s = new SnapshotImpl(sequence);
+        s->next_ = &head_;
+        s->prev_ = head_.prev_;
+        s->prev_->next_ = s;
+        s->next_->prev_ = s;
+        return s;
+    }
+
+    void Delete(const SnapshotImpl* s) {
+        s->prev_->next_ = s->next_;
+        s->next_->prev_ = s->prev_;
+        delete s;
+    }
+
+    // Appends the sequence numbers of the live snapshots, oldest first.
+    void Sequences(std::vector<uint64_t>* result) const {
+        for (const SnapshotImpl* s = head_.next_; s != &head_; s = s->next_) {
+            result->push_back(s->sequence_);
+        }
+    }
+
+private:
+    SnapshotImpl head_;
+
+    SnapshotList(const SnapshotList&);
+    void operator=(const SnapshotList&);
+};
+
+// Values that writes replaced while a snapshot might still read them. The
+// log, its flushes and compactions keep only the newest value of a key, so
+// a write saves the value it overwrites here first, and a read at a
+// snapshot prefers what is saved here over the current value.
+//
+// Every saved value carries the range of sequence numbers it was current
+// for: from the write that replaced the previous saved value of the key,
+// or 0 if there is none, up to the write that replaced it. Writes to a key
+// come in sequence order, as they hold the key's index stripe, so a key's
+// values are kept in that order too. Sharded by key hash, each shard under
+// its own mutex.
+//
+// A key keeps at most one value per live snapshot: once a value is saved
+// that became current after the newest snapshot, later writes save nothing.
+// Still, a snapshot held while most keys are overwritten costs a copy of
+// their values in DRAM. Values go when the last snapshot that may read them
+// is released, and a key's values that even the oldest live snapshot cannot
+// read are dropped as soon as the key is written again.
+class OverwrittenValues {
+public:
+    OverwrittenValues() {}
+
+    // Saves the value `key` had before the write numbered `sequence`,
+    // unless no snapshot up to `newest_snapshot` can read it, that is, when
+    // the value became current after the newest snapshot. `read` fetches
+    // the value and returns false if the key had none. Returns whether the
+    // value was saved. Drops the key's values that were replaced by
+    // `oldest_snapshot`, which no snapshot from it on reads.
+    bool Save(const Slice& key, uint64_t hash, uint64_t sequence, uint64_t oldest_snapshot,
+              uint64_t newest_snapshot, const std::function<bool(std::string*)>& read);
+
+    // If `key` was overwritten after the snapshot numbered `snapshot`,
+    // sets `*s` and `*value` to what the snapshot sees and returns true.
+    // Otherwise the current value is the snapshot's and nothing changes.
+    bool Get(const Slice& key, uint64_t hash, uint64_t snapshot, Status* s, std::string* value);
+
+    // Drops the values that none of `snapshots`, in ascending order, can
+    // read.
+    void Trim(const std::vector<uint64_t>& snapshots);
+
+private:
+    struct Value {
+        // The value was current for writes in [since, until).
+        uint64_t since;
+        uint64_t until;
+        bool found;
+        std::string value;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::vector<Value>> values;
+    };
+
+    static const size_t kShards = 64;
+
+    Shard* ShardFor(uint64_t hash) {
+        return &shards_[(hash >> 32) & (kShards - 1)];
+    }
+
+    Shard shards_[kShards];
+
+    OverwrittenValues(const OverwrittenValues&);
+    void operator=(const OverwrittenValues&);
+};
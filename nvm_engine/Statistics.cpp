@@ -0,0 +1,214 @@
+#include "Statistics.hpp"
+
+#include <sys/time.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static const char* const kTickerNames[TICKER_ENUM_MAX] = {
+    "get.calls",
+    "get.found",
+    "get.inline.hits",
+    "get.pmem.reads",
+    "get.seqlock.retries",
+    "set.calls",
+    "set.failed",
+    "log.appends",
+    "log.bytes.persisted",
+    "log.pool.retries",
+    "slot.appends",
+    "slot.bytes.persisted",
+    "slot.pool.retries",
+    "index.lookups",
+    "index.buckets.probed",
+    "index.long.probes",
+    "table.filter.useful",
+    "table.filter.positive",
+    "table.filter.true.positive",
+    "block.cache.hits",
+    "block.cache.misses",
+    "table.opens",
+    "get.table.lookups",
+    "get.table.hits",
+    "flushes",
+    "flush.records",
+    "flush.bytes.written",
+    "compactions",
+    "compaction.bytes.read",
+    "compaction.bytes.written",
+    "compaction.trivial.moves",
+    "write.stalls",
+    "snapshot.values.saved",
+    "delete.calls",
+    "get.expired",
+    "tombstones.dropped",
+    "writes.combined",
+    "prefault.micros",
+};
+
+static std::atomic<uint64_t> next_statistics_id_(1);
+
+static uint64_t NowMicros() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+Statistics::Statistics(uint32_t trace_sample_period)
+    : id_(next_statistics_id_++),
+      next_block_(0),
+      blocks_(nullptr),
+      shared_(nullptr),
+      tracer_(trace_sample_period),
+      log_(nullptr),
+      max_log_size_(0),
+      log_written_(0),
+      start_us_(NowMicros()),
+      stop_(false) {
+    void* mem = nullptr;
+    if (posix_memalign(&mem, alignof(Block), kMaxBlocks * sizeof(Block)) != 0) {
+        abort();
+    }
+    blocks_ = static_cast<Block*>(mem);
+    for (size_t i = 0; i < kMaxBlocks; ++i) {
+        Block* block = new (&blocks_[i]) Block;
+        for (uint32_t t = 0; t < TICKER_ENUM_MAX; ++t) {
+            block->tickers[t].store(0, std::memory_order_relaxed);
+        }
+        block->owner.store(0, std::memory_order_relaxed);
+    }
+    shared_ = &blocks_[kMaxBlocks - 1];
+}
+
+Statistics::~Statistics() {
+    if (dumper_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        dumper_.join();
+        Dump();
+    }
+    for (size_t i = 0; i < kMaxBlocks; ++i) {
+        blocks_[i].~Block();
+    }
+    free(blocks_);
+}
+
+Statistics::Block* Statistics::Local() {
+    // Remembers the blocks of the few statistics objects the thread used
+    // last, as every shard of an engine has its own, keyed by a
+    // process-unique id so that a new object at a recycled address is not
+    // mistaken for an old one.
+    struct Cached {
+        uint64_t id;
+        Block* block;
+    };
+    static thread_local Cached cache[kCachedObjects];
+    static thread_local size_t next_victim = 0;
+    for (size_t i = 0; i < kCachedObjects; ++i) {
+        if (cache[i].id == id_) {
+            return cache[i].block;
+        }
+    }
+    Cached* entry = &cache[next_victim++ % kCachedObjects];
+    entry->id = id_;
+    entry->block = Claim();
+    return entry->block;
+}
+
+// The block of the calling thread, claimed on its first use of this object
+// and found again after the cache has dropped it.
+Statistics::Block* Statistics::Claim() {
+    static thread_local uint64_t thread_id = next_statistics_id_++;
+    size_t used = next_block_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < used && i < kMaxBlocks - 1; ++i) {
+        if (blocks_[i].owner.load(std::memory_order_acquire) == thread_id) {
+            return &blocks_[i];
+        }
+    }
+    size_t i = next_block_.fetch_add(1, std::memory_order_relaxed);
+    if (i >= kMaxBlocks - 1) {
+        return shared_;
+    }
+    blocks_[i].owner.store(thread_id, std::memory_order_release);
+    return &blocks_[i];
+}
+
+uint64_t Statistics::getTickerCount(uint32_t ticker) const {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < kMaxBlocks; ++i) {
+        sum += blocks_[i].tickers[ticker].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+std::string Statistics::ToString() const {
+    std::string out;
+    char buf[64];
+    for (uint32_t t = 0; t < TICKER_ENUM_MAX; ++t) {
+        snprintf(buf, sizeof(buf), "%s%s %llu", t == 0 ? "" : " ", kTickerNames[t],
+                 (unsigned long long)getTickerCount(t));
+        out += buf;
+    }
+    uint64_t useful = getTickerCount(TABLE_FILTER_USEFUL);
+    uint64_t false_positive =
+        getTickerCount(TABLE_FILTER_POSITIVE) - getTickerCount(TABLE_FILTER_TRUE_POSITIVE);
+    if (useful + false_positive > 0) {
+        snprintf(buf, sizeof(buf), " table.filter.fp.rate %.4f",
+                 (double)false_positive / (useful + false_positive));
+        out += buf;
+    }
+    return out;
+}
+
+void Statistics::StartDumping(FILE* log, unsigned period_sec, size_t max_log_size,
+                              const std::string& label) {
+    if (log == nullptr || period_sec == 0 || dumper_.joinable()) {
+        return;
+    }
+    log_ = log;
+    label_ = label.empty() ? "stats" : "stats " + label;
+    max_log_size_ = max_log_size;
+    dumper_ = std::thread(&Statistics::DumpLoop, this, period_sec);
+}
+
+void Statistics::DumpLoop(unsigned period_sec) {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!cv_.wait_for(lock, std::chrono::seconds(period_sec), [this] { return stop_; })) {
+        Dump();
+    }
+}
+
+void Statistics::Dump() {
+    if (log_ == nullptr || log_written_ >= max_log_size_) {
+        return;
+    }
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "[%s %.1fs] ", label_.c_str(),
+             (NowMicros() - start_us_) / 1e6);
+    std::string line = prefix + ToString() + "\n";
+    std::string trace = tracer_.Summary();
+    for (size_t begin = 0; begin < trace.size();) {
+        size_t end = trace.find('\n', begin);
+        end = end == std::string::npos ? trace.size() : end;
+        line += "[trace] " + trace.substr(begin, end - begin) + "\n";
+        begin = end + 1;
+    }
+    if (log_written_ + line.size() > max_log_size_) {
+        // Leave a marker instead of a line cut short.
+        std::string full = "[" + label_ + "] log size limit reached, no further dumps\n";
+        if (log_written_ + full.size() <= max_log_size_) {
+            fputs(full.c_str(), log_);
+            fflush(log_);
+        }
+        log_written_ = max_log_size_;
+        return;
+    }
+    fputs(line.c_str(), log_);
+    fflush(log_);
+    log_written_ += line.size();
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Tracer.hpp"
+
+// Counters of the engine's hot paths, in the spirit of rocksdb's tickers.
+enum Tickers : uint32_t {
+    GET_CALLS = 0,
+    GET_FOUND,
+    // Values served from an inline DRAM record, and those read from pmem.
+    GET_INLINE_HITS,
+    GET_PMEM_READS,
+    // Lookups repeated because a writer rewrote an inline value under them.
+    GET_SEQLOCK_RETRIES,
+    SET_CALLS,
+    SET_FAILED,
+    // Records appended to the log and the bytes they occupy, padding
+    // included; every append is one persist.
+    LOG_APPENDS,
+    LOG_BYTES_PERSISTED,
+    // Appends that found the thread's own pool full and moved on.
+    LOG_POOL_RETRIES,
+    // The same for the fixed-size slot store; bytes include the slot's
+    // side table entry, and every append is two persists.
+    SLOT_APPENDS,
+    SLOT_BYTES_PERSISTED,
+    SLOT_POOL_RETRIES,
+    // Index lookups, the buckets they probed and how many needed more than
+    // the home bucket.
+    INDEX_LOOKUPS,
+    INDEX_BUCKETS_PROBED,
+    INDEX_LONG_PROBES,
+    // Sorted-table Gets the filter answered negatively, those it let
+    // through, and those of the latter that found the key. The false
+    // positive rate follows from the three and is printed with them.
+    TABLE_FILTER_USEFUL,
+    TABLE_FILTER_POSITIVE,
+    TABLE_FILTER_TRUE_POSITIVE,
+    // Data block reads served by the block cache and those that went to
+    // the file, and tables the table cache had to open.
+    BLOCK_CACHE_HITS,
+    BLOCK_CACHE_MISSES,
+    TABLE_OPENS,
+    // Gets the index missed and that went on to the sorted tables, and
+    // those of them that found the key.
+    GET_TABLE_LOOKUPS,
+    GET_TABLE_HITS,
+    // Log flushes, the live records they moved into tables and the bytes of
+    // tables they wrote.
+    FLUSHES,
+    FLUSH_RECORDS,
+    FLUSH_BYTES_WRITTEN,
+    // Compactions, the table bytes they read and wrote, and tables moved to
+    // the next level without a rewrite.
+    COMPACTIONS,
+    COMPACTION_BYTES_READ,
+    COMPACTION_BYTES_WRITTEN,
+    COMPACTION_TRIVIAL_MOVES,
+    // Sets that found the log full and waited for a flush.
+    WRITE_STALLS,
+    // Values Sets replaced while a snapshot was live and that were kept for
+    // it.
+    SNAPSHOT_VALUES_SAVED,
+    DELETE_CALLS,
+    // Gets that found an expired value.
+    GET_EXPIRED,
+    // Deletions and expired values that flushes and compactions dropped
+    // for good.
+    TOMBSTONES_DROPPED,
+    // Sets and Deletes that a newer write of the same key queued with them
+    // made redundant, and that completed without writing.
+    WRITES_COMBINED,
+    // Time open spent faulting in the index and the pmem file ahead of
+    // use.
+    PREFAULT_MICROS,
+    TICKER_ENUM_MAX
+};
+
+// Per-thread counters, each thread writing only to its own cache line
+// aligned block so that counting never takes a locked instruction or
+// bounces a line between cores. Reads sum over all blocks and are only
+// approximately consistent with each other.
+//
+// Optionally dumps the counters, and the summary of the tracer it carries,
+// to a log file every few seconds from a background thread, stopping before
+// the file would outgrow a size limit.
+class Statistics {
+public:
+    // One in `trace_sample_period` operations per thread is traced; 0
+    // disables tracing.
+    explicit Statistics(uint32_t trace_sample_period = 0);
+    ~Statistics();
+
+    void RecordTick(uint32_t ticker, uint64_t count = 1) {
+        Block* block = Local();
+        if (block != shared_) {
+            block->tickers[ticker].store(
+                block->tickers[ticker].load(std::memory_order_relaxed) + count,
+                std::memory_order_relaxed);
+        } else {
+            block->tickers[ticker].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t getTickerCount(uint32_t ticker) const;
+
+    Tracer* tracer() {
+        return &tracer_;
+    }
+
+    // One line of "name value" pairs.
+    std::string ToString() const;
+
+    // Starts dumping to `log` every `period_sec` seconds. Dumps stop once
+    // `max_log_size` bytes have been written; a last dump is written when
+    // the statistics are destroyed. A non-empty `label` goes into every
+    // line.
+    void StartDumping(FILE* log, unsigned period_sec, size_t max_log_size,
+                      const std::string& label = std::string());
+
+private:
+    // Threads beyond this many share the last block, counting with atomic
+    // adds.
+    static const size_t kMaxBlocks = 256;
+    static const size_t kCachedObjects = 8;
+
+    struct alignas(64) Block {
+        std::atomic<uint64_t> tickers[TICKER_ENUM_MAX];
+        // The thread the block belongs to; set once when it is claimed.
+        std::atomic<uint64_t> owner;
+    };
+
+    Block* Local();
+    Block* Claim();
+    void Dump();
+    void DumpLoop(unsigned period_sec);
+
+    const uint64_t id_;
+    std::atomic<size_t> next_block_;
+    Block* blocks_;
+    Block* shared_;
+    Tracer tracer_;
+
+    FILE* log_;
+    std::string label_;
+    size_t max_log_size_;
+    size_t log_written_;
+    uint64_t start_us_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_;
+    std::thread dumper_;
+
+    Statistics(const Statistics&);
+    void operator=(const Statistics&);
+};
+
+inline void RecordTick(Statistics* statistics, uint32_t ticker, uint64_t count = 1) {
+    if (statistics != nullptr) {
+        statistics->RecordTick(ticker, count);
+    }
+}
@@ -0,0 +1,318 @@
+#include "Table.hpp"
+
+#include <cstdlib>
+
+#include "BloomFilter.hpp"
+#include "Coding.hpp"
+#include "Hash.hpp"
+#include "TwoLevelIterator.hpp"
+
+BlockHandle::BlockHandle() : offset_(~(uint64_t)0), size_(~(uint64_t)0) {}
+
+BlockHandle::BlockHandle(uint64_t size, uint64_t offset) : offset_(offset), size_(size) {}
+
+void BlockHandle::EncodeTo(std::string* dst) const {
+    PutVarint64(dst, offset_);
+    PutVarint64(dst, size_);
+}
+
+Status BlockHandle::DecodeFrom(Slice* input) {
+    if (GetVarint64(input, &offset_) && GetVarint64(input, &size_)) {
+        return Ok;
+    }
+    return IOError;
+}
+
+void Footer::EncodeTo(std::string* dst) const {
+    const size_t original_size = dst->size();
+    metaindex_handle_.EncodeTo(dst);
+    index_handle_.EncodeTo(dst);
+    dst->resize(original_size + 2 * BlockHandle::kMaxEncodedLength);  // Padding
+    PutFixed64(dst, kTableMagicNumber);
+}
+
+Status Footer::DecodeFrom(Slice* input) {
+    if (input->size() < kEncodedLength) {
+        return IOError;
+    }
+    const char* magic_ptr = input->data() + kEncodedLength - 8;
+    if (DecodeFixed64(magic_ptr) != kTableMagicNumber) {
+        return IOError;
+    }
+
+    Status result = metaindex_handle_.DecodeFrom(input);
+    if (result == Ok) {
+        result = index_handle_.DecodeFrom(input);
+    }
+    if (result == Ok) {
+        // Skip over any leftover data (just padding for now) in input.
+        const char* end = magic_ptr + 8;
+        *input = Slice(const_cast<char*>(end), input->data() + input->size() - end);
+    }
+    return result;
+}
+
+Status ReadBlock(RandomAccessFile* file, const BlockHandle& handle, BlockContents* result,
+                 bool verify_in_place) {
+    result->data = Slice();
+    result->heap_allocated = false;
+
+    size_t n = handle.size();
+    // Files that hand out their own memory need no buffer.
+    char* buf = file->ReadsWithoutCopy() ? nullptr : new char[n + kBlockTrailerSize];
+    Slice contents;
+    Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+    if (s != Ok) {
+        delete[] buf;
+        return s;
+    }
+    if (contents.size() != n + kBlockTrailerSize) {
+        delete[] buf;
+        return IOError;  // Truncated read
+    }
+
+    const char* data = contents.data();
+    if (data[n] != 0) {
+        delete[] buf;
+        return IOError;
+    }
+    if ((data == buf || verify_in_place) && DecodeFixed32(data + n + 1) != Crc32c(data, n + 1)) {
+        delete[] buf;
+        return IOError;
+    }
+
+    if (data != buf) {
+        // The file handed out its own memory, which outlives the block.
+        delete[] buf;
+        result->data = Slice(const_cast<char*>(data), n);
+    } else {
+        result->data = Slice(buf, n);
+        result->heap_allocated = true;
+    }
+    return Ok;
+}
+
+struct Table::Rep {
+    ~Rep() {
+        free(filter_data);
+        delete index_block;
+    }
+
+    Options options;
+    Statistics* statistics;
+    RandomAccessFile* file;
+    uint64_t cache_id;
+    BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
+    Block* index_block;
+    // The filter, copied into DRAM; nullptr if the table has none.
+    char* filter_data;
+    BloomFilterReader filter;
+};
+
+Status Table::Open(const Options& options, RandomAccessFile* file, uint64_t file_number,
+                   uint64_t size, Table** table, Statistics* statistics) {
+    *table = nullptr;
+    if (size < Footer::kEncodedLength) {
+        return IOError;
+    }
+
+    char footer_space[Footer::kEncodedLength];
+    Slice footer_input;
+    Status s = file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength, &footer_input,
+                          footer_space);
+    if (s != Ok) {
+        return s;
+    }
+    if (footer_input.size() != Footer::kEncodedLength) {
+        return IOError;
+    }
+
+    Footer footer;
+    s = footer.DecodeFrom(&footer_input);
+    if (s != Ok) {
+        return s;
+    }
+
+    BlockContents index_block_contents;
+    s = ReadBlock(file, footer.index_handle(), &index_block_contents);
+    if (s != Ok) {
+        return s;
+    }
+
+    Rep* rep = new Table::Rep;
+    rep->options = options;
+    rep->statistics = statistics;
+    rep->file = file;
+    rep->cache_id = file_number;
+    rep->metaindex_handle = footer.metaindex_handle();
+    rep->index_block = new Block(index_block_contents);
+    rep->filter_data = nullptr;
+    *table = new Table(rep);
+    (*table)->ReadMeta(footer);
+    return Ok;
+}
+
+void Table::ReadMeta(const Footer& footer) {
+    // A table without a readable filter still works, only slower, so errors
+    // here are not propagated.
+    BlockContents contents;
+    if (ReadBlock(rep_->file, footer.metaindex_handle(), &contents) != Ok) {
+        return;
+    }
+    Block* meta = new Block(contents);
+    Iterator* iter = meta->NewIterator(BytewiseComparator());
+    Slice key(const_cast<char*>(kFilterBlockName));
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == key) {
+        ReadFilter(iter->value());
+    }
+    delete iter;
+    delete meta;
+}
+
+void Table::ReadFilter(const Slice& filter_handle_value) {
+    Slice v = filter_handle_value;
+    BlockHandle filter_handle;
+    if (filter_handle.DecodeFrom(&v) != Ok) {
+        return;
+    }
+    BlockContents block;
+    if (ReadBlock(rep_->file, filter_handle, &block) != Ok) {
+        return;
+    }
+    // Copy the filter to a line-aligned DRAM buffer even when the file
+    // handed out its own memory, so a probe costs one DRAM line whatever
+    // the table lives on.
+    void* mem = nullptr;
+    if (posix_memalign(&mem, kBloomLineBytes, block.data.size()) == 0) {
+        memcpy(mem, block.data.data(), block.data.size());
+        if (rep_->filter.Init(Slice(static_cast<char*>(mem), block.data.size()))) {
+            rep_->filter_data = static_cast<char*>(mem);
+        } else {
+            free(mem);
+        }
+    }
+    if (block.heap_allocated) {
+        delete[] block.data.data();
+    }
+}
+
+Table::~Table() {
+    delete rep_;
+}
+
+static void DeleteBlock(void* arg, void* ignored) {
+    delete reinterpret_cast<Block*>(arg);
+}
+
+static void DeleteCachedBlock(const Slice& key, void* value) {
+    delete reinterpret_cast<Block*>(value);
+}
+
+static void ReleaseBlock(void* arg, void* h) {
+    Cache* cache = reinterpret_cast<Cache*>(arg);
+    cache->Release(reinterpret_cast<Cache::Handle*>(h));
+}
+
+Iterator* Table::BlockIterator(const BlockHandle& handle) const {
+    Cache* block_cache = rep_->options.block_cache;
+    Block* block = nullptr;
+    Cache::Handle* cache_handle = nullptr;
+    Status s = Ok;
+
+    if (block_cache != nullptr) {
+        char cache_key_buffer[16];
+        EncodeFixed64(cache_key_buffer, rep_->cache_id);
+        EncodeFixed64(cache_key_buffer + 8, handle.offset());
+        Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+        cache_handle = block_cache->Lookup(key);
+        if (cache_handle != nullptr) {
+            RecordTick(rep_->statistics, BLOCK_CACHE_HITS);
+            block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+        } else {
+            RecordTick(rep_->statistics, BLOCK_CACHE_MISSES);
+            BlockContents contents;
+            s = ReadBlock(rep_->file, handle, &contents, rep_->options.verify_checksums);
+            if (s == Ok) {
+                block = new Block(contents);
+                if (contents.heap_allocated) {
+                    cache_handle = block_cache->Insert(key, block, block->size(),
+                                                       &DeleteCachedBlock);
+                }
+            }
+        }
+    } else {
+        BlockContents contents;
+        s = ReadBlock(rep_->file, handle, &contents, rep_->options.verify_checksums);
+        if (s == Ok) {
+            block = new Block(contents);
+        }
+    }
+
+    if (block == nullptr) {
+        return new EmptyIterator(s);
+    }
+    Iterator* iter = block->NewIterator(rep_->options.comparator);
+    if (cache_handle == nullptr) {
+        iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+    } else {
+        iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+    }
+    return iter;
+}
+
+// Converts an index iterator value (i.e., an encoded BlockHandle) into an
+// iterator over the contents of the corresponding block.
+Iterator* Table::BlockReader(void* arg, const Slice& index_value) {
+    Table* table = reinterpret_cast<Table*>(arg);
+    BlockHandle handle;
+    Slice input = index_value;
+    Status s = handle.DecodeFrom(&input);
+    if (s != Ok) {
+        return new EmptyIterator(s);
+    }
+    return table->BlockIterator(handle);
+}
+
+Iterator* Table::NewIterator() const {
+    return NewTwoLevelIterator(rep_->index_block->NewIterator(rep_->options.comparator),
+                               &Table::BlockReader, const_cast<Table*>(this));
+}
+
+Status Table::InternalGet(const Slice& k, void* arg,
+                          void (*handle_result)(void*, const Slice&, const Slice&)) {
+    Status s = Ok;
+    if (rep_->filter_data != nullptr) {
+        if (!rep_->filter.KeyMayMatch(BloomHash(k))) {
+            RecordTick(rep_->statistics, TABLE_FILTER_USEFUL);
+            return Ok;
+        }
+        RecordTick(rep_->statistics, TABLE_FILTER_POSITIVE);
+    }
+    Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+    iiter->Seek(k);
+    if (iiter->Valid()) {
+        Iterator* block_iter = BlockReader(this, iiter->value());
+        block_iter->Seek(k);
+        if (block_iter->Valid()) {
+            if (rep_->filter_data != nullptr &&
+                rep_->options.comparator->Compare(block_iter->key(), k) == 0) {
+                RecordTick(rep_->statistics, TABLE_FILTER_TRUE_POSITIVE);
+            }
+            (*handle_result)(arg, block_iter->key(), block_iter->value());
+        }
+        s = block_iter->status();
+        delete block_iter;
+    }
+    if (s == Ok) {
+        s = iiter->status();
+    }
+    delete iiter;
+    return s;
+}
+
+std::string TableFileName(const std::string& dbname, uint64_t number) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "/%06llu.sst", (unsigned long long)number);
+    return dbname + buf;
+}
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "include/db.hpp"
-#include "Iterator.hpp"
-#include "Index.hpp"
+#include "Block.hpp"
 #include "Cache.hpp"
+#include "Env.hpp"
+#include "Iterator.hpp"
+#include "Options.hpp"
+#include "Statistics.hpp"
 
-class Env;
+class Table;
 
 struct TableHandle {
   typedef void (*CleanupFunction)(void* arg1, void* arg2);
@@ -19,7 +22,9 @@ struct TableHandle {
   }
 
   ~TableHandle() {
-    (*func)(arg1, arg2);
+    if (func != nullptr) {
+      (*func)(arg1, arg2);
+    }
   }
 
   Table* table_;
@@ -28,17 +33,25 @@ struct TableHandle {
   void* arg2;
 };
 
-class RandomAccessFile {
-public:
-    RandomAccessFile() = default;
-    virtual ~RandomAccessFile();
-    virtual Status Read(uint64_t offset, size_t n, Slice* result, char* scratch) const = 0;
-
-private:
-    RandomAccessFile(const RandomAccessFile&);
-    void operator=(const RandomAccessFile&);
-};
-
+// A sorted table is an immutable file of key-ordered entries:
+//
+//     [data block 1]
+//     ...
+//     [data block N]
+//     [filter block]
+//     [metaindex block]
+//     [index block]
+//     [footer]
+//
+// Every block is followed by a 5-byte trailer, a type byte (0, there is no
+// compression) and the CRC32C of the block and the type. The index block
+// has one entry per data block, keyed by a key >= the block's last key and
+// < the next block's first, with the block's BlockHandle as the value. The
+// metaindex block maps meta block names to their handles. The footer sits
+// at a fixed distance from the end of the file.
+
+// Points at a block of a table: its offset and its size without the
+// trailer.
 class BlockHandle {
 public:
     BlockHandle();
@@ -67,6 +80,8 @@ class Footer {
 public:
     Footer() = default;
 
+    // Encoded with the handles as varints, padded, and a magic number.
+
     const BlockHandle& metaindex_handle() const { return metaindex_handle_; }
     void set_metaindex_handle(const BlockHandle& h) { metaindex_handle_ = h; }
 
@@ -89,12 +104,41 @@ private:
     BlockHandle index_handle_;
 };
 
+static const uint64_t kTableMagicNumber = 0x7461626c656e766dULL;
+
+// Type byte and CRC32C after every block.
+static const size_t kBlockTrailerSize = 5;
+
+// Metaindex key of the table's Bloom filter (see BloomFilter.hpp).
+static const char* const kFilterBlockName = "filter.blocked_bloom";
+
+// Reads the block `handle` points at and checks its trailer. A block the
+// file hands out in place is only checked with `verify_in_place`, as the
+// check would otherwise cost a pass over the block on every read. On
+// success `result->data` is owned by the caller if
+// `result->heap_allocated`.
+Status ReadBlock(RandomAccessFile* file, const BlockHandle& handle, BlockContents* result,
+                 bool verify_in_place = true);
+
+// A sorted table opened for reading. Open reads the footer, the index block
+// and the filter, which stay in DRAM; data blocks are read from the file on
+// demand. Safe for concurrent use.
 class Table {
 public:
-    static Status Open(RandomAccessFile* file, uint64_t file_size, Table** table);
+    // `file` must stay alive as long as the table; the caller deletes it
+    // after the table.
+    // `file_number` identifies the table's blocks in options.block_cache
+    // and must not be reused by another table. Filter and cache hits are
+    // counted in `statistics` when it is not null.
+    static Status Open(const Options& options, RandomAccessFile* file, uint64_t file_number,
+                       uint64_t file_size, Table** table, Statistics* statistics = nullptr);
     ~Table();
+
+    // Iterates over all entries in key order.
     Iterator* NewIterator() const;
-    Iterator* BlockIterator(const BlockHandle&);
+    // Iterates over the entries of one data block, from the block cache if
+    // it is there.
+    Iterator* BlockIterator(const BlockHandle&) const;
 
 private:
     struct Rep;
@@ -106,6 +150,9 @@ private:
     static Iterator* BlockReader(void*, const Slice&);
     friend class TableCache;
 
+    // Calls handle_result with the first entry whose key is >= `key`, if
+    // the table has one; the callback checks whether it is `key` itself.
+    // Returns without reading the file when the filter rules `key` out.
     Status InternalGet(
         const Slice& key,
         void* arg,
@@ -118,26 +165,41 @@ private:
     void operator=(const Table&);
 };
 
+// Name of the table file numbered `number` in directory `dbname`.
+std::string TableFileName(const std::string& dbname, uint64_t number);
+
+// Keeps up to `entries` tables of a directory open, closing the least
+// recently used ones beyond that. Tables are opened on first use. Safe for
+// concurrent use.
 class TableCache {
 public:
-    TableCache(const std::string& dbanme, int entries);
+    TableCache(const std::string& dbname, const Options& options, int entries,
+               Statistics* statistics = nullptr);
     ~TableCache();
 
+    // Iterates over a table. If `tableptr` is not null it receives the
+    // table, which stays open as long as the iterator lives.
     Iterator* NewIterator(uint64_t file_number, uint64_t file_size, Table** tableptr = nullptr);
 
+    // Calls handle_result with the table's first entry whose key is >= k,
+    // if any (see Table::InternalGet).
     Status Get(uint64_t file_number,
                uint64_t file_size,
                const Slice& k,
                void* arg,
                void (*handle_result)(void*, const Slice&, const Slice&));
 
+    // Pins a table until `table_handle` is destroyed.
     Status GetTable(uint64_t file_number, uint64_t, TableHandle* table_handle);
 
+    // Closes a table whose file is about to be removed.
     void Evict(uint64_t file_number);
 
 private:
     Env* const env_;
     const std::string dbname_;
+    const Options options_;
+    Statistics* const statistics_;
     Cache* cache_;
 
     Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
@@ -162,8 +224,3 @@ inline static void UnrefEntry(void* arg1, void* arg2) {
     c->Release(h);
 }
 
-
-
-
-//TODO:
-// table的详细实现
\ No newline at end of file
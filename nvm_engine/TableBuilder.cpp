@@ -0,0 +1,195 @@
+#include "TableBuilder.hpp"
+
+#include <cassert>
+
+#include "BloomFilter.hpp"
+#include "Coding.hpp"
+#include "Hash.hpp"
+
+struct TableBuilder::Rep {
+    Rep(const Options& opt, WritableFile* f)
+        : options(opt),
+          file(f),
+          offset(0),
+          status(Ok),
+          data_block(opt.block_restart_interval),
+          // Index entries are looked up by binary search only, so every
+          // one is a restart point.
+          index_block(1),
+          num_entries(0),
+          closed(false),
+          filter(opt.bloom_bits_per_key > 0 ? new BloomFilterBuilder(opt.bloom_bits_per_key)
+                                            : nullptr),
+          pending_index_entry(false) {}
+
+    ~Rep() {
+        delete filter;
+    }
+
+    Options options;
+    WritableFile* file;
+    uint64_t offset;
+    Status status;
+    BlockBuilder data_block;
+    BlockBuilder index_block;
+    std::string last_key;
+    uint64_t num_entries;
+    bool closed;  // Either Finish() or Abandon() has been called.
+    BloomFilterBuilder* filter;  // nullptr if bloom_bits_per_key is 0
+
+    // The index entry of a data block is added once the first key of the
+    // next block is known, which allows a shorter separator key.
+    // pending_index_entry is true only if data_block is empty.
+    bool pending_index_entry;
+    BlockHandle pending_handle;
+};
+
+TableBuilder::TableBuilder(const Options& options, WritableFile* file)
+    : rep_(new Rep(options, file)) {}
+
+TableBuilder::~TableBuilder() {
+    assert(rep_->closed);
+    delete rep_;
+}
+
+void TableBuilder::Add(const Slice& key, const Slice& value) {
+    Rep* r = rep_;
+    assert(!r->closed);
+    if (r->status != Ok) {
+        return;
+    }
+    if (r->num_entries > 0) {
+        assert(r->options.comparator->Compare(
+                   key, Slice(const_cast<char*>(r->last_key.data()), r->last_key.size())) > 0);
+    }
+
+    if (r->pending_index_entry) {
+        assert(r->data_block.empty());
+        r->options.comparator->FindShortestSeparator(&r->last_key, key);
+        std::string handle_encoding;
+        r->pending_handle.EncodeTo(&handle_encoding);
+        r->index_block.Add(Slice(const_cast<char*>(r->last_key.data()), r->last_key.size()),
+                           Slice(const_cast<char*>(handle_encoding.data()), handle_encoding.size()));
+        r->pending_index_entry = false;
+    }
+
+    if (r->filter != nullptr) {
+        r->filter->AddKey(key);
+    }
+
+    r->last_key.assign(key.data(), key.size());
+    r->num_entries++;
+    r->data_block.Add(key, value);
+
+    if (r->data_block.CurrentSizeEstimate() >= r->options.block_size) {
+        Flush();
+    }
+}
+
+void TableBuilder::Flush() {
+    Rep* r = rep_;
+    assert(!r->closed);
+    if (r->status != Ok || r->data_block.empty()) {
+        return;
+    }
+    assert(!r->pending_index_entry);
+    WriteBlock(&r->data_block, &r->pending_handle);
+    if (r->status == Ok) {
+        r->pending_index_entry = true;
+        r->status = r->file->Flush();
+    }
+}
+
+void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+    WriteRawBlock(block->Finish(), handle);
+    block->Reset();
+}
+
+void TableBuilder::WriteRawBlock(const Slice& contents, BlockHandle* handle) {
+    Rep* r = rep_;
+    handle->set_offset(r->offset);
+    handle->set_size(contents.size());
+    r->status = r->file->Append(contents);
+    if (r->status == Ok) {
+        char trailer[kBlockTrailerSize];
+        trailer[0] = 0;  // No compression
+        uint32_t crc = Crc32c(contents.data(), contents.size());
+        crc = Crc32c(trailer, 1, crc);
+        EncodeFixed32(trailer + 1, crc);
+        r->status = r->file->Append(Slice(trailer, kBlockTrailerSize));
+        if (r->status == Ok) {
+            r->offset += contents.size() + kBlockTrailerSize;
+        }
+    }
+}
+
+Status TableBuilder::status() const {
+    return rep_->status;
+}
+
+Status TableBuilder::Finish() {
+    Rep* r = rep_;
+    Flush();
+    assert(!r->closed);
+    r->closed = true;
+
+    BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+
+    if (r->status == Ok && r->filter != nullptr) {
+        std::string filter_block;
+        r->filter->Finish(&filter_block);
+        WriteRawBlock(Slice(const_cast<char*>(filter_block.data()), filter_block.size()),
+                      &filter_block_handle);
+    }
+
+    if (r->status == Ok) {
+        BlockBuilder meta_index_block(r->options.block_restart_interval);
+        if (r->filter != nullptr) {
+            std::string handle_encoding;
+            filter_block_handle.EncodeTo(&handle_encoding);
+            meta_index_block.Add(Slice(const_cast<char*>(kFilterBlockName)),
+                                 Slice(const_cast<char*>(handle_encoding.data()),
+                                       handle_encoding.size()));
+        }
+        WriteBlock(&meta_index_block, &metaindex_block_handle);
+    }
+
+    if (r->status == Ok) {
+        if (r->pending_index_entry) {
+            // Any key after the last one will do; keep it as is.
+            std::string handle_encoding;
+            r->pending_handle.EncodeTo(&handle_encoding);
+            r->index_block.Add(Slice(const_cast<char*>(r->last_key.data()), r->last_key.size()),
+                               Slice(const_cast<char*>(handle_encoding.data()), handle_encoding.size()));
+            r->pending_index_entry = false;
+        }
+        WriteBlock(&r->index_block, &index_block_handle);
+    }
+
+    if (r->status == Ok) {
+        Footer footer;
+        footer.set_metaindex_handle(metaindex_block_handle);
+        footer.set_index_handle(index_block_handle);
+        std::string footer_encoding;
+        footer.EncodeTo(&footer_encoding);
+        r->status = r->file->Append(Slice(const_cast<char*>(footer_encoding.data()),
+                                          footer_encoding.size()));
+        if (r->status == Ok) {
+            r->offset += footer_encoding.size();
+        }
+    }
+    return r->status;
+}
+
+void TableBuilder::Abandon() {
+    assert(!rep_->closed);
+    rep_->closed = true;
+}
+
+uint64_t TableBuilder::NumEntries() const {
+    return rep_->num_entries;
+}
+
+uint64_t TableBuilder::FileSize() const {
+    return rep_->offset;
+}
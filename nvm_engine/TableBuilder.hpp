@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+#include "include/db.hpp"
+#include "Block.hpp"
+#include "Env.hpp"
+#include "Options.hpp"
+#include "Table.hpp"
+
+// Writes a sorted table (see Table.hpp for the format) to a file. Not
+// thread-safe.
+class TableBuilder {
+public:
+    // Does not take ownership of `file`; the caller syncs and closes it
+    // after Finish.
+    TableBuilder(const Options& options, WritableFile* file);
+
+    // Finish or Abandon must have been called.
+    ~TableBuilder();
+
+    // Keys must be added in increasing order of options.comparator.
+    void Add(const Slice& key, const Slice& value);
+
+    // Writes out the current data block. Rarely needed from outside.
+    void Flush();
+
+    Status status() const;
+
+    // Writes the index block and the footer.
+    Status Finish();
+
+    // Stops without finishing the file; the caller removes it.
+    void Abandon();
+
+    uint64_t NumEntries() const;
+
+    // Bytes written so far; the file size after Finish.
+    uint64_t FileSize() const;
+
+private:
+    struct Rep;
+
+    void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+    void WriteRawBlock(const Slice& data, BlockHandle* handle);
+
+    Rep* rep_;
+
+    TableBuilder(const TableBuilder&);
+    void operator=(const TableBuilder&);
+};
@@ -0,0 +1,97 @@
+#include "Table.hpp"
+
+#include "Coding.hpp"
+
+TableCache::TableCache(const std::string& dbname, const Options& options, int entries,
+                       Statistics* statistics)
+    : env_(Env::Default()),
+      dbname_(dbname),
+      options_(options),
+      statistics_(statistics),
+      cache_(NewLRUCache(entries)) {}
+
+TableCache::~TableCache() {
+    delete cache_;
+}
+
+// Every table is charged 1, so the cache's capacity is a count of tables.
+Status TableCache::FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle** handle) {
+    char buf[sizeof(file_number)];
+    EncodeFixed64(buf, file_number);
+    Slice key(buf, sizeof(buf));
+    *handle = cache_->Lookup(key);
+    if (*handle != nullptr) {
+        return Ok;
+    }
+
+    RecordTick(statistics_, TABLE_OPENS);
+    RandomAccessFile* file = nullptr;
+    Table* table = nullptr;
+    FileOptions file_options;
+    file_options.use_mmap = options_.use_mmap_reads;
+    file_options.populate = options_.populate_table_files;
+    file_options.access = kAccessRandom;
+    Status s = env_->NewRandomAccessFile(TableFileName(dbname_, file_number), file_options, &file);
+    if (s == Ok) {
+        s = Table::Open(options_, file, file_number, file_size, &table, statistics_);
+    }
+    if (s != Ok) {
+        delete file;
+        // Errors are not cached, so a transient one is retried next time.
+        return s;
+    }
+
+    TableAndFile* tf = new TableAndFile;
+    tf->file = file;
+    tf->table = table;
+    *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
+    return Ok;
+}
+
+Iterator* TableCache::NewIterator(uint64_t file_number, uint64_t file_size, Table** tableptr) {
+    if (tableptr != nullptr) {
+        *tableptr = nullptr;
+    }
+
+    Cache::Handle* handle = nullptr;
+    Status s = FindTable(file_number, file_size, &handle);
+    if (s != Ok) {
+        return new EmptyIterator(s);
+    }
+
+    Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    Iterator* result = table->NewIterator();
+    result->RegisterCleanup(&UnrefEntry, cache_, handle);
+    if (tableptr != nullptr) {
+        *tableptr = table;
+    }
+    return result;
+}
+
+Status TableCache::Get(uint64_t file_number, uint64_t file_size, const Slice& k, void* arg,
+                       void (*handle_result)(void*, const Slice&, const Slice&)) {
+    Cache::Handle* handle = nullptr;
+    Status s = FindTable(file_number, file_size, &handle);
+    if (s == Ok) {
+        Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+        s = t->InternalGet(k, arg, handle_result);
+        cache_->Release(handle);
+    }
+    return s;
+}
+
+Status TableCache::GetTable(uint64_t file_number, uint64_t file_size, TableHandle* table_handle) {
+    Cache::Handle* handle = nullptr;
+    Status s = FindTable(file_number, file_size, &handle);
+    if (s == Ok) {
+        table_handle->table_ = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+        table_handle->RegisterCleanup(&UnrefEntry, cache_, handle);
+    }
+    return s;
+}
+
+void TableCache::Evict(uint64_t file_number) {
+    char buf[sizeof(file_number)];
+    EncodeFixed64(buf, file_number);
+    cache_->Erase(Slice(buf, sizeof(buf)));
+}
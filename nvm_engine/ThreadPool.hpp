@@ -0,0 +1,64 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running queued jobs in order of submission.
+// Destroying the pool waits for the running jobs and drops queued ones.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads) : stop_(false) {
+        for (int i = 0; i < threads; ++i) {
+            threads_.push_back(std::thread(&ThreadPool::Run, this));
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> l(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (size_t i = 0; i < threads_.size(); ++i) {
+            threads_[i].join();
+        }
+    }
+
+    void Schedule(const std::function<void()>& job) {
+        {
+            std::lock_guard<std::mutex> l(mutex_);
+            queue_.push_back(job);
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void Run() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> l(mutex_);
+                cv_.wait(l, [this] { return stop_ || !queue_.empty(); });
+                if (stop_) {
+                    return;
+                }
+                job = queue_.front();
+                queue_.pop_front();
+            }
+            job();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+    std::deque<std::function<void()>> queue_;
+    std::vector<std::thread> threads_;
+
+    ThreadPool(const ThreadPool&);
+    void operator=(const ThreadPool&);
+};
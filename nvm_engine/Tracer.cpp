@@ -0,0 +1,147 @@
+#include "Tracer.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+static const char* const kOpNames[TRACE_OP_MAX] = { "get", "set" };
+
+static const char* const kStageNames[TRACE_STAGE_MAX] = {
+    "index", "read", "copy",
+    "index", "copy", "persist", "publish",
+};
+
+// Stages [first, last) belong to each operation.
+static const uint32_t kOpStages[TRACE_OP_MAX][2] = {
+    { TRACE_GET_INDEX, TRACE_GET_COPY + 1 },
+    { TRACE_SET_INDEX, TRACE_SET_PUBLISH + 1 },
+};
+
+static std::atomic<uint64_t> next_tracer_id_(1);
+
+thread_local Tracer::Active Tracer::active_;
+
+Tracer::Tracer(uint32_t sample_period)
+    : id_(next_tracer_id_++), sample_period_(sample_period), next_ring_(0) {
+    for (size_t i = 0; i < kMaxRings; ++i) {
+        rings_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+Tracer::~Tracer() {
+    for (size_t i = 0; i < kMaxRings; ++i) {
+        delete rings_[i].load(std::memory_order_relaxed);
+    }
+}
+
+// Like Statistics::Local, a few tracers per thread are cached, and a
+// thread that comes back to one after the cache dropped it finds its ring
+// again instead of taking another.
+Tracer::Ring* Tracer::Local() {
+    struct Cached {
+        uint64_t id;
+        Ring* ring;
+    };
+    static thread_local Cached cache[kCachedObjects];
+    static thread_local size_t next_victim = 0;
+    for (size_t i = 0; i < kCachedObjects; ++i) {
+        if (cache[i].id == id_) {
+            return cache[i].ring;
+        }
+    }
+    Cached* entry = &cache[next_victim++ % kCachedObjects];
+    entry->id = id_;
+    entry->ring = Claim();
+    return entry->ring;
+}
+
+Tracer::Ring* Tracer::Claim() {
+    static thread_local uint64_t thread_id = next_tracer_id_++;
+    size_t used = next_ring_.load(std::memory_order_acquire);
+    for (size_t i = 0; i < used && i < kMaxRings; ++i) {
+        Ring* ring = rings_[i].load(std::memory_order_acquire);
+        if (ring != nullptr && ring->owner == thread_id) {
+            return ring;
+        }
+    }
+    size_t i = next_ring_.fetch_add(1, std::memory_order_relaxed);
+    if (i >= kMaxRings) {
+        return nullptr;
+    }
+    Ring* ring = new Ring;
+    ring->owner = thread_id;
+    ring->written.store(0, std::memory_order_relaxed);
+    rings_[i].store(ring, std::memory_order_release);
+    return ring;
+}
+
+void Tracer::Commit() {
+    Active& a = active_;
+    a.on = false;
+    uint64_t end = __rdtsc();
+    Ring* ring = Local();
+    if (ring == nullptr) {
+        return;
+    }
+    uint64_t n = ring->written.load(std::memory_order_relaxed);
+    Sample& sample = ring->samples[n % kRingSize];
+    sample.op.store(a.op, std::memory_order_relaxed);
+    sample.total.store((uint32_t)std::min<uint64_t>(end - a.start, UINT32_MAX),
+                       std::memory_order_relaxed);
+    for (uint32_t s = 0; s < TRACE_STAGE_MAX; ++s) {
+        sample.cycles[s].store((uint32_t)std::min<uint64_t>(a.cycles[s], UINT32_MAX),
+                               std::memory_order_relaxed);
+    }
+    ring->written.store(n + 1, std::memory_order_release);
+}
+
+static void AppendStage(std::string* out, const char* name, std::vector<uint32_t>* v) {
+    uint64_t sum = 0;
+    for (uint32_t c : *v) {
+        sum += c;
+    }
+    size_t p99 = v->size() * 99 / 100;
+    std::nth_element(v->begin(), v->begin() + p99, v->end());
+    char buf[96];
+    snprintf(buf, sizeof(buf), " %s avg %llu p99 %u", name,
+             (unsigned long long)(sum / v->size()), (*v)[p99]);
+    *out += buf;
+}
+
+std::string Tracer::Summary() const {
+    std::string out;
+    for (uint32_t op = 0; op < TRACE_OP_MAX; ++op) {
+        std::vector<uint32_t> total;
+        std::vector<std::vector<uint32_t> > stages(TRACE_STAGE_MAX);
+        for (size_t i = 0; i < kMaxRings; ++i) {
+            const Ring* ring = rings_[i].load(std::memory_order_acquire);
+            if (ring == nullptr) {
+                continue;
+            }
+            uint64_t n = std::min<uint64_t>(ring->written.load(std::memory_order_acquire),
+                                            kRingSize);
+            for (uint64_t j = 0; j < n; ++j) {
+                const Sample& sample = ring->samples[j];
+                if (sample.op.load(std::memory_order_relaxed) != op) {
+                    continue;
+                }
+                total.push_back(sample.total.load(std::memory_order_relaxed));
+                for (uint32_t s = kOpStages[op][0]; s < kOpStages[op][1]; ++s) {
+                    stages[s].push_back(sample.cycles[s].load(std::memory_order_relaxed));
+                }
+            }
+        }
+        if (total.empty()) {
+            continue;
+        }
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s%s samples %zu cycles:", out.empty() ? "" : "\n",
+                 kOpNames[op], total.size());
+        out += buf;
+        for (uint32_t s = kOpStages[op][0]; s < kOpStages[op][1]; ++s) {
+            AppendStage(&out, kStageNames[s], &stages[s]);
+        }
+        AppendStage(&out, "total", &total);
+    }
+    return out;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <x86intrin.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum TraceOp : uint32_t {
+    TRACE_GET = 0,
+    TRACE_SET,
+    TRACE_OP_MAX
+};
+
+// Stages an operation's time is split into. A stage is charged the cycles
+// since the previous mark, so code between marks counts towards the stage
+// marked at its end, and a stage marked several times (a tag hit that
+// turns out to be another key) adds up.
+enum TraceStage : uint32_t {
+    // Get: probing the index buckets, reading the candidate record to
+    // compare keys (the first touch of pmem or of the inline record), and
+    // copying the value out.
+    TRACE_GET_INDEX = 0,
+    TRACE_GET_READ,
+    TRACE_GET_COPY,
+    // Set: locking the stripe and finding or claiming the slot, copying the
+    // record into the log, persisting it, and publishing the handle.
+    TRACE_SET_INDEX,
+    TRACE_SET_COPY,
+    TRACE_SET_PERSIST,
+    TRACE_SET_PUBLISH,
+    TRACE_STAGE_MAX
+};
+
+// Sampling tracer: one in every `sample_period` operations of a thread is
+// timed with rdtsc stage by stage. Finished samples go to a per-thread ring
+// of the most recent kRingSize samples, from which Summary() reports the
+// mean and p99 cycles per stage.
+//
+// An operation runs on one thread from Begin to End, so the sample in
+// progress lives in a thread-local and Mark can be called from anywhere
+// below, such as the log, without passing it down. Mark costs a
+// thread-local load and a branch when the operation is not sampled.
+class Tracer {
+public:
+    explicit Tracer(uint32_t sample_period);
+    ~Tracer();
+
+    void Begin(TraceOp op) {
+        if (sample_period_ == 0) {
+            return;
+        }
+        Active& a = active_;
+        if (a.countdown > 1) {
+            a.countdown--;
+            return;
+        }
+        a.countdown = sample_period_;
+        a.on = true;
+        a.op = op;
+        for (uint32_t s = 0; s < TRACE_STAGE_MAX; ++s) {
+            a.cycles[s] = 0;
+        }
+        a.start = a.last = __rdtsc();
+    }
+
+    static void Mark(TraceStage stage) {
+        Active& a = active_;
+        if (a.on) {
+            uint64_t now = __rdtsc();
+            a.cycles[stage] += now - a.last;
+            a.last = now;
+        }
+    }
+
+    void End() {
+        if (active_.on) {
+            Commit();
+        }
+    }
+
+    // One line per operation type with samples, or "" if there are none.
+    std::string Summary() const;
+
+private:
+    static const size_t kRingSize = 1024;
+    static const size_t kMaxRings = 256;
+    static const size_t kCachedObjects = 8;
+
+    struct Active {
+        bool on;
+        TraceOp op;
+        uint32_t countdown;
+        uint64_t start;
+        uint64_t last;
+        uint64_t cycles[TRACE_STAGE_MAX];
+    };
+
+    // Samples are written by the ring's thread while Summary may read them;
+    // relaxed atomics keep that well defined, a sample read while being
+    // overwritten is merely inaccurate.
+    struct Sample {
+        std::atomic<uint32_t> op;
+        std::atomic<uint32_t> total;
+        std::atomic<uint32_t> cycles[TRACE_STAGE_MAX];
+    };
+
+    struct Ring {
+        // The thread the ring belongs to.
+        uint64_t owner;
+        std::atomic<uint64_t> written;
+        Sample samples[kRingSize];
+    };
+
+    void Commit();
+    Ring* Local();
+    Ring* Claim();
+
+    static thread_local Active active_;
+
+    const uint64_t id_;
+    const uint32_t sample_period_;
+    std::atomic<size_t> next_ring_;
+    // Allocated by the thread that claims the slot; threads past kMaxRings
+    // are not traced.
+    std::atomic<Ring*> rings_[kMaxRings];
+
+    Tracer(const Tracer&);
+    void operator=(const Tracer&);
+};
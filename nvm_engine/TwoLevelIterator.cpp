@@ -0,0 +1,146 @@
+#include "TwoLevelIterator.hpp"
+
+#include <string>
+
+namespace {
+
+class TwoLevelIterator : public Iterator {
+public:
+    TwoLevelIterator(Iterator* index_iter, BlockFunction block_function, void* arg)
+        : block_function_(block_function),
+          arg_(arg),
+          index_iter_(index_iter),
+          data_iter_(nullptr),
+          status_(Ok) {}
+
+    ~TwoLevelIterator() override {
+        delete data_iter_;
+        delete index_iter_;
+    }
+
+    bool Valid() const override {
+        return data_iter_ != nullptr && data_iter_->Valid();
+    }
+
+    Slice key() override {
+        return data_iter_->key();
+    }
+
+    Slice value() override {
+        return data_iter_->value();
+    }
+
+    Status status() const override {
+        if (index_iter_->status() != Ok) {
+            return index_iter_->status();
+        }
+        if (data_iter_ != nullptr && data_iter_->status() != Ok) {
+            return data_iter_->status();
+        }
+        return status_;
+    }
+
+    void Seek(const Slice& target) override {
+        index_iter_->Seek(target);
+        InitDataBlock();
+        if (data_iter_ != nullptr) {
+            data_iter_->Seek(target);
+        }
+        SkipEmptyDataBlocksForward();
+    }
+
+    void SeekToFirst() override {
+        index_iter_->SeekToFirst();
+        InitDataBlock();
+        if (data_iter_ != nullptr) {
+            data_iter_->SeekToFirst();
+        }
+        SkipEmptyDataBlocksForward();
+    }
+
+    void SeekToLast() override {
+        index_iter_->SeekToLast();
+        InitDataBlock();
+        if (data_iter_ != nullptr) {
+            data_iter_->SeekToLast();
+        }
+        SkipEmptyDataBlocksBackward();
+    }
+
+    void Next() override {
+        data_iter_->Next();
+        SkipEmptyDataBlocksForward();
+    }
+
+    void Prev() override {
+        data_iter_->Prev();
+        SkipEmptyDataBlocksBackward();
+    }
+
+private:
+    void SkipEmptyDataBlocksForward() {
+        while (data_iter_ == nullptr || !data_iter_->Valid()) {
+            if (!index_iter_->Valid()) {
+                SetDataIterator(nullptr);
+                return;
+            }
+            index_iter_->Next();
+            InitDataBlock();
+            if (data_iter_ != nullptr) {
+                data_iter_->SeekToFirst();
+            }
+        }
+    }
+
+    void SkipEmptyDataBlocksBackward() {
+        while (data_iter_ == nullptr || !data_iter_->Valid()) {
+            if (!index_iter_->Valid()) {
+                SetDataIterator(nullptr);
+                return;
+            }
+            index_iter_->Prev();
+            InitDataBlock();
+            if (data_iter_ != nullptr) {
+                data_iter_->SeekToLast();
+            }
+        }
+    }
+
+    void SetDataIterator(Iterator* data_iter) {
+        if (data_iter_ != nullptr && data_iter_->status() != Ok && status_ == Ok) {
+            status_ = data_iter_->status();
+        }
+        delete data_iter_;
+        data_iter_ = data_iter;
+    }
+
+    void InitDataBlock() {
+        if (!index_iter_->Valid()) {
+            SetDataIterator(nullptr);
+            return;
+        }
+        Slice handle = index_iter_->value();
+        if (data_iter_ != nullptr && handle.size() == data_block_handle_.size() &&
+            memcmp(handle.data(), data_block_handle_.data(), handle.size()) == 0) {
+            // The data iterator is already positioned on this block.
+            return;
+        }
+        Iterator* iter = (*block_function_)(arg_, handle);
+        data_block_handle_.assign(handle.data(), handle.size());
+        SetDataIterator(iter);
+    }
+
+    BlockFunction block_function_;
+    void* arg_;
+    Iterator* index_iter_;
+    Iterator* data_iter_;  // May be nullptr
+    Status status_;
+    // The index value data_iter_ was opened from.
+    std::string data_block_handle_;
+};
+
+}  // namespace
+
+Iterator* NewTwoLevelIterator(Iterator* index_iter, BlockFunction block_function, void* arg) {
+    return new TwoLevelIterator(index_iter, block_function, arg);
+}
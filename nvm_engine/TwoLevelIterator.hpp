@@ -0,0 +1,11 @@
+#pragma once
+
+#include "Iterator.hpp"
+
+// Opens the block an index entry's value points at.
+typedef Iterator* (*BlockFunction)(void* arg, const Slice& index_value);
+
+// Iterates over the concatenation of the blocks that `index_iter` points
+// at, opening each with `block_function(arg, index_iter->value())`. Takes
+// ownership of `index_iter`.
+Iterator* NewTwoLevelIterator(Iterator* index_iter, BlockFunction block_function, void* arg);
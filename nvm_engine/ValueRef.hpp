@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+struct KVSHdr {
+    unsigned char encoding;
+};
+
+struct KVSRef {
+    //指定插入值的编码
+    struct KVSHdr hdr;
+
+    unsigned int size;
+    unsigned int pool_index;
+
+    //pmem池中的偏移
+    size_t off_in_pool;
+};
+
+enum ValueEncoding {
+    kEncodingRawCompressed = 0x0,
+    kEncodingRawUncompressed = 0x01,
+    kEncodingPtrCompressed = 0x02,
+    kEncodingPtrUncompressed = 0x03,
+    kEncodingUnknown
+};
+
+// What a log record or a table entry says about its key. A deletion is a
+// tombstone that hides older values of the key until the GC drops it.
+enum RecordType : uint8_t {
+    kTypeDeletion = 0,
+    kTypeValue = 1
+};
+
+// Expiry times are in seconds since the epoch; 0 means never.
+inline uint32_t NowSeconds() {
+    return (uint32_t)time(nullptr);
+}
+
+inline bool IsExpired(uint32_t expire, uint32_t now) {
+    return expire != 0 && expire <= now;
+}
+
+// A value handle is the 32-bit word the DRAM index keeps per key. The top
+// two bits say where the value is:
+//   0x: kEncodingPtrUncompressed, the low 31 bits are the location of a
+//       record in the pmem log, in kLocationUnit units, which addresses
+//       128GB.
+//   10: kEncodingRawUncompressed, the low 30 bits are a location in the DRAM
+//       arena that holds the key and the value inline.
+//   11: a slot handle (see IsSlotHandle), the low 30 bits are a slot
+//       number in the pmem store of fixed-size records.
+// Zero means "no value"; the two largest slot numbers are reserved for the
+// index's own bookkeeping.
+typedef uint32_t ValueHandle;
+
+static const int kLocationShift = 6;
+static const size_t kLocationUnit = 1UL << kLocationShift;
+static const uint32_t kHandleInlineBit = 1U << 31;
+static const uint32_t kHandleSlotBit = 1U << 30;
+static const uint32_t kHandleLocationMask = kHandleInlineBit - 1;
+static const uint32_t kHandleSlotMask = kHandleSlotBit - 1;
+static const size_t kMaxLocationSpace = (size_t)kHandleLocationMask << kLocationShift;
+static const size_t kMaxInlineSpace = (size_t)kHandleSlotMask << kLocationShift;
+static const uint32_t kMaxSlots = kHandleSlotMask - 1;
+
+inline bool IsSlotHandle(ValueHandle handle) {
+    return (handle & (kHandleInlineBit | kHandleSlotBit)) == (kHandleInlineBit | kHandleSlotBit);
+}
+
+inline ValueEncoding HandleEncoding(ValueHandle handle) {
+    return (handle & kHandleInlineBit) && !(handle & kHandleSlotBit) ? kEncodingRawUncompressed
+                                                                     : kEncodingPtrUncompressed;
+}
+
+// The log or inline location of a handle that is not a slot handle.
+inline uint32_t HandleLocation(ValueHandle handle) {
+    return handle & ((handle & kHandleInlineBit) ? kHandleSlotMask : kHandleLocationMask);
+}
+
+inline uint32_t HandleSlot(ValueHandle handle) {
+    return handle & kHandleSlotMask;
+}
+
+inline ValueHandle EncodePmemHandle(uint32_t location) {
+    return location;
+}
+
+inline ValueHandle EncodeInlineHandle(uint32_t location) {
+    return kHandleInlineBit | location;
+}
+
+inline ValueHandle EncodeSlotHandle(uint32_t slot) {
+    return kHandleInlineBit | kHandleSlotBit | slot;
+}
@@ -0,0 +1,689 @@
+#include "VersionSet.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "Coding.hpp"
+#include "Hash.hpp"
+#include "MergingIterator.hpp"
+
+static const uint64_t kManifestMagic = 0x7473666e616d766eULL;
+
+static std::string ManifestFileName(const std::string& dbname) {
+    return dbname + "/MANIFEST";
+}
+
+static Slice ToSlice(const std::string& s) {
+    return Slice(const_cast<char*>(s.data()), s.size());
+}
+
+// Number of a table file name as written by TableFileName, or 0.
+static uint64_t ParseTableFileName(const std::string& name) {
+    if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".sst") != 0) {
+        return 0;
+    }
+    uint64_t number = 0;
+    for (size_t i = 0; i < name.size() - 4; ++i) {
+        if (name[i] < '0' || name[i] > '9') {
+            return 0;
+        }
+        number = number * 10 + (name[i] - '0');
+    }
+    return number;
+}
+
+void AppendTableValue(std::string* dst, RecordType type, uint32_t expire, const Slice& value) {
+    dst->push_back((char)(expire != 0 ? type | kTagExpires : type));
+    if (expire != 0) {
+        PutFixed32(dst, expire);
+    }
+    dst->append(value.data(), value.size());
+}
+
+bool ParseTableValue(const Slice& input, RecordType* type, uint32_t* expire, Slice* value) {
+    if (input.size() < 1) {
+        return false;
+    }
+    uint8_t tag = (uint8_t)input.data()[0];
+    size_t header = 1;
+    *expire = 0;
+    if (tag & kTagExpires) {
+        if (input.size() < 5) {
+            return false;
+        }
+        *expire = DecodeFixed32(input.data() + 1);
+        header = 5;
+    }
+    *type = (RecordType)(tag & ~kTagExpires);
+    if (*type != kTypeDeletion && *type != kTypeValue) {
+        return false;
+    }
+    *value = Slice(input.data() + header, input.size() - header);
+    return true;
+}
+
+VersionSet::VersionSet(const std::string& dbname, const Options& options,
+                       TableCache* table_cache, Statistics* statistics)
+    : env_(Env::Default()),
+      dbname_(dbname),
+      options_(options),
+      table_cache_(table_cache),
+      statistics_(statistics),
+      current_(std::make_shared<Version>()),
+      next_file_number_(1),
+      flushed_generation_(0) {}
+
+VersionSet::~VersionSet() {
+    std::lock_guard<std::mutex> l(mutex_);
+    RemoveObsoleteFiles();
+}
+
+Status VersionSet::Recover() {
+    Status s = env_->CreateDir(dbname_);
+    if (s != Ok) {
+        return s;
+    }
+
+    std::shared_ptr<Version> v = std::make_shared<Version>();
+    uint64_t size;
+    s = env_->GetFileSize(ManifestFileName(dbname_), &size);
+    if (s == Ok) {
+        FileOptions file_options;
+        file_options.use_mmap = false;
+        file_options.access = kAccessSequential;
+        RandomAccessFile* file = nullptr;
+        s = env_->NewRandomAccessFile(ManifestFileName(dbname_), file_options, &file);
+        if (s != Ok) {
+            return s;
+        }
+        std::string contents(size, '\0');
+        Slice input;
+        s = file->Read(0, size, &input, &contents[0]);
+        delete file;
+        if (s != Ok) {
+            return s;
+        }
+        if (input.size() != size || size < 12 ||
+            DecodeFixed32(input.data() + size - 4) != Crc32c(input.data(), size - 4)) {
+            return IOError;
+        }
+        input = Slice(input.data(), size - 4);
+        if (DecodeFixed64(input.data()) != kManifestMagic) {
+            return IOError;
+        }
+        input = Slice(input.data() + 8, input.size() - 8);
+        if (!GetVarint64(&input, &next_file_number_)) {
+            return IOError;
+        }
+        for (int level = 0; level < kNumLevels; ++level) {
+            uint32_t count;
+            if (!GetVarint32(&input, &count)) {
+                return IOError;
+            }
+            for (uint32_t i = 0; i < count; ++i) {
+                std::shared_ptr<FileMetaData> f = std::make_shared<FileMetaData>();
+                Slice smallest, largest;
+                if (!GetVarint64(&input, &f->number) || !GetVarint64(&input, &f->file_size) ||
+                    !GetLengthPrefixedSlice(&input, &smallest) ||
+                    !GetLengthPrefixedSlice(&input, &largest)) {
+                    return IOError;
+                }
+                f->smallest = smallest.to_string();
+                f->largest = largest.to_string();
+                v->files[level].push_back(f);
+                files_.insert(f->number);
+            }
+        }
+        // Absent from MANIFESTs written before flushes recorded it.
+        if (input.size() > 0 && !GetVarint64(&input, &flushed_generation_)) {
+            return IOError;
+        }
+    } else if (s != NotFound) {
+        return s;
+    }
+
+    // Tables written after the MANIFEST was last replaced are not in any
+    // version; their data is still in the log.
+    std::vector<std::string> children;
+    s = env_->GetChildren(dbname_, &children);
+    if (s != Ok) {
+        return s;
+    }
+    for (size_t i = 0; i < children.size(); ++i) {
+        uint64_t number = ParseTableFileName(children[i]);
+        if (number != 0 && files_.count(number) == 0) {
+            env_->RemoveFile(dbname_ + "/" + children[i]);
+        }
+        if (number >= next_file_number_) {
+            next_file_number_ = number + 1;
+        }
+    }
+
+    std::shared_ptr<const Version> installed(v);
+    std::atomic_store(&current_, installed);
+    versions_.push_back(installed);
+    return Ok;
+}
+
+// Index of the first table of a sorted level whose largest key is >= key,
+// the only one that may hold it.
+static size_t FindFile(const Comparator* ucmp, const std::vector<FileRef>& files,
+                       const Slice& key) {
+    size_t lo = 0, hi = files.size();
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (ucmp->Compare(ToSlice(files[mid]->largest), key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+namespace {
+
+struct Saver {
+    const Comparator* comparator;
+    Slice key;
+    std::string* value;
+    bool found;
+    // What was found: a value, or NotFound for a deletion or an expired
+    // value, or IOError for a malformed entry.
+    Status status;
+};
+
+void SaveValue(void* arg, const Slice& k, const Slice& v) {
+    Saver* saver = reinterpret_cast<Saver*>(arg);
+    if (saver->comparator->Compare(k, saver->key) != 0) {
+        return;
+    }
+    saver->found = true;
+    RecordType type;
+    uint32_t expire;
+    Slice value;
+    if (!ParseTableValue(v, &type, &expire, &value)) {
+        saver->status = IOError;
+    } else if (type == kTypeDeletion || IsExpired(expire, NowSeconds())) {
+        saver->status = NotFound;
+    } else {
+        saver->value->assign(value.data(), value.size());
+        saver->status = Ok;
+    }
+}
+
+}  // namespace
+
+Status VersionSet::Get(const Slice& key, std::string* value) {
+    std::shared_ptr<const Version> v = current();
+    const Comparator* ucmp = options_.comparator;
+    Saver saver;
+    saver.comparator = ucmp;
+    saver.key = key;
+    saver.value = value;
+    saver.found = false;
+    saver.status = NotFound;
+
+    for (int level = 0; level < kNumLevels; ++level) {
+        const std::vector<FileRef>& files = v->files[level];
+        size_t begin = 0, end = files.size();
+        if (level > 0) {
+            begin = FindFile(ucmp, files, key);
+            end = std::min(begin + 1, files.size());
+        }
+        for (size_t i = begin; i < end; ++i) {
+            const FileMetaData& f = *files[i];
+            if (ucmp->Compare(key, ToSlice(f.smallest)) < 0 ||
+                ucmp->Compare(key, ToSlice(f.largest)) > 0) {
+                continue;
+            }
+            Status s = table_cache_->Get(f.number, f.file_size, key, &saver, &SaveValue);
+            if (s != Ok) {
+                return s;
+            }
+            if (saver.found) {
+                return saver.status;
+            }
+        }
+    }
+    return NotFound;
+}
+
+Status VersionSet::FinishTable(Status s, TableBuilder* builder, WritableFile* file,
+                               FileMetaData* meta) {
+    if (s == Ok) {
+        s = builder->Finish();
+    } else {
+        builder->Abandon();
+    }
+    meta->file_size = builder->FileSize();
+    delete builder;
+    if (s == Ok) {
+        s = file->Sync();
+    }
+    Status close = file->Close();
+    if (s == Ok) {
+        s = close;
+    }
+    delete file;
+    if (s != Ok) {
+        env_->RemoveFile(TableFileName(dbname_, meta->number));
+        std::lock_guard<std::mutex> l(mutex_);
+        pending_.erase(meta->number);
+        files_.erase(meta->number);
+    }
+    return s;
+}
+
+Status VersionSet::WriteTables(Iterator* input, const Version& base, int base_level,
+                               RateLimiter* limiter, const std::atomic<bool>* stop,
+                               std::vector<FileRef>* outputs) {
+    const Comparator* ucmp = options_.comparator;
+    const uint32_t now = NowSeconds();
+    std::vector<FileRef> written;
+    std::shared_ptr<FileMetaData> meta;
+    WritableFile* file = nullptr;
+    TableBuilder* builder = nullptr;
+    std::string last_key;
+    bool has_last = false;
+    std::string deletion;
+    AppendTableValue(&deletion, kTypeDeletion, 0, Slice());
+    uint64_t dropped = 0;
+    Status s = Ok;
+
+    for (input->SeekToFirst(); s == Ok && input->Valid(); input->Next()) {
+        Slice key = input->key();
+        if (has_last && ucmp->Compare(key, ToSlice(last_key)) == 0) {
+            continue;
+        }
+        last_key.assign(key.data(), key.size());
+        has_last = true;
+
+        Slice value = input->value();
+        RecordType type;
+        uint32_t expire;
+        Slice user_value;
+        if (!ParseTableValue(value, &type, &expire, &user_value)) {
+            s = IOError;
+            break;
+        }
+        if (type == kTypeDeletion || IsExpired(expire, now)) {
+            if (IsBaseLevelForKey(base, base_level, key)) {
+                ++dropped;
+                continue;
+            }
+            value = ToSlice(deletion);
+        }
+
+        if (builder == nullptr) {
+            if (stop != nullptr && stop->load(std::memory_order_relaxed)) {
+                s = IOError;
+                break;
+            }
+            meta = std::make_shared<FileMetaData>();
+            {
+                std::lock_guard<std::mutex> l(mutex_);
+                meta->number = next_file_number_++;
+                files_.insert(meta->number);
+                pending_.insert(meta->number);
+            }
+            s = env_->NewWritableFile(TableFileName(dbname_, meta->number), &file);
+            if (s != Ok) {
+                std::lock_guard<std::mutex> l(mutex_);
+                pending_.erase(meta->number);
+                files_.erase(meta->number);
+                break;
+            }
+            if (limiter != nullptr) {
+                file = new RateLimitedFile(file, limiter);
+            }
+            builder = new TableBuilder(options_, file);
+            meta->smallest = last_key;
+        }
+        builder->Add(key, value);
+        meta->largest = last_key;
+        if (builder->FileSize() >= options_.target_file_size) {
+            s = FinishTable(builder->status(), builder, file, meta.get());
+            builder = nullptr;
+            file = nullptr;
+            if (s == Ok) {
+                written.push_back(meta);
+            }
+        }
+    }
+    if (s == Ok) {
+        s = input->status();
+    }
+    if (builder != nullptr) {
+        s = FinishTable(s == Ok ? builder->status() : s, builder, file, meta.get());
+        if (s == Ok) {
+            written.push_back(meta);
+        }
+    }
+    if (s != Ok) {
+        DropTables(written);
+        return s;
+    }
+    outputs->insert(outputs->end(), written.begin(), written.end());
+    RecordTick(statistics_, TOMBSTONES_DROPPED, dropped);
+    return Ok;
+}
+
+void VersionSet::DropTables(const std::vector<FileRef>& tables) {
+    std::lock_guard<std::mutex> l(mutex_);
+    for (size_t i = 0; i < tables.size(); ++i) {
+        pending_.erase(tables[i]->number);
+    }
+    RemoveObsoleteFiles();
+}
+
+uint64_t VersionSet::flushed_generation() {
+    std::lock_guard<std::mutex> l(mutex_);
+    return flushed_generation_;
+}
+
+Status VersionSet::WriteManifest(const Version& v, uint64_t flushed_generation) {
+    std::string record;
+    PutFixed64(&record, kManifestMagic);
+    PutVarint64(&record, next_file_number_);
+    for (int level = 0; level < kNumLevels; ++level) {
+        PutVarint32(&record, (uint32_t)v.files[level].size());
+        for (size_t i = 0; i < v.files[level].size(); ++i) {
+            const FileMetaData& f = *v.files[level][i];
+            PutVarint64(&record, f.number);
+            PutVarint64(&record, f.file_size);
+            PutLengthPrefixedSlice(&record, ToSlice(f.smallest));
+            PutLengthPrefixedSlice(&record, ToSlice(f.largest));
+        }
+    }
+    PutVarint64(&record, flushed_generation);
+    PutFixed32(&record, Crc32c(record.data(), record.size()));
+
+    // The MANIFEST is small, so it is rewritten whole and renamed into
+    // place; a crash leaves either the old or the new one.
+    std::string tmp = ManifestFileName(dbname_) + ".tmp";
+    WritableFile* file = nullptr;
+    Status s = env_->NewWritableFile(tmp, &file);
+    if (s != Ok) {
+        return s;
+    }
+    s = file->Append(ToSlice(record));
+    if (s == Ok) {
+        s = file->Sync();
+    }
+    Status close = file->Close();
+    if (s == Ok) {
+        s = close;
+    }
+    delete file;
+    if (s == Ok) {
+        s = env_->RenameFile(tmp, ManifestFileName(dbname_));
+    }
+    if (s != Ok) {
+        env_->RemoveFile(tmp);
+    }
+    return s;
+}
+
+Status VersionSet::LogAndApply(const VersionEdit& edit) {
+    std::lock_guard<std::mutex> l(mutex_);
+    std::shared_ptr<const Version> base = current();
+    std::shared_ptr<Version> v = std::make_shared<Version>(*base);
+    const Comparator* ucmp = options_.comparator;
+
+    for (size_t i = 0; i < edit.deleted.size(); ++i) {
+        std::vector<FileRef>& files = v->files[edit.deleted[i].first];
+        for (size_t j = 0; j < files.size(); ++j) {
+            if (files[j]->number == edit.deleted[i].second) {
+                files.erase(files.begin() + j);
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < edit.added.size(); ++i) {
+        int level = edit.added[i].first;
+        const FileRef& f = edit.added[i].second;
+        std::vector<FileRef>& files = v->files[level];
+        if (level == 0) {
+            // Newest first. An edit adds the tables of one flush, which are
+            // disjoint, so their relative order does not matter.
+            files.insert(files.begin(), f);
+        } else {
+            Slice smallest = ToSlice(f->smallest);
+            std::vector<FileRef>::iterator pos = std::lower_bound(
+                files.begin(), files.end(), smallest, [ucmp](const FileRef& a, const Slice& b) {
+                    return ucmp->Compare(ToSlice(a->smallest), b) < 0;
+                });
+            files.insert(pos, f);
+        }
+    }
+
+    uint64_t flushed_generation = std::max(flushed_generation_, edit.flushed_generation);
+    Status s = WriteManifest(*v, flushed_generation);
+    for (size_t i = 0; i < edit.added.size(); ++i) {
+        pending_.erase(edit.added[i].second->number);
+    }
+    if (s == Ok) {
+        flushed_generation_ = flushed_generation;
+        std::shared_ptr<const Version> installed(v);
+        std::atomic_store(&current_, installed);
+        versions_.push_back(installed);
+    }
+    RemoveObsoleteFiles();
+    return s;
+}
+
+// Caller holds mutex_.
+void VersionSet::RemoveObsoleteFiles() {
+    std::set<uint64_t> live;
+    std::vector<std::shared_ptr<const Version>> in_use;
+    in_use.push_back(current());
+    size_t kept = 0;
+    for (size_t i = 0; i < versions_.size(); ++i) {
+        std::shared_ptr<const Version> v = versions_[i].lock();
+        if (v) {
+            in_use.push_back(v);
+            versions_[kept++] = versions_[i];
+        }
+    }
+    versions_.resize(kept);
+    for (size_t i = 0; i < in_use.size(); ++i) {
+        for (int level = 0; level < kNumLevels; ++level) {
+            for (size_t j = 0; j < in_use[i]->files[level].size(); ++j) {
+                live.insert(in_use[i]->files[level][j]->number);
+            }
+        }
+    }
+
+    for (std::set<uint64_t>::iterator it = files_.begin(); it != files_.end();) {
+        uint64_t number = *it;
+        if (live.count(number) == 0 && pending_.count(number) == 0) {
+            table_cache_->Evict(number);
+            env_->RemoveFile(TableFileName(dbname_, number));
+            files_.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+uint64_t VersionSet::MaxBytesForLevel(int level) const {
+    uint64_t result = options_.max_bytes_for_level_base;
+    for (int i = 1; i < level; ++i) {
+        result *= options_.max_bytes_for_level_multiplier;
+    }
+    return result;
+}
+
+int VersionSet::PickLevel(const Version& v) const {
+    int best = -1;
+    double best_score = 1;
+    for (int level = 0; level < kNumLevels - 1; ++level) {
+        double score;
+        if (level == 0) {
+            score = (double)v.files[0].size() / std::max(1, options_.level0_compaction_trigger);
+        } else {
+            uint64_t bytes = 0;
+            for (size_t i = 0; i < v.files[level].size(); ++i) {
+                bytes += v.files[level][i]->file_size;
+            }
+            score = (double)bytes / MaxBytesForLevel(level);
+        }
+        if (score >= best_score) {
+            best = level;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+bool VersionSet::NeedsCompaction() const {
+    return PickLevel(*current()) >= 0;
+}
+
+bool VersionSet::IsBaseLevelForKey(const Version& v, int level, const Slice& key) const {
+    const Comparator* ucmp = options_.comparator;
+    for (; level < kNumLevels; ++level) {
+        const std::vector<FileRef>& files = v.files[level];
+        size_t begin = 0, end = files.size();
+        if (level > 0) {
+            begin = FindFile(ucmp, files, key);
+            end = std::min(begin + 1, files.size());
+        }
+        for (size_t i = begin; i < end; ++i) {
+            if (ucmp->Compare(key, ToSlice(files[i]->smallest)) >= 0 &&
+                ucmp->Compare(key, ToSlice(files[i]->largest)) <= 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void VersionSet::GetOverlappingInputs(const Version& v, int level, const Slice& smallest,
+                                      const Slice& largest, std::vector<FileRef>* inputs) const {
+    const Comparator* ucmp = options_.comparator;
+    for (size_t i = 0; i < v.files[level].size(); ++i) {
+        const FileRef& f = v.files[level][i];
+        if (ucmp->Compare(ToSlice(f->largest), smallest) < 0 ||
+            ucmp->Compare(ToSlice(f->smallest), largest) > 0) {
+            continue;
+        }
+        inputs->push_back(f);
+    }
+}
+
+static void DeleteCompactionTable(void* table, void* file) {
+    delete reinterpret_cast<Table*>(table);
+    delete reinterpret_cast<RandomAccessFile*>(file);
+}
+
+Iterator* VersionSet::NewCompactionIterator(const FileMetaData& f) {
+    FileOptions file_options;
+    file_options.use_mmap = options_.use_mmap_reads;
+    file_options.access = kAccessSequential;
+    RandomAccessFile* file = nullptr;
+    Status s = env_->NewRandomAccessFile(TableFileName(dbname_, f.number), file_options, &file);
+    if (s != Ok) {
+        return new EmptyIterator(s);
+    }
+    // Blocks read once must not push the hot ones out of the cache.
+    Options table_options = options_;
+    table_options.block_cache = nullptr;
+    Table* table = nullptr;
+    s = Table::Open(table_options, file, f.number, f.file_size, &table);
+    if (s != Ok) {
+        delete file;
+        return new EmptyIterator(s);
+    }
+    Iterator* iter = table->NewIterator();
+    iter->RegisterCleanup(&DeleteCompactionTable, table, file);
+    return iter;
+}
+
+Status VersionSet::CompactOnce(RateLimiter* limiter, const std::atomic<bool>* stop) {
+    std::shared_ptr<const Version> base = current();
+    int level = PickLevel(*base);
+    if (level < 0) {
+        return Ok;
+    }
+    const Comparator* ucmp = options_.comparator;
+
+    // Level 0 tables overlap, so all of them go in; from a sorted level the
+    // table after the last one compacted does.
+    std::vector<FileRef> inputs[2];
+    if (level == 0) {
+        inputs[0] = base->files[0];
+    } else {
+        const std::vector<FileRef>& files = base->files[level];
+        size_t pick = 0;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (compact_pointer_[level].empty() ||
+                ucmp->Compare(ToSlice(files[i]->largest), ToSlice(compact_pointer_[level])) > 0) {
+                pick = i;
+                break;
+            }
+        }
+        inputs[0].push_back(files[pick]);
+    }
+
+    std::string smallest = inputs[0][0]->smallest;
+    std::string largest = inputs[0][0]->largest;
+    for (size_t i = 1; i < inputs[0].size(); ++i) {
+        if (ucmp->Compare(ToSlice(inputs[0][i]->smallest), ToSlice(smallest)) < 0) {
+            smallest = inputs[0][i]->smallest;
+        }
+        if (ucmp->Compare(ToSlice(inputs[0][i]->largest), ToSlice(largest)) > 0) {
+            largest = inputs[0][i]->largest;
+        }
+    }
+    GetOverlappingInputs(*base, level + 1, ToSlice(smallest), ToSlice(largest), &inputs[1]);
+    compact_pointer_[level] = largest;
+
+    VersionEdit edit;
+    for (int which = 0; which < 2; ++which) {
+        for (size_t i = 0; i < inputs[which].size(); ++i) {
+            edit.deleted.push_back(std::make_pair(level + which, inputs[which][i]->number));
+        }
+    }
+
+    // A table that overlaps nothing below moves down without a rewrite.
+    if (level > 0 && inputs[0].size() == 1 && inputs[1].empty()) {
+        edit.added.push_back(std::make_pair(level + 1, inputs[0][0]));
+        RecordTick(statistics_, COMPACTION_TRIVIAL_MOVES);
+        return LogAndApply(edit);
+    }
+
+    // Newer tables come first, so that the merge yields their value of a
+    // key first and WriteTables keeps that one.
+    std::vector<Iterator*> children;
+    uint64_t bytes_read = 0;
+    for (int which = 0; which < 2; ++which) {
+        for (size_t i = 0; i < inputs[which].size(); ++i) {
+            children.push_back(NewCompactionIterator(*inputs[which][i]));
+            bytes_read += inputs[which][i]->file_size;
+        }
+    }
+    Iterator* merged = NewMergingIterator(ucmp, &children[0], (int)children.size());
+    std::vector<FileRef> outputs;
+    // Tables below the output level hold older values, which deletions
+    // must keep shadowing.
+    Status s = WriteTables(merged, *base, level + 2, limiter, stop, &outputs);
+    delete merged;
+    if (s != Ok) {
+        return stop != nullptr && stop->load(std::memory_order_relaxed) ? Ok : s;
+    }
+
+    uint64_t bytes_written = 0;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        edit.added.push_back(std::make_pair(level + 1, outputs[i]));
+        bytes_written += outputs[i]->file_size;
+    }
+    s = LogAndApply(edit);
+    if (s == Ok) {
+        RecordTick(statistics_, COMPACTIONS);
+        RecordTick(statistics_, COMPACTION_BYTES_READ, bytes_read);
+        RecordTick(statistics_, COMPACTION_BYTES_WRITTEN, bytes_written);
+    }
+    return s;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "include/db.hpp"
+#include "Env.hpp"
+#include "Iterator.hpp"
+#include "Options.hpp"
+#include "RateLimiter.hpp"
+#include "Statistics.hpp"
+#include "Table.hpp"
+#include "TableBuilder.hpp"
+#include "ValueRef.hpp"
+
+static const int kNumLevels = 4;
+
+// A table file and the range of keys in it.
+struct FileMetaData {
+    uint64_t number;
+    uint64_t file_size;
+    std::string smallest;
+    std::string largest;
+};
+
+typedef std::shared_ptr<const FileMetaData> FileRef;
+
+// Table values start with a RecordType byte. A value that expires has
+// kTagExpires set in it and its expiry time as a fixed32 after it.
+static const uint8_t kTagExpires = 0x80;
+
+void AppendTableValue(std::string* dst, RecordType type, uint32_t expire, const Slice& value);
+
+// Returns false if `input` is not a well-formed table value.
+bool ParseTableValue(const Slice& input, RecordType* type, uint32_t* expire, Slice* value);
+
+// An immutable set of tables, as in leveldb. Level 0 holds the outputs of
+// log flushes, newest first; they may overlap each other. Every deeper
+// level is a sorted run of disjoint tables ordered by key. A key's newest
+// value is in the first table that has it, searching level 0 first.
+struct Version {
+    std::vector<FileRef> files[kNumLevels];
+};
+
+// Tables added to and removed from a version. A flush also moves up the
+// generation of the newest log segment whose records are now in tables,
+// which recovery skips; 0 leaves it as it was.
+struct VersionEdit {
+    std::vector<std::pair<int, FileRef>> added;
+    std::vector<std::pair<int, uint64_t>> deleted;
+    uint64_t flushed_generation = 0;
+};
+
+// The sorted-table tier: the current Version, the MANIFEST that makes it
+// durable, and the compactions that keep the levels in shape.
+//
+// Readers take the current version with current() and keep its tables for
+// as long as they hold it. Edits are serialised by a mutex; compactions are
+// not, and callers run at most one at a time.
+class VersionSet {
+public:
+    // Keeps the tables in directory `dbname`, read through `table_cache`.
+    VersionSet(const std::string& dbname, const Options& options, TableCache* table_cache,
+               Statistics* statistics);
+    ~VersionSet();
+
+    // Loads the MANIFEST, if there is one, and removes tables it does not
+    // list, left behind by a crash.
+    Status Recover();
+
+    std::shared_ptr<const Version> current() const {
+        return std::atomic_load(&current_);
+    }
+
+    // The newest log segment generation a flush has installed the tables
+    // of, 0 if none.
+    uint64_t flushed_generation();
+
+    // Looks `key` up in the current version. A deleted or expired key is
+    // NotFound.
+    Status Get(const Slice& key, std::string* value);
+
+    // Writes the entries of `input`, which must be sorted and hold table
+    // values, to new tables of about target_file_size bytes. Of equal keys
+    // only the first is kept. A deletion or an expired value is dropped if
+    // no table of `base` at `base_level` or deeper may hold an older value
+    // of its key, and an expired value that must stay shadowing one is
+    // written as a deletion. Writes go through `limiter` unless it is null,
+    // and `*stop`, if given, is polled between tables. The tables are
+    // synced but belong to no version until LogAndApply adds them or
+    // DropTables removes them. On error nothing is left behind.
+    Status WriteTables(Iterator* input, const Version& base, int base_level, RateLimiter* limiter,
+                       const std::atomic<bool>* stop, std::vector<FileRef>* outputs);
+
+    // Removes tables written by WriteTables that will not be installed.
+    void DropTables(const std::vector<FileRef>& tables);
+
+    // Applies `edit` to the current version, makes the result durable in
+    // the MANIFEST and installs it. Removes tables no version uses anymore.
+    Status LogAndApply(const VersionEdit& edit);
+
+    // Whether a level is over its size limit.
+    bool NeedsCompaction() const;
+
+    // Merges the level with the highest score into the next one. Returns Ok
+    // without doing anything if no level needs it. `*stop` is polled
+    // between outputs, and an interrupted compaction changes nothing.
+    Status CompactOnce(RateLimiter* limiter, const std::atomic<bool>* stop);
+
+private:
+    // Bytes level `level` may hold before it is compacted.
+    uint64_t MaxBytesForLevel(int level) const;
+
+    // Picks the level to compact, or returns -1. Level 0 scores by table
+    // count against the trigger, the others by size against their limit.
+    int PickLevel(const Version& v) const;
+
+    // Whether no table of `v` at `level` or deeper may hold `key`.
+    bool IsBaseLevelForKey(const Version& v, int level, const Slice& key) const;
+
+    // Appends the tables of `level` that overlap [smallest, largest].
+    void GetOverlappingInputs(const Version& v, int level, const Slice& smallest,
+                              const Slice& largest, std::vector<FileRef>* inputs) const;
+
+    // Opens a table for one sequential pass, bypassing the caches.
+    Iterator* NewCompactionIterator(const FileMetaData& f);
+
+    // Closes a table being written by WriteTables; it is kept if `s` is Ok
+    // and the table could be finished.
+    Status FinishTable(Status s, TableBuilder* builder, WritableFile* file, FileMetaData* meta);
+
+    Status WriteManifest(const Version& v, uint64_t flushed_generation);
+
+    void RemoveObsoleteFiles();
+
+    Env* const env_;
+    const std::string dbname_;
+    const Options options_;
+    TableCache* const table_cache_;
+    Statistics* const statistics_;
+
+    std::shared_ptr<const Version> current_;
+
+    // Guards everything below and serialises edits.
+    std::mutex mutex_;
+    uint64_t next_file_number_;
+    uint64_t flushed_generation_;
+    // Versions handed out, for finding the tables still in use.
+    std::vector<std::weak_ptr<const Version>> versions_;
+    // Table files on disk, and those being written.
+    std::set<uint64_t> files_;
+    std::set<uint64_t> pending_;
+    // Largest key compacted out of each level, to go round its key space.
+    std::string compact_pointer_[kNumLevels];
+
+    VersionSet(const VersionSet&);
+    void operator=(const VersionSet&);
+};
@@ -3,7 +3,9 @@
 #include <libpmem.h>
 #endif
 
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <unistd.h>
 #include <cstdio>
 #include <cstring>
 #include <mutex>
@@ -43,7 +45,8 @@ void LogAppender::RecoveryHelper::_get_slice(Slice& slice) {
     *_end_off = pmem_addr - _pmem_base;
 }
 
-LogAppender::LogAppender(const char* file_name, size_t size) {
+LogAppender::LogAppender(const char* file_name, size_t size)
+    : _mapped_len(size), _is_pmem(0), _end_off(sizeof(uint64_t)) {
 #ifdef USE_LIBPMEM
     if ((_pmem.pmem_base = (char*)pmem_map_file(file_name, size,
                                                 PMEM_FILE_CREATE,
@@ -53,7 +56,16 @@ LogAppender::LogAppender(const char* file_name, size_t size) {
         exit(1);
     }
 #else
-    if((_pmem.pmem_base = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, 0, 0)) == NULL) {
+    // Without libpmem the log is an ordinary file, so that it survives a
+    // restart the same way.
+    int fd = open(file_name, O_RDWR | O_CREAT, 0666);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        perror("open log file failed");
+        exit(1);
+    }
+    _pmem.pmem_base = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_pmem.pmem_base == MAP_FAILED) {
         perror("mmap failed");
         exit(1);
     }
@@ -74,6 +86,7 @@ std::pair<Slice, Slice> LogAppender::Append(const Slice& key, const Slice& val)
     Slice nvm_key = _push_back(key);
     Slice nvm_val = _push_back(val);
     (*_pmem.sequence)++;
+    _persist(_pmem.sequence, sizeof(uint64_t));
     return std::make_pair(nvm_key, nvm_val);
 }
 
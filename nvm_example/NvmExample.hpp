@@ -1,46 +1,71 @@
-#ifndef TAIR_CONTEST_KV_CONTEST_NVM_ENGINE_H_
-#define TAIR_CONTEST_KV_CONTEST_NVM_ENGINE_H_
+#ifndef TAIR_CONTEST_KV_CONTEST_NVM_EXAMPLE_H_
+#define TAIR_CONTEST_KV_CONTEST_NVM_EXAMPLE_H_
 
-#include <atomic>
-#include <climits>
 #include <cstddef>
-#include <cstdlib>
-#include <iostream>
+#include <cstdint>
 #include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
 
 #include "include/db.hpp"
 
-class NvmEngine : DB {
+// Append-only log of length-prefixed keys and values. The first 8 bytes of
+// the file count the key/value pairs appended so far.
+class LogAppender {
 public:
-    /**
-     * @param
-     * name: file in AEP(exist)
-     * dbptr: pointer of db object
-     *
-     */
-    static Status CreateOrOpen(const std::string &name, DB **dbptr);
-    NvmEngine(const std::string &name);
-    Status Get(const Slice &key, std::string *value);
-    Status Set(const Slice &key, const Slice &value);
-    ~NvmEngine();
+    class RecoveryHelper {
+    public:
+        RecoveryHelper(char* pmem_base, uint64_t* end_off);
+        // The next logged pair, or a pair of null slices past the end.
+        std::pair<Slice, Slice> Next();
 
-private:
-    static uint32_t _hash(const char *str, uint16_t size);
-    static const size_t NVM_SIZE = 79456894976;
-    static const size_t DRAM_SIZE = 4200000000;
-    struct entry_t {
-        char key[16];
-        char value[80];
+    private:
+        void _get_slice(Slice& slice);
+
+        uint64_t* _end_off;
+        char* _pmem_base;
+        uint64_t _sequence;
+        uint64_t _current;
     };
-    static const uint32_t ENTRY_MAX = NVM_SIZE / sizeof(entry_t);
-    static const uint32_t BUCKET_MAX = DRAM_SIZE / sizeof(uint32_t);
-    static const uint32_t BUCKET_PER_MUTEX = 30000000;
-    static const uint32_t MUTEX_CNT = BUCKET_MAX / BUCKET_PER_MUTEX + 1;
-
-    entry_t *entry;
-    uint32_t *bucket;
-    std::atomic<uint32_t> entry_cnt = {1};
-    std::mutex slot_mut[MUTEX_CNT];
+
+    LogAppender(const char* file_name, size_t size);
+    ~LogAppender();
+
+    // Rebuilds `hash_map` from the log and positions the tail after it.
+    void Recovery(std::unordered_map<std::string, Slice>& hash_map);
+    // Returns the logged copies of key and val.
+    std::pair<Slice, Slice> Append(const Slice& key, const Slice& val);
+
+private:
+    void _persist(void* addr, uint32_t len);
+    Slice _push_back(const Slice& slice);
+
+    union {
+        char* pmem_base;
+        uint64_t* sequence;
+    } _pmem;
+    size_t _mapped_len;
+    int _is_pmem;
+    uint64_t _end_off;
+};
+
+// Reference engine: a global mutex around an unordered_map from key to the
+// logged value.
+class NvmExample : DB {
+public:
+    static Status CreateOrOpen(const std::string& name, DB** dbptr, FILE* log_file = nullptr);
+    explicit NvmExample(const std::string& name);
+    Status Get(const Slice& key, std::string* value);
+    Status Set(const Slice& key, const Slice& value);
+    ~NvmExample();
+
+private:
+    static const size_t SIZE = 79456894976UL;
+
+    LogAppender logger;
+    std::mutex mut;
+    std::unordered_map<std::string, Slice> hash_map;
 };
 
 #endif
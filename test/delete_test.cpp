@@ -0,0 +1,101 @@
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include "test_util.hpp"
+
+// Deletes and TTLs over slot-sized and log-sized values, through a flush
+// and a reopen: a deleted or expired key must stay gone, and must not
+// bring back a value it had before.
+
+static const uint64_t kKeys = 80000;
+static const int kThreads = 4;
+
+enum Fate {
+    kDeletedFromSlots,  // Set 80B, Set 80B, Delete
+    kDeletedFromLog,    // Set 100B, Delete
+    kSetAgain,          // Set 80B, Delete, Set 100B
+    kExpired,           // Set 80B, Set 100B with a 1s TTL
+    kNotExpired,        // Set 80B, Set 100B with a 1h TTL
+    kFateCount
+};
+
+static void Verify(DB* db) {
+    std::string value;
+    for (uint64_t i = 0; i < kKeys; ++i) {
+        Status s = db->Get(ToSlice(TestKey(i)), &value);
+        switch (i % kFateCount) {
+        case kDeletedFromSlots:
+        case kDeletedFromLog:
+        case kExpired:
+            CHECK(s == NotFound);
+            break;
+        default:
+            CHECK(s == Ok);
+            CHECK(value == TestValue(i, 2, 100));
+            break;
+        }
+    }
+}
+
+int main() {
+    const std::string name = "./tmp_delete_test";
+    DestroyTestDB(name);
+    Options options = TestOptions();
+
+    DB* db = OpenTestDB(name, options);
+    // Deleting a key that was never set is fine.
+    CHECK(db->Delete(ToSlice(TestKey(kKeys + 5000))) == Ok);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back(std::thread([db, t] {
+            for (uint64_t i = t; i < kKeys; i += kThreads) {
+                std::string k = TestKey(i);
+                Slice key = ToSlice(k);
+                std::string v0 = TestValue(i, 0, 80);
+                std::string v1 = TestValue(i, 1, 80);
+                std::string v2 = TestValue(i, 2, 100);
+                switch (i % kFateCount) {
+                case kDeletedFromSlots:
+                    CHECK(db->Set(key, ToSlice(v0)) == Ok);
+                    CHECK(db->Set(key, ToSlice(v1)) == Ok);
+                    CHECK(db->Delete(key) == Ok);
+                    break;
+                case kDeletedFromLog:
+                    CHECK(db->Set(key, ToSlice(v2)) == Ok);
+                    CHECK(db->Delete(key) == Ok);
+                    break;
+                case kSetAgain:
+                    CHECK(db->Set(key, ToSlice(v0)) == Ok);
+                    CHECK(db->Delete(key) == Ok);
+                    CHECK(db->Set(key, ToSlice(v2)) == Ok);
+                    break;
+                case kExpired:
+                    CHECK(db->Set(key, ToSlice(v0)) == Ok);
+                    CHECK(db->Set(key, ToSlice(v2), 1) == Ok);
+                    break;
+                default:
+                    CHECK(db->Set(key, ToSlice(v0)) == Ok);
+                    CHECK(db->Set(key, ToSlice(v2), 3600) == Ok);
+                    break;
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    sleep(2);
+    FillUntilFlushed(db, name, kKeys);
+    Verify(db);
+    delete db;
+
+    db = OpenTestDB(name, options);
+    Verify(db);
+    delete db;
+
+    DestroyTestDB(name);
+    printf("delete_test passed\n");
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "test_util.hpp"
+
+// Kills a writer while its log is being flushed, one segment per batch,
+// and reopens: every key must come back with its last acknowledged value.
+// Keys are written in groups. Each thread sets every key of a group in
+// turn, so the key's records are spread over the pools' segments and thus
+// over the batches of a flush, and then the group is left alone, so that
+// a flush unlinks its keys from the index. A group written long before
+// gets one more, slot-sized, value at the same time, which is where a key
+// unlinked by a flush starts over.
+
+static const int kThreads = 4;
+static const int kGroups = 200;
+static const int kGroupKeys = 1000;
+static const int kKeys = kGroups * kGroupKeys;
+static const int kRounds = 8;
+
+// The last version of each key a Set returned for, -1 before the first.
+// Shared with the parent, which reads it once the writer is dead.
+static std::atomic<int>* acked;
+
+static size_t SizeOf(int version) {
+    return version % 5 == 4 ? 80 : 100;
+}
+
+static void SetNext(DB* db, int k) {
+    int v = acked[k].load(std::memory_order_relaxed) + 1;
+    std::string key = TestKey(k);
+    std::string value = TestValue(k, v, SizeOf(v));
+    CHECK(db->Set(ToSlice(key), ToSlice(value)) == Ok);
+    acked[k].store(v, std::memory_order_release);
+}
+
+static void RunWriter(const std::string& name, const Options& options) {
+    DB* db = OpenTestDB(name, options);
+    std::mutex mu;
+    std::condition_variable cv;
+    int arrived = 0;
+    int version = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back(std::thread([&, t] {
+            // In round r, key k of the current group is set by thread
+            // (k + r) % kThreads, which is bound to a pool of its own.
+            for (int r = 0;; ++r) {
+                int group = r / kThreads % kGroups;
+                int first = (kThreads + t - r % kThreads) % kThreads;
+                for (int i = first; i < kGroupKeys; i += kThreads) {
+                    SetNext(db, group * kGroupKeys + i);
+                }
+                if (r % kThreads == 0) {
+                    int old = (group + kGroups / 2) % kGroups;
+                    for (int i = first; i < kGroupKeys; i += kThreads) {
+                        SetNext(db, old * kGroupKeys + i);
+                    }
+                }
+                std::unique_lock<std::mutex> l(mu);
+                if (++arrived == kThreads) {
+                    arrived = 0;
+                    ++version;
+                    cv.notify_all();
+                } else {
+                    cv.wait(l, [&] { return version > r; });
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+}
+
+// A key may also hold the version that was in flight when the writer died.
+static void Verify(DB* db) {
+    std::string value;
+    for (int k = 0; k < kKeys; ++k) {
+        int v = acked[k].load(std::memory_order_acquire);
+        std::string key = TestKey(k);
+        Status s = db->Get(ToSlice(key), &value);
+        if (v < 0) {
+            CHECK(s == NotFound || value == TestValue(k, 0, SizeOf(0)));
+            continue;
+        }
+        CHECK(s == Ok);
+        CHECK(value == TestValue(k, v, SizeOf(v)) || value == TestValue(k, v + 1, SizeOf(v + 1)));
+    }
+}
+
+int main() {
+    const std::string name = "./tmp_flush_crash_test";
+    // A log of eight segments, flushed a few times a second.
+    Options options = TestOptions();
+    options.pmem_size = 16UL << 20;
+    options.max_flush_batch_size = options.log_segment_size;
+    acked = static_cast<std::atomic<int>*>(mmap(nullptr, kKeys * sizeof(std::atomic<int>),
+                                                PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    CHECK(acked != MAP_FAILED);
+
+    std::mt19937 rnd(301);
+    int flushed = 0;
+    for (int round = 0; round < kRounds; ++round) {
+        DestroyTestDB(name);
+        for (int k = 0; k < kKeys; ++k) {
+            acked[k].store(-1);
+        }
+        pid_t pid = fork();
+        CHECK(pid >= 0);
+        if (pid == 0) {
+            RunWriter(name, options);
+            _exit(0);
+        }
+        usleep(500000 + rnd() % 2000000);
+        CHECK(kill(pid, SIGKILL) == 0);
+        int status;
+        CHECK(waitpid(pid, &status, 0) == pid);
+        CHECK(WIFSIGNALED(status));
+
+        flushed += HasTables(name + ".tables");
+        DB* db = OpenTestDB(name, options);
+        Verify(db);
+        delete db;
+        // And once more, after whatever the first reopen flushed.
+        db = OpenTestDB(name, options);
+        Verify(db);
+        delete db;
+    }
+    CHECK(flushed > 0);
+
+    DestroyTestDB(name);
+    printf("flush_crash_test passed\n");
+    return 0;
+}
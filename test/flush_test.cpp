@@ -0,0 +1,69 @@
+#include <thread>
+#include <vector>
+
+#include "test_util.hpp"
+
+// Overwrites keys with a mix of slot-sized (80 byte) and log-sized values,
+// flushes the log into tables and reopens: every key must come back with
+// its last value, not an older one from the slot store.
+
+static const uint64_t kKeys = 80000;
+static const int kThreads = 4;
+
+// The sizes each key is set to, in order.
+static std::vector<size_t> Sizes(uint64_t i) {
+    switch (i % 4) {
+    case 0: return {80, 80, 100};
+    case 1: return {100, 80};
+    case 2: return {80, 100, 80};
+    default: return {100, 100};
+    }
+}
+
+static void Verify(DB* db) {
+    std::string value;
+    for (uint64_t i = 0; i < kKeys; ++i) {
+        std::vector<size_t> sizes = Sizes(i);
+        CHECK(db->Get(ToSlice(TestKey(i)), &value) == Ok);
+        CHECK(value == TestValue(i, (int)sizes.size() - 1, sizes.back()));
+    }
+}
+
+int main() {
+    const std::string name = "./tmp_flush_test";
+    DestroyTestDB(name);
+    Options options = TestOptions();
+
+    DB* db = OpenTestDB(name, options);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back(std::thread([db, t] {
+            for (uint64_t i = t; i < kKeys; i += kThreads) {
+                std::vector<size_t> sizes = Sizes(i);
+                for (size_t v = 0; v < sizes.size(); ++v) {
+                    CHECK(db->Set(ToSlice(TestKey(i)), ToSlice(TestValue(i, (int)v, sizes[v]))) ==
+                          Ok);
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    FillUntilFlushed(db, name, kKeys);
+    Verify(db);
+    delete db;
+
+    db = OpenTestDB(name, options);
+    Verify(db);
+    delete db;
+
+    // And once more, now that the reopen has rebuilt the index.
+    db = OpenTestDB(name, options);
+    Verify(db);
+    delete db;
+
+    DestroyTestDB(name);
+    printf("flush_test passed\n");
+    return 0;
+}
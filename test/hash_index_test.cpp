@@ -0,0 +1,80 @@
+#include <random>
+#include <vector>
+
+#include "test_util.hpp"
+
+// Fills the index, erases every key as a flush would and fills it again
+// with new ones, many times over: lookups of keys that are gone, and of
+// those that are there, must stay as short as in a fresh index.
+
+static const size_t kSlots = 12000;
+static const size_t kKeys = 9000;
+static const int kRounds = 200;
+
+int main() {
+    HashIndex index(kSlots);
+    std::mt19937_64 rnd(42);
+    std::vector<uint64_t> hashes;
+    std::vector<uint64_t> gone;
+    std::vector<ValueHandle> gone_handles;
+    ValueHandle next_handle = 1;
+
+    for (int round = 0; round < kRounds; ++round) {
+        std::vector<ValueHandle> handles;
+        hashes.clear();
+        for (size_t i = 0; i < kKeys; ++i) {
+            uint64_t hash = rnd();
+            ValueHandle handle = next_handle++;
+            bool inserted;
+            HashIndex::Slot* slot =
+                index.FindOrInsert(hash, [&](ValueHandle) { return false; }, &inserted);
+            CHECK(slot != nullptr && inserted);
+            // Now and then an insert fails and hands its slot back.
+            if (i % 10 == 0) {
+                index.Abandon(hash, slot);
+                continue;
+            }
+            slot->store(handle);
+            hashes.push_back(hash);
+            handles.push_back(handle);
+        }
+
+        size_t probed_sum = 0;
+        size_t probed_max = 0;
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            size_t probed;
+            ValueHandle want = handles[i];
+            HashIndex::Slot* slot =
+                index.Find(hashes[i], [&](ValueHandle h) { return h == want; }, &probed);
+            CHECK(slot != nullptr);
+            probed_sum += probed;
+            probed_max = std::max(probed_max, probed);
+        }
+        for (size_t i = 0; i < gone.size(); ++i) {
+            size_t probed;
+            ValueHandle old = gone_handles[i];
+            CHECK(index.Find(gone[i], [&](ValueHandle h) { return h == old; }, &probed) ==
+                  nullptr);
+            probed_sum += probed;
+            probed_max = std::max(probed_max, probed);
+        }
+        size_t lookups = hashes.size() + gone.size();
+        CHECK(probed_sum <= 2 * lookups);
+        CHECK(probed_max <= 16);
+
+        gone.clear();
+        gone_handles.clear();
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            ValueHandle want = handles[i];
+            HashIndex::Slot* slot =
+                index.Find(hashes[i], [&](ValueHandle h) { return h == want; });
+            CHECK(slot != nullptr);
+            index.Erase(hashes[i], slot);
+            gone.push_back(hashes[i]);
+            gone_handles.push_back(want);
+        }
+    }
+
+    printf("hash_index_test passed\n");
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <thread>
+#include <vector>
+
+#include "test_util.hpp"
+
+// A sharded engine: sets, deletes, MultiGet and a snapshot across shards,
+// then a reopen with options that ask for no sharding, which must still
+// find the shard count the engine was created with.
+
+static const uint64_t kKeys = 40000;
+static const int kThreads = 4;
+
+static bool Deleted(uint64_t i) {
+    return i % 11 == 0;
+}
+
+static std::string ValueOf(uint64_t i) {
+    return TestValue(i, 1, i % 2 == 0 ? 80 : 100);
+}
+
+static void Verify(DB* db) {
+    std::string value;
+    for (uint64_t i = 0; i < kKeys; ++i) {
+        Status s = db->Get(ToSlice(TestKey(i)), &value);
+        if (Deleted(i)) {
+            CHECK(s == NotFound);
+        } else {
+            CHECK(s == Ok);
+            CHECK(value == ValueOf(i));
+        }
+    }
+
+    std::vector<std::string> keys(kKeys);
+    std::vector<Slice> slices(kKeys);
+    for (uint64_t i = 0; i < kKeys; ++i) {
+        keys[i] = TestKey(i);
+        slices[i] = ToSlice(keys[i]);
+    }
+    std::vector<std::string> values(kKeys);
+    std::vector<Status> statuses(kKeys);
+    db->MultiGet(kKeys, slices.data(), values.data(), statuses.data());
+    for (uint64_t i = 0; i < kKeys; ++i) {
+        CHECK(statuses[i] == (Deleted(i) ? NotFound : Ok));
+        CHECK(Deleted(i) || values[i] == ValueOf(i));
+    }
+}
+
+int main() {
+    const std::string name = "./tmp_shard_test";
+    DestroyTestDB(name);
+    Options options = TestOptions();
+    options.shards = 4;
+    options.pmem_size *= 4;
+    options.index_slots *= 4;
+    options.inline_arena_size *= 4;
+
+    DB* db = OpenTestDB(name, options);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.push_back(std::thread([db, t] {
+            for (uint64_t i = t; i < kKeys; i += kThreads) {
+                std::string key = TestKey(i);
+                CHECK(db->Set(ToSlice(key), ToSlice(TestValue(i, 0, 80))) == Ok);
+                CHECK(db->Set(ToSlice(key), ToSlice(ValueOf(i))) == Ok);
+                if (Deleted(i)) {
+                    CHECK(db->Delete(ToSlice(key)) == Ok);
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    Verify(db);
+
+    const Snapshot* snapshot = db->GetSnapshot();
+    CHECK(snapshot != nullptr);
+    std::string value;
+    std::string key = TestKey(1);
+    CHECK(db->Set(ToSlice(key), ToSlice(TestValue(1, 2, 80))) == Ok);
+    CHECK(db->Get(snapshot, ToSlice(key), &value) == Ok);
+    CHECK(value == ValueOf(1));
+    db->ReleaseSnapshot(snapshot);
+    CHECK(db->Set(ToSlice(key), ToSlice(ValueOf(1))) == Ok);
+    delete db;
+
+    options.shards = 1;
+    db = OpenTestDB(name, options);
+    Verify(db);
+    delete db;
+
+    DestroyTestDB(name);
+    printf("shard_test passed\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <vector>
+
+#include "test_util.hpp"
+
+// Snapshots over slot-sized and log-sized overwrites and deletes: Gets at a
+// snapshot keep seeing what it saw while the keys change under it and the
+// log is flushed into tables, and releasing one does not disturb another.
+
+static const uint64_t kKeys = 20000;
+
+// Version `v` of key `i`, or empty if it is deleted then.
+static std::string ValueAt(uint64_t i, int v) {
+    if (v == 2 && i % 5 == 0) {
+        return std::string();
+    }
+    return TestValue(i, v, (i + v) % 3 == 0 ? 100 : 80);
+}
+
+static void Write(DB* db, int v) {
+    for (uint64_t i = 0; i < kKeys; ++i) {
+        std::string key = TestKey(i);
+        std::string value = ValueAt(i, v);
+        if (value.empty()) {
+            CHECK(db->Delete(ToSlice(key)) == Ok);
+        } else {
+            CHECK(db->Set(ToSlice(key), ToSlice(value)) == Ok);
+        }
+    }
+}
+
+static void Verify(DB* db, const Snapshot* snapshot, int v) {
+    std::string value;
+    for (uint64_t i = 0; i < kKeys; ++i) {
+        std::string expected = ValueAt(i, v);
+        Status s = db->Get(snapshot, ToSlice(TestKey(i)), &value);
+        if (expected.empty()) {
+            CHECK(s == NotFound);
+        } else {
+            CHECK(s == Ok);
+            CHECK(value == expected);
+        }
+    }
+}
+
+int main() {
+    const std::string name = "./tmp_snapshot_test";
+    DestroyTestDB(name);
+    DB* db = OpenTestDB(name, TestOptions());
+
+    Write(db, 0);
+    const Snapshot* first = db->GetSnapshot();
+    CHECK(first != nullptr);
+    Write(db, 1);
+    const Snapshot* second = db->GetSnapshot();
+    Write(db, 2);
+    Verify(db, first, 0);
+    Verify(db, second, 1);
+    Verify(db, nullptr, 2);
+
+    FillUntilFlushed(db, name, kKeys);
+    Verify(db, first, 0);
+    Verify(db, second, 1);
+    Verify(db, nullptr, 2);
+
+    db->ReleaseSnapshot(first);
+    Write(db, 3);
+    Verify(db, second, 1);
+    Verify(db, nullptr, 3);
+    db->ReleaseSnapshot(second);
+    Verify(db, nullptr, 3);
+    delete db;
+
+    DestroyTestDB(name);
+    printf("snapshot_test passed\n");
+    return 0;
+}
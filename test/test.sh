@@ -5,3 +5,10 @@ g++ -std=c++11 -o test -g -I.. test.cpp -L../lib -lengine -lpthread -lrt -lz -lp
 rm -rf ./tmp
 
 ./test
+
+# Engine tests: each reopens its own db under ./tmp_<name> and exits
+# non-zero on failure.
+for t in hash_index_test flush_test flush_crash_test delete_test slot_test snapshot_test shard_test; do
+    g++ -std=c++11 -O2 -msse4.2 -maes -o $t -I.. -I../nvm_engine $t.cpp -L../lib -lengine -lpthread || exit 1
+    ./$t || exit 1
+done
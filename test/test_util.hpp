@@ -0,0 +1,93 @@
+#pragma once
+
+#include <dirent.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "include/db.hpp"
+#include "nvm_engine/NvmEngine.hpp"
+
+// Shared by the engine tests: each one is a program that exits non-zero
+// on the first failed check.
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                                 \
+        }                                                                            \
+    } while (0)
+
+// A distinct 16-byte key per number.
+inline std::string TestKey(uint64_t i) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)(i * 0x9e3779b97f4a7c15ULL));
+    return std::string(buf, 16);
+}
+
+// A value of `size` bytes that differs per key and version.
+inline std::string TestValue(uint64_t i, int version, size_t size) {
+    std::string value(size, (char)('a' + (i + version) % 26));
+    char buf[32];
+    size_t n = (size_t)snprintf(buf, sizeof(buf), "%llu:%d:", (unsigned long long)i, version);
+    value.replace(0, n < size ? n : size, buf, n < size ? n : size);
+    return value;
+}
+
+inline Slice ToSlice(const std::string& s) {
+    return Slice(const_cast<char*>(s.data()), s.size());
+}
+
+// Small enough that a few hundred thousand writes fill the log and force
+// flushes, each in several batches; 80-byte values go to the slot store.
+inline Options TestOptions() {
+    Options options;
+    options.pmem_size = 64UL << 20;
+    options.log_segment_size = 1UL << 20;
+    options.fixed_value_size = 80;
+    options.pool_count = 4;
+    options.index_slots = 1 << 20;
+    options.inline_arena_size = 8 << 20;
+    options.target_file_size = 2 << 20;
+    options.max_bytes_for_level_base = 8 << 20;
+    options.max_flush_batch_size = 4 << 20;
+    return options;
+}
+
+inline DB* OpenTestDB(const std::string& name, const Options& options) {
+    DB* db = nullptr;
+    CHECK(NvmEngine::CreateOrOpen(name, &db, options) == Ok);
+    return db;
+}
+
+inline void DestroyTestDB(const std::string& name) {
+    std::string command = "rm -rf '" + name + "' '" + name + "'.*";
+    CHECK(system(command.c_str()) == 0);
+}
+
+// Whether a flush has written any table under `dir`.
+inline bool HasTables(const std::string& dir) {
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr) {
+        return false;
+    }
+    bool found = false;
+    for (struct dirent* e; !found && (e = readdir(d)) != nullptr;) {
+        std::string name = e->d_name;
+        found = name.size() > 4 && name.compare(name.size() - 4, 4, ".sst") == 0;
+    }
+    closedir(d);
+    return found;
+}
+
+// Sets a thousand other keys to log-sized values until the log has been
+// flushed into tables at least once.
+inline void FillUntilFlushed(DB* db, const std::string& name, uint64_t first_key) {
+    std::string filler(200, 'f');
+    for (uint64_t i = 0; i < 2000000 && !HasTables(name + ".tables"); ++i) {
+        CHECK(db->Set(ToSlice(TestKey(first_key + i % 1000)), ToSlice(filler)) == Ok);
+    }
+    CHECK(HasTables(name + ".tables"));
+}